@@ -0,0 +1,188 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/BatchQuery.h"
+#include "bbrd/DependencyGraph.h"
+#include "bbrd/Workers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <istream>
+#include <optional>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+
+/// The answer to a single line of a batch.
+struct Answer
+{
+  std::string output = "";
+  bool failed = false;
+};
+
+
+constexpr std::string_view whitespace = " \t\r\n";
+
+
+Answer AnswerQuery(const bbrd::DependencyGraph& graph, std::string_view line)
+{
+  std::ostringstream out;
+  out << "# " << line << "\n";
+  try
+  {
+    if( auto query = bbrd::ParseQuery(line) )
+      bbrd::RunQuery(graph, *query, out);
+    return {out.str(), false};
+  }
+  catch( const std::exception& e )
+  {
+    out << "# error: " << e.what() << "\n";
+    return {out.str(), true};
+  }
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+QueryError::QueryError(const std::string& msg) noexcept
+: std::runtime_error(msg)  // noexcept
+{
+}
+
+
+std::optional<Query> ParseQuery(std::string_view line)
+{
+  Query query{"", false, false};
+  bool has_direction = false;
+  auto set_reverse = [&](bool reverse){
+    if( has_direction && query.reverse != reverse )
+      throw QueryError("provide either depends or rdepends, not both");
+    has_direction = true;
+    query.reverse = reverse;
+  };
+
+  for(;;)
+  {
+    auto begin = line.find_first_not_of(whitespace);
+    if( begin == std::string_view::npos )
+      break;
+
+    line.remove_prefix(begin);
+    auto token = line.substr(0, line.find_first_of(whitespace));
+    line.remove_prefix(token.size());
+
+    if( token.front() == '#' && query.recipe.empty() && !has_direction )
+      return {};
+
+    if( token == "deps" )
+    {
+      set_reverse(false);
+    }
+    else if( token == "rdeps" )
+    {
+      set_reverse(true);
+    }
+    else if( token.front() == '-' && token.size() > 1 )
+    {
+      for(auto flag : token.substr(1))
+        switch( flag )
+        {
+          case 'd': set_reverse(false); break;
+          case 'r': set_reverse(true); break;
+          case 't': query.transitive = true; break;
+          default:
+            throw QueryError(
+              std::string("unknown option '-").append(1, flag).append("'"));
+        }
+    }
+    else if( query.recipe.empty() )
+    {
+      query.recipe = token;
+    }
+    else
+    {
+      throw QueryError("more than one recipe in query");
+    }
+  }
+
+  if( query.recipe.empty() )
+  {
+    if( has_direction || query.transitive )
+      throw QueryError("missing recipe in query");
+    return {};
+  }
+
+  return query;
+}
+
+
+void RunQuery(const DependencyGraph& graph,
+              const Query& query,
+              std::ostream& out)
+{
+  if( query.transitive )
+    graph.list_recipe_depends(query.recipe, query.reverse, out);
+  else
+    graph.list_adjacent_recipes(query.recipe, query.reverse, out);
+}
+
+
+std::size_t RunBatch(const DependencyGraph& graph,
+                     std::istream& in,
+                     std::ostream& out,
+                     unsigned thread_count)
+{
+  // Empty lines and comments are skipped
+  std::vector<std::string> lines;
+  for(std::string line; std::getline(in, line); )
+  {
+    auto begin = line.find_first_not_of(whitespace);
+    if( begin == std::string::npos || line[begin] == '#' )
+      continue;
+
+    auto end = line.find_last_not_of(whitespace) + 1;
+    lines.push_back(line.substr(begin, end - begin));
+  }
+
+  if( thread_count == 0 )
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // DependencyGraph is immutable, therefore queries are answered
+  // concurrently. Every thread takes the next unanswered query until none
+  // are left. The answers are printed in input order.
+  std::vector<Answer> answers(lines.size());
+  std::atomic<std::size_t> next(0);
+  auto worker = [&](std::size_t){
+    for(auto i = next++; i < lines.size(); i = next++)
+      answers[i] = AnswerQuery(graph, lines[i]);
+  };
+
+  RunWorkers(std::min<std::size_t>(thread_count, lines.size()), worker);
+
+  std::size_t failed = 0;
+  for(const auto& answer : answers)
+  {
+    out << answer.output;
+    failed += answer.failed;
+  }
+
+  return failed;
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,64 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/DependencyGraph.h"
+
+#include <cstddef>
+#include <iosfwd>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// Thrown if a query cannot be parsed.
+class QueryError : public std::runtime_error
+{
+public:
+  explicit QueryError(const std::string& msg) noexcept;
+};
+
+
+/// A single question about a recipe, e.g. "rdeps -t openssl".
+struct Query
+{
+  std::string recipe;
+  bool reverse;
+  bool transitive;
+};
+
+
+/// Parse a query of the form [deps|rdeps] [-d|-r|-t]... <recipe>. The flags
+/// have the same meaning as on the command line and may be combined
+/// (e.g. -tr). Returns nothing for empty lines and comments starting with
+/// '#'. Throws QueryError if line is not a valid query.
+std::optional<Query> ParseQuery(std::string_view line);
+
+
+/// Answer query, writing one recipe per line to out. Throws
+/// std::runtime_error if the recipe does not exist.
+void RunQuery(const DependencyGraph& graph,
+              const Query& query,
+              std::ostream& out);
+
+
+/// Answer the queries read from in, one per line. The answers are written to
+/// out in input order. Every answer is preceded by a label "# <query>",
+/// errors are reported as "# error: <message>" after the label.
+/// Queries are answered by thread_count threads. If thread_count is 0, it
+/// is the number of cores.
+/// Returns the number of queries that failed.
+std::size_t RunBatch(const DependencyGraph& graph,
+                     std::istream& in,
+                     std::ostream& out,
+                     unsigned thread_count = 0);
+
+
+} // namespace bbrd
+
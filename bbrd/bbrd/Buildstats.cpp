@@ -0,0 +1,192 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/Buildstats.h"
+#include "bbrd/File.h"
+#include "bbrd/GraphImage.h"
+#include "bbrd/Workers.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+
+/// Directories with fewer task files are not worth the overhead of threads.
+constexpr std::size_t min_files_per_thread = 64;
+
+
+/// Read the elapsed time of a task file into seconds. buffer is reused
+/// between calls. Returns the reason on failure.
+std::string ReadElapsedTime(const std::string& path,
+                            std::string& buffer,
+                            double& seconds)
+{
+  // Task files are small, reading them whole is cheaper than a stream
+  std::unique_ptr<std::FILE, int (*)(std::FILE *)> file(
+      std::fopen(path.c_str(), "rb"), std::fclose);
+  if( !file )
+    return "cannot read file";
+
+  buffer.clear();
+  std::array<char, 4096> chunk;
+  for(std::size_t n; ( n = std::fread(chunk.data(), 1, chunk.size(),
+                                      file.get()) ) > 0;)
+    buffer.append(chunk.data(), n);
+  if( std::ferror(file.get()) )
+    return "cannot read file";
+
+  constexpr std::string_view prefix = "Elapsed time: ";
+  for(std::size_t line = 0; line < buffer.size();)
+  {
+    auto end = std::min(buffer.find('\n', line), buffer.size());
+    if( std::string_view(buffer).substr(line, prefix.size()) == prefix )
+    {
+      // strtod stops at the newline
+      auto begin = buffer.c_str() + line + prefix.size();
+      char * parsed = nullptr;
+      seconds = std::strtod(begin, &parsed);
+      if( parsed == begin || seconds < 0 )
+        return "invalid elapsed time";
+      return "";
+    }
+    line = end + 1;
+  }
+
+  return "no elapsed time (task has not finished)";
+}
+
+
+/// The id of the recipe a buildstats directory (PN-PV-PR) belongs to.
+std::optional<bbrd::GraphImage::Id> FindRecipe(const bbrd::GraphImage& image,
+                                               std::string_view directory)
+{
+  if( auto id = image.find(directory) )
+    return id;
+
+  // PV and PR rarely contain "-", PN often does, e.g. gcc-cross-i686
+  for(auto dash = directory.rfind('-');
+      dash != std::string_view::npos && dash > 0;
+      dash = directory.rfind('-', dash - 1))
+    if( auto id = image.find(directory.substr(0, dash)) )
+      return id;
+
+  return std::nullopt;
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+Buildstats Buildstats::Read(const std::string& directory,
+                            unsigned thread_count,
+                            std::size_t max_open_files)
+{
+  namespace fs = std::filesystem;
+
+  Buildstats stats;
+  try
+  {
+    if( !fs::is_directory(directory) )
+      throw FileError("cannot read '" + directory + "': not a directory");
+
+    // Listing holds one open directory per level
+    for(const auto& entry : fs::recursive_directory_iterator(directory))
+    {
+      auto name = entry.path().filename().string();
+      if( name.compare(0, 3, "do_") == 0 && entry.is_regular_file() )
+        stats.tasks.push_back(Task{
+            entry.path().string(),
+            entry.path().parent_path().filename().string(),
+            std::move(name),
+            0});
+    }
+  }
+  catch( const fs::filesystem_error& e )
+  {
+    throw FileError("cannot read '" + directory + "': " + e.code().message());
+  }
+
+  std::sort(stats.tasks.begin(), stats.tasks.end(),
+            [](const Task& a, const Task& b){ return a.path < b.path; });
+
+  if( thread_count == 0 )
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  auto threads = std::min<std::size_t>(
+      {thread_count,
+       std::max<std::size_t>(max_open_files, 1),
+       stats.tasks.size() / min_files_per_thread + 1});
+
+  std::vector<std::string> reasons(stats.tasks.size());
+  std::atomic<std::size_t> next(0);
+  RunWorkers(threads, [&stats, &reasons, &next](std::size_t){
+    std::string buffer;
+    for(auto i = next++; i < stats.tasks.size(); i = next++)
+      reasons[i] = ReadElapsedTime(
+          stats.tasks[i].path, buffer, stats.tasks[i].seconds);
+  });
+
+  // Keep the tasks with a duration, in path order
+  std::size_t kept = 0;
+  for(std::size_t i = 0; i < stats.tasks.size(); ++i)
+  {
+    if( !reasons[i].empty() )
+      stats.errors.push_back(stats.tasks[i].path + ": " + reasons[i]);
+    else if( kept++ != i )
+      stats.tasks[kept - 1] = std::move(stats.tasks[i]);
+  }
+  stats.tasks.resize(kept);
+
+  return stats;
+}
+
+Buildstats::Durations Buildstats::match(const GraphImage& image) const
+{
+  Durations durations;
+  durations.seconds.assign(image.task_count(), 0);
+  std::vector<bool> seen(image.task_count(), false);
+  for(const auto& task : this->tasks)
+  {
+    auto recipe = FindRecipe(image, task.recipe);
+    if( !recipe )
+    {
+      durations.unmatched.push_back(task.path + ": recipe not found");
+      continue;
+    }
+
+    auto id = image.find_task(*recipe, task.task);
+    if( !id )
+    {
+      durations.unmatched.push_back(task.path + ": task not found");
+      continue;
+    }
+
+    durations.seconds[*id] = task.seconds;
+    if( !seen[*id] )
+      durations.matched++;
+    seen[*id] = true;
+  }
+
+  return durations;
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,69 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/GraphImage.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// The durations of tasks recorded by Yocto's buildstats class.
+///
+/// A buildstats directory contains one directory per build, which contains
+/// one directory per recipe, named after PN-PV-PR (e.g. "curl-7.69.1-r0"),
+/// which contains one file per task (e.g. "do_compile"). A task file has a
+/// line "Elapsed time: 12.34 seconds" once the task has finished.
+struct Buildstats
+{
+  /// The number of task files that are open at the same time.
+  static constexpr std::size_t default_max_open_files = 64;
+
+  struct Task
+  {
+    std::string path = {};
+    /// The name of the recipe directory, i.e. PN-PV-PR
+    std::string recipe = {};
+    std::string task = {};
+    double seconds = 0;
+  };
+
+  /// The duration of every task of a graph image, indexed by task.
+  struct Durations
+  {
+    /// 0 if the task has no buildstats
+    std::vector<double> seconds = {};
+    std::size_t matched = 0;
+    /// Task files that do not belong to a task of the image, with reason
+    std::vector<std::string> unmatched = {};
+  };
+
+  /// Read all task files below directory, which may be the buildstats
+  /// directory, a single build or a single recipe. Task files are read by
+  /// thread_count threads, each holding at most one open file, but no more
+  /// than max_open_files threads. If thread_count is 0, it is the number of
+  /// cores. Throws FileError if directory cannot be read.
+  static Buildstats Read(const std::string& directory,
+                         unsigned thread_count = 0,
+                         std::size_t max_open_files = default_max_open_files);
+
+  /// Assign the durations to the tasks of image. A recipe directory belongs
+  /// to the recipe with the longest name that is followed by "-" (PN-PV-PR).
+  /// If a task was recorded more than once, e.g. in several builds, the last
+  /// one in path order wins.
+  Durations match(const GraphImage& image) const;
+
+  /// Sorted by path.
+  std::vector<Task> tasks = {};
+  /// Task files that could not be read or have not finished, with reason
+  std::vector<std::string> errors = {};
+};
+
+
+} // namespace bbrd
+
@@ -0,0 +1,196 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/bbrd.h"
+#include "bbrd/DependencyGraph.h"
+#include "bbrd/ReadGraph.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+struct bbrd_graph
+{
+  bbrd::DependencyGraph graph;
+};
+
+
+namespace {
+
+
+thread_local std::string last_error;
+
+
+/// Call f and return 0, or keep the message of the exception it throws and
+/// return -1. No exception may cross the C interface.
+template<typename F>
+int TryOrKeepError(F f) noexcept
+{
+  try
+  {
+    f();
+    return 0;
+  }
+  catch( const std::exception& e )
+  {
+    try
+    {
+      last_error = e.what();
+    }
+    catch( ... )
+    {
+      last_error.clear();
+    }
+  }
+  catch( ... )
+  {
+    last_error.clear();
+  }
+
+  return -1;
+}
+
+
+/// Throws std::out_of_range if recipe does not exist. Recipes that only
+/// occur in dependencies between their own tasks, which a cached image with
+/// tasks keeps, do not exist in the recipe graph.
+void RequireRecipe(const bbrd_graph * graph, bbrd_id recipe)
+{
+  const auto& image = graph->graph.image();
+  if( recipe >= image.recipe_count() || !image.in_recipe_graph(recipe) )
+    throw std::out_of_range(
+        "recipe not found: id " + std::to_string(recipe));
+}
+
+
+} // namespace
+
+
+extern "C" {
+
+
+const char * bbrd_last_error(void)
+{
+  return last_error.c_str();
+}
+
+bbrd_graph * bbrd_graph_open(const char * path,
+                             const char * cache_dir,
+                             unsigned flags,
+                             unsigned thread_count)
+{
+  std::unique_ptr<bbrd_graph> graph;
+  TryOrKeepError([&]{
+    if( !path )
+      throw std::invalid_argument("no path");
+
+    bbrd::ReadGraphOptions options;
+    options.thread_count = thread_count;
+    options.closure = flags & BBRD_CLOSURE;
+    options.cache = !( flags & BBRD_NO_CACHE );
+    if( cache_dir )
+      options.cache_dir = cache_dir;
+
+    // The cache is an optimization, a failure to write it is ignored
+    graph.reset(new bbrd_graph{bbrd::DependencyGraph(
+        bbrd::ReadGraphImage(path, options))});
+  });
+
+  return graph.release();
+}
+
+void bbrd_graph_close(bbrd_graph * graph)
+{
+  delete graph;
+}
+
+size_t bbrd_recipe_count(const bbrd_graph * graph)
+{
+  return graph->graph.image().recipe_count();
+}
+
+size_t bbrd_dependency_count(const bbrd_graph * graph)
+{
+  return graph->graph.image().dependency_count();
+}
+
+int bbrd_find_recipe(const bbrd_graph * graph,
+                     const char * name,
+                     size_t size,
+                     bbrd_id * id)
+{
+  return TryOrKeepError([&]{
+    std::string_view recipe(name, size);
+    auto found = graph->graph.find(recipe);
+    if( !found )
+      throw std::runtime_error(
+          std::string("recipe not found: ").append(recipe));
+    *id = *found;
+  });
+}
+
+int bbrd_recipe_name(const bbrd_graph * graph,
+                     bbrd_id recipe,
+                     bbrd_string * name)
+{
+  return TryOrKeepError([&]{
+    RequireRecipe(graph, recipe);
+    auto recipe_name = graph->graph.image().recipe_name(recipe);
+    *name = bbrd_string{recipe_name.data(), recipe_name.size()};
+  });
+}
+
+int bbrd_adjacent_recipes(const bbrd_graph * graph,
+                          bbrd_id recipe,
+                          int reverse,
+                          bbrd_ids * adjacent)
+{
+  return TryOrKeepError([&]{
+    RequireRecipe(graph, recipe);
+    auto [first, last] = graph->graph.adjacent_recipes(recipe, reverse);
+    *adjacent = bbrd_ids{first, static_cast<size_t>(last - first)};
+  });
+}
+
+int bbrd_transitive_recipes(const bbrd_graph * graph,
+                            bbrd_id recipe,
+                            int reverse,
+                            bbrd_ids * transitive)
+{
+  return TryOrKeepError([&]{
+    RequireRecipe(graph, recipe);
+    auto recipes = graph->graph.transitive_recipes(recipe, reverse);
+    auto ids = std::make_unique<bbrd_id[]>(recipes.size());
+    std::copy(recipes.begin(), recipes.end(), ids.get());
+    *transitive = bbrd_ids{ids.release(), recipes.size()};
+  });
+}
+
+void bbrd_ids_free(bbrd_ids ids)
+{
+  delete[] ids.ids;
+}
+
+int bbrd_depends_on(const bbrd_graph * graph,
+                    bbrd_id recipe,
+                    bbrd_id dependency)
+{
+  bool depends = false;
+  auto status = TryOrKeepError([&]{
+    RequireRecipe(graph, recipe);
+    RequireRecipe(graph, dependency);
+    const auto& image = graph->graph.image();
+    depends = graph->graph.depends_on(image.recipe_name(recipe),
+                                      image.recipe_name(dependency));
+  });
+
+  return status == 0 ? depends : -1;
+}
+
+
+} // extern "C"
+
@@ -0,0 +1,137 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/ClosureIndex.h"
+#include "bbrd/Condensation.h"
+#include "bbrd/CsrGraph.h"
+#include "bbrd/Workers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+
+using Word = bbrd::ClosureIndex::Word;
+using Component = bbrd::Condensation::Component;
+
+
+/// Graphs with fewer components are not worth the overhead of threads.
+constexpr std::size_t min_components_per_thread = 256;
+
+
+/// Set the row of component c from its members and the rows of its
+/// successors, which must be complete.
+void BuildRow(const bbrd::Condensation& condensation,
+              const bbrd::CsrGraph& successors,
+              Component c,
+              Word * rows,
+              std::size_t words_per_row)
+{
+  auto row = rows + c * words_per_row;
+  for(auto v = condensation.members_begin(c);
+      v != condensation.members_end(c);
+      ++v)
+    row[*v / bbrd::ClosureIndex::word_bits] |=
+      Word(1) << (*v % bbrd::ClosureIndex::word_bits);
+
+  for(auto d = successors.targets_begin(c);
+      d != successors.targets_end(c);
+      ++d)
+  {
+    auto other = rows + *d * words_per_row;
+    for(std::size_t i = 0; i < words_per_row; ++i)
+      row[i] |= other[i];
+  }
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+void ClosureIndex::Build(const Condensation& condensation,
+                         bool reverse,
+                         Word * rows,
+                         unsigned thread_count)
+{
+  auto component_count = condensation.component_count();
+  auto words_per_row = WordsPerRow(condensation.vertex_count());
+  auto successors = reverse ? condensation.reverse() : condensation.forward();
+  auto predecessors = reverse ? condensation.forward() : condensation.reverse();
+
+  if( thread_count == 0 )
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  thread_count = static_cast<unsigned>(std::min<std::size_t>(
+      thread_count, component_count / min_components_per_thread + 1));
+
+  if( thread_count < 2 )
+  {
+    // Components are numbered in reverse topological order
+    for(std::size_t i = 0; i < component_count; ++i)
+    {
+      auto c = static_cast<Component>(reverse ? component_count - 1 - i : i);
+      BuildRow(condensation, successors, c, rows, words_per_row);
+    }
+    return;
+  }
+
+  // A component is ready once the rows of all its successors are built.
+  // Ready components are processed concurrently.
+  std::vector<std::atomic<std::size_t>> pending(component_count);
+  std::vector<Component> ready;
+  for(Component c = 0; c < component_count; ++c)
+  {
+    pending[c] = out_degree(c, successors);
+    if( pending[c] == 0 )
+      ready.push_back(c);
+  }
+
+  std::mutex mutex;
+  std::condition_variable cond;
+  std::size_t remaining = component_count;
+  auto worker = [&](std::size_t){
+    for(;;)
+    {
+      Component c;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        cond.wait(lock, [&]{ return !ready.empty() || remaining == 0; });
+        if( ready.empty() )
+          return;
+        c = ready.back();
+        ready.pop_back();
+      }
+
+      BuildRow(condensation, successors, c, rows, words_per_row);
+
+      std::vector<Component> now_ready;
+      for(auto p = predecessors.targets_begin(c);
+          p != predecessors.targets_end(c);
+          ++p)
+        if( --pending[*p] == 0 )
+          now_ready.push_back(*p);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.insert(ready.end(), now_ready.begin(), now_ready.end());
+        remaining--;
+      }
+      cond.notify_all();
+    }
+  };
+
+  RunWorkers(thread_count, worker);
+}
+
+
+} // namespace bbrd
+
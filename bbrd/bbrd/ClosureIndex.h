@@ -0,0 +1,128 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/Condensation.h"
+#include "bbrd/CsrGraph.h"
+
+#include <cstddef>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+namespace bbrd {
+
+
+/// The index of the lowest set bit of word, which must not be 0.
+inline std::size_t CountTrailingZeros(std::uint64_t word) noexcept
+{
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return index;
+#else
+  return static_cast<std::size_t>(__builtin_ctzll(word));
+#endif
+}
+
+
+/// A read-only view of the transitive closure of a graph as a bit matrix:
+/// Bit w of row c is set if vertex w is reachable from the vertices of
+/// strongly connected component c. All vertices of a component share a row.
+/// The rows are usually part of a GraphImage.
+class ClosureIndex
+{
+public:
+  using Vertex = CsrGraph::Vertex;
+  using Word = std::uint64_t;
+
+  static constexpr std::size_t word_bits = 64;
+
+  /// The number of words in a row of a graph with vertex_count vertices.
+  static std::size_t WordsPerRow(std::size_t vertex_count) noexcept
+  { return (vertex_count + word_bits - 1) / word_bits; }
+
+  /// Compute the rows of all components of condensation. If reverse is set,
+  /// the closure of the reversed graph is computed.
+  /// rows must hold component_count * WordsPerRow(vertex_count) zeroed words.
+  /// Components are processed bottom-up: A row is the OR of the rows of the
+  /// component's successors, which are computed first. Independent
+  /// components are processed by thread_count threads. If thread_count is 0,
+  /// it is the number of cores.
+  static void Build(const Condensation& condensation,
+                    bool reverse,
+                    Word * rows,
+                    unsigned thread_count = 0);
+
+  /// An empty index, which contains no rows.
+  ClosureIndex() noexcept
+  : component_of_(nullptr)
+  , rows_(nullptr)
+  , vertex_count_(0)
+  , words_per_row_(0)
+  {}
+
+  ClosureIndex(const Vertex * component_of,
+               const Word * rows,
+               std::size_t vertex_count) noexcept
+  : component_of_(component_of)
+  , rows_(rows)
+  , vertex_count_(vertex_count)
+  , words_per_row_(WordsPerRow(vertex_count))
+  {}
+
+  bool empty() const noexcept
+  { return this->rows_ == nullptr; }
+
+  /// Returns true if to is reachable from from. A vertex does not reach
+  /// itself.
+  bool reaches(Vertex from, Vertex to) const noexcept
+  {
+    if( from == to )
+      return false;
+
+    return Test(this->row(from), to);
+  }
+
+  /// Call f for every vertex reachable from from, in ascending order. from
+  /// itself is skipped.
+  template<typename F>
+  void for_each_reachable(Vertex from, F f) const
+  {
+    auto row = this->row(from);
+    for(std::size_t i = 0; i < this->words_per_row_; ++i)
+      for(auto word = row[i]; word; word &= word - 1)
+      {
+        auto v = static_cast<Vertex>(i * word_bits + CountTrailingZeros(word));
+        if( v != from && v < this->vertex_count_ )
+          f(v);
+      }
+  }
+
+  std::size_t words_per_row() const noexcept
+  { return this->words_per_row_; }
+
+  /// The row of component c, which is shared by all of its vertices.
+  const Word * component_row(Vertex c) const noexcept
+  { return this->rows_ + c * this->words_per_row_; }
+
+  /// Returns true if bit v of row is set.
+  static bool Test(const Word * row, Vertex v) noexcept
+  { return ( row[v / word_bits] >> (v % word_bits) ) & 1; }
+
+private:
+  const Word * row(Vertex v) const noexcept
+  { return this->component_row(this->component_of_[v]); }
+
+  const Vertex * component_of_;
+  const Word * rows_;
+  std::size_t vertex_count_;
+  std::size_t words_per_row_;
+};
+
+
+} // namespace bbrd
+
@@ -0,0 +1,145 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/Condensation.h"
+#include "bbrd/CsrGraph.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+
+constexpr std::uint32_t unvisited = std::numeric_limits<std::uint32_t>::max();
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+Condensation::Data Condensation::Compute(const CsrGraph& graph)
+{
+  auto vertex_count = graph.vertex_count();
+  Data data;
+  data.component_of.assign(vertex_count, unvisited);
+  data.member_offsets.assign(1, 0);
+  data.forward_offsets.assign(1, 0);
+
+  // Iterative Tarjan: The call stack holds the vertex and the position of
+  // the next out edge to visit.
+  std::vector<std::uint32_t> index(vertex_count, unvisited);
+  std::vector<std::uint32_t> low_link(vertex_count, 0);
+  std::vector<Vertex> stack;
+  std::vector<std::pair<Vertex, const Vertex *>> call_stack;
+  std::uint32_t next_index = 0;
+  Component next_component = 0;
+
+  for(Vertex root = 0; root < vertex_count; ++root)
+  {
+    if( index[root] != unvisited )
+      continue;
+
+    index[root] = low_link[root] = next_index++;
+    stack.push_back(root);
+    call_stack.push_back({root, graph.targets_begin(root)});
+
+    while( !call_stack.empty() )
+    {
+      auto& [v, next] = call_stack.back();
+      if( next != graph.targets_end(v) )
+      {
+        auto w = *next++;
+        if( index[w] == unvisited )
+        {
+          index[w] = low_link[w] = next_index++;
+          stack.push_back(w);
+          call_stack.push_back({w, graph.targets_begin(w)});
+        }
+        else if( data.component_of[w] == unvisited )
+        {
+          // w is on the stack
+          low_link[v] = std::min(low_link[v], index[w]);
+        }
+        continue;
+      }
+
+      auto done = v;
+      call_stack.pop_back();
+      if( !call_stack.empty() )
+      {
+        auto parent = call_stack.back().first;
+        low_link[parent] = std::min(low_link[parent], low_link[done]);
+      }
+
+      if( low_link[done] != index[done] )
+        continue;
+
+      // done is the root of a component. Components are completed after all
+      // components reachable from them, i.e. in reverse topological order.
+      auto first_member = data.members.size();
+      Vertex member;
+      do
+      {
+        member = stack.back();
+        stack.pop_back();
+        data.component_of[member] = next_component;
+        data.members.push_back(member);
+      }
+      while( member != done );
+
+      std::sort(data.members.begin()
+                  + static_cast<std::ptrdiff_t>(first_member),
+                data.members.end());
+      data.member_offsets.push_back(data.members.size());
+      next_component++;
+    }
+  }
+
+  // Edges between components. seen[d] == c if edge c -> d was already added.
+  std::vector<Component> seen(next_component, unvisited);
+  for(Component c = 0; c < next_component; ++c)
+  {
+    for(auto i = data.member_offsets[c]; i < data.member_offsets[c + 1]; ++i)
+    {
+      auto v = data.members[i];
+      for(auto w = graph.targets_begin(v); w != graph.targets_end(v); ++w)
+      {
+        auto d = data.component_of[*w];
+        if( d != c && seen[d] != c )
+        {
+          seen[d] = c;
+          data.forward_targets.push_back(d);
+        }
+      }
+    }
+
+    data.forward_offsets.push_back(data.forward_targets.size());
+  }
+
+  // Reverse the edges with a counting sort
+  data.reverse_offsets.assign(next_component + 1, 0);
+  for(auto d : data.forward_targets)
+    data.reverse_offsets[d + 1]++;
+  for(std::size_t c = 0; c < next_component; ++c)
+    data.reverse_offsets[c + 1] += data.reverse_offsets[c];
+
+  data.reverse_targets.resize(data.forward_targets.size());
+  std::vector<Offset> next(data.reverse_offsets.begin(),
+                           data.reverse_offsets.end() - 1);
+  for(Component c = 0; c < next_component; ++c)
+    for(auto i = data.forward_offsets[c]; i < data.forward_offsets[c + 1]; ++i)
+      data.reverse_targets[next[data.forward_targets[i]]++] = c;
+
+  return data;
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,133 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/CsrGraph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// A read-only view of the strongly connected components of a graph and the
+/// acyclic graph between them. The arrays are not owned, they are usually
+/// part of a GraphImage.
+///
+/// Components are numbered in reverse topological order: All successors of a
+/// component have smaller numbers. Processing components in ascending order
+/// therefore visits every component after all of its dependencies.
+class Condensation
+{
+public:
+  using Vertex = CsrGraph::Vertex;
+  using Component = CsrGraph::Vertex;
+  using Offset = CsrGraph::Offset;
+
+  /// The arrays of a condensation.
+  struct Data
+  {
+    /// The component of every vertex.
+    std::vector<Component> component_of = {};
+    /// The members of component c are stored in
+    /// members[member_offsets[c]] to members[member_offsets[c + 1]].
+    std::vector<Offset> member_offsets = {};
+    std::vector<Vertex> members = {};
+    /// Edges between components, in CSR format (see CsrGraph).
+    std::vector<Offset> forward_offsets = {};
+    std::vector<Component> forward_targets = {};
+    std::vector<Offset> reverse_offsets = {};
+    std::vector<Component> reverse_targets = {};
+  };
+
+  /// Find the components with Tarjan's algorithm, which is linear in the
+  /// number of vertices and edges.
+  static Data Compute(const CsrGraph& graph);
+
+  /// An empty condensation of an empty graph.
+  Condensation() noexcept
+  : Condensation(nullptr, nullptr, nullptr, nullptr, nullptr, nullptr, nullptr,
+                 0, 0)
+  {}
+
+  /// A view of data, which must outlive it.
+  explicit Condensation(const Data& data) noexcept
+  : Condensation(data.component_of.data(),
+                 data.member_offsets.data(),
+                 data.members.data(),
+                 data.forward_offsets.data(),
+                 data.forward_targets.data(),
+                 data.reverse_offsets.data(),
+                 data.reverse_targets.data(),
+                 data.component_of.size(),
+                 data.member_offsets.size() - 1)
+  {}
+
+  Condensation(const Component * component_of,
+               const Offset * member_offsets,
+               const Vertex * members,
+               const Offset * forward_offsets,
+               const Component * forward_targets,
+               const Offset * reverse_offsets,
+               const Component * reverse_targets,
+               std::size_t vertex_count,
+               std::size_t component_count) noexcept
+  : component_of_(component_of)
+  , member_offsets_(member_offsets)
+  , members_(members)
+  , forward_(forward_offsets, forward_targets, component_count)
+  , reverse_(reverse_offsets, reverse_targets, component_count)
+  , vertex_count_(vertex_count)
+  , component_count_(component_count)
+  {}
+
+  std::size_t vertex_count() const noexcept
+  { return this->vertex_count_; }
+
+  std::size_t component_count() const noexcept
+  { return this->component_count_; }
+
+  Component component_of(Vertex v) const noexcept
+  { return this->component_of_[v]; }
+
+  /// The component of every vertex, indexed by vertex.
+  const Component * components() const noexcept
+  { return this->component_of_; }
+
+  /// The vertices of component c, in ascending order.
+  const Vertex * members_begin(Component c) const noexcept
+  { return this->members_ + this->member_offsets_[c]; }
+
+  const Vertex * members_end(Component c) const noexcept
+  { return this->members_ + this->member_offsets_[c + 1]; }
+
+  std::size_t member_count(Component c) const noexcept
+  {
+    return static_cast<std::size_t>(
+        this->member_offsets_[c + 1] - this->member_offsets_[c]);
+  }
+
+  /// Edges between components, without duplicates.
+  const CsrGraph& forward() const noexcept
+  { return this->forward_; }
+
+  /// The edges of forward(), reversed.
+  const CsrGraph& reverse() const noexcept
+  { return this->reverse_; }
+
+private:
+  const Component * component_of_;
+  const Offset * member_offsets_;
+  const Vertex * members_;
+  CsrGraph forward_;
+  CsrGraph reverse_;
+  std::size_t vertex_count_;
+  std::size_t component_count_;
+};
+
+
+} // namespace bbrd
+
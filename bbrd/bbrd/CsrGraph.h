@@ -0,0 +1,171 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <boost/graph/graph_traits.hpp>
+#include <boost/graph/properties.hpp>
+#include <boost/iterator/counting_iterator.hpp>
+#include <boost/iterator/transform_iterator.hpp>
+#include <boost/property_map/property_map.hpp>
+
+
+namespace bbrd {
+
+
+/// A read-only view of one direction of a graph in compressed sparse row
+/// format: The targets of the out edges of vertex v are stored contiguously
+/// in targets[offsets[v]] to targets[offsets[v + 1]].
+/// The arrays are not owned, they are usually part of a GraphImage.
+///
+/// Models the Boost Graph concepts VertexListGraph, IncidenceGraph and
+/// AdjacencyGraph, therefore it can be used with e.g.
+/// boost::breadth_first_search.
+class CsrGraph
+{
+public:
+  using Vertex = std::uint32_t;
+  using Offset = std::uint64_t;
+
+  struct Edge
+  {
+    Vertex source;
+    Vertex target;
+
+    bool operator==(const Edge& other) const noexcept
+    { return this->source == other.source && this->target == other.target; }
+
+    bool operator!=(const Edge& other) const noexcept
+    { return !(*this == other); }
+  };
+
+  /// Creates an edge from the source vertex and a target.
+  struct MakeEdge
+  {
+    Vertex source;
+
+    Edge operator()(Vertex target) const noexcept
+    { return Edge{this->source, target}; }
+  };
+
+  // Boost Graph traits
+  using vertex_descriptor = Vertex;
+  using edge_descriptor = Edge;
+  using directed_category = boost::directed_tag;
+  using edge_parallel_category = boost::disallow_parallel_edge_tag;
+  struct traversal_category
+  : public boost::vertex_list_graph_tag
+  , public boost::incidence_graph_tag
+  , public boost::adjacency_graph_tag
+  {};
+  using vertices_size_type = std::size_t;
+  using edges_size_type = std::size_t;
+  using degree_size_type = std::size_t;
+  using vertex_iterator = boost::counting_iterator<Vertex>;
+  using adjacency_iterator = const Vertex *;
+  using out_edge_iterator = boost::transform_iterator<MakeEdge,
+                                                      const Vertex *>;
+  using in_edge_iterator = void;
+  using edge_iterator = void;
+
+  static Vertex null_vertex() noexcept
+  { return std::numeric_limits<Vertex>::max(); }
+
+  CsrGraph(const Offset * offsets,
+           const Vertex * targets,
+           std::size_t vertex_count) noexcept
+  : offsets_(offsets)
+  , targets_(targets)
+  , vertex_count_(vertex_count)
+  {}
+
+  std::size_t vertex_count() const noexcept
+  { return this->vertex_count_; }
+
+  std::size_t edge_count() const noexcept
+  { return static_cast<std::size_t>(this->offsets_[this->vertex_count_]); }
+
+  const Vertex * targets_begin(Vertex v) const noexcept
+  { return this->targets_ + this->offsets_[v]; }
+
+  const Vertex * targets_end(Vertex v) const noexcept
+  { return this->targets_ + this->offsets_[v + 1]; }
+
+private:
+  const Offset * offsets_;
+  const Vertex * targets_;
+  std::size_t vertex_count_;
+};
+
+
+inline std::pair<CsrGraph::vertex_iterator, CsrGraph::vertex_iterator>
+vertices(const CsrGraph& g) noexcept
+{
+  return {CsrGraph::vertex_iterator(0),
+          CsrGraph::vertex_iterator(
+              static_cast<CsrGraph::Vertex>(g.vertex_count()))};
+}
+
+inline std::size_t num_vertices(const CsrGraph& g) noexcept
+{
+  return g.vertex_count();
+}
+
+inline std::pair<CsrGraph::out_edge_iterator, CsrGraph::out_edge_iterator>
+out_edges(CsrGraph::Vertex v, const CsrGraph& g) noexcept
+{
+  CsrGraph::MakeEdge make_edge{v};
+  return {CsrGraph::out_edge_iterator(g.targets_begin(v), make_edge),
+          CsrGraph::out_edge_iterator(g.targets_end(v), make_edge)};
+}
+
+inline std::size_t out_degree(CsrGraph::Vertex v, const CsrGraph& g) noexcept
+{
+  return static_cast<std::size_t>(g.targets_end(v) - g.targets_begin(v));
+}
+
+inline std::pair<CsrGraph::adjacency_iterator, CsrGraph::adjacency_iterator>
+adjacent_vertices(CsrGraph::Vertex v, const CsrGraph& g) noexcept
+{
+  return {g.targets_begin(v), g.targets_end(v)};
+}
+
+inline CsrGraph::Vertex source(const CsrGraph::Edge& e,
+                               const CsrGraph&) noexcept
+{
+  return e.source;
+}
+
+inline CsrGraph::Vertex target(const CsrGraph::Edge& e,
+                               const CsrGraph&) noexcept
+{
+  return e.target;
+}
+
+inline boost::typed_identity_property_map<CsrGraph::Vertex>
+get(boost::vertex_index_t, const CsrGraph&) noexcept
+{
+  return {};
+}
+
+
+} // namespace bbrd
+
+
+namespace boost {
+
+
+template<>
+struct property_map<bbrd::CsrGraph, vertex_index_t>
+{
+  using type = typed_identity_property_map<bbrd::CsrGraph::Vertex>;
+  using const_type = type;
+};
+
+
+} // namespace boost
+
@@ -0,0 +1,379 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/Decompression.h"
+#include "bbrd/File.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <future>
+#include <limits>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef BBRD_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BBRD_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+
+namespace {
+
+
+/// Compressed input is read in pieces of this size.
+constexpr std::size_t input_size = 1 << 18;
+
+
+#ifdef BBRD_WITH_ZLIB
+/// Decompresses gzip (and zlib) streams. Concatenated gzip members, as
+/// written by `pigz` or `cat a.gz b.gz`, are decompressed one after the
+/// other.
+class GzipDecompressor : public bbrd::Decompressor
+{
+public:
+  GzipDecompressor(bbrd::RawReader read_raw, std::string path)
+  : read_raw_(std::move(read_raw))
+  , path_(std::move(path))
+  , input_(input_size, '\0')
+  , stream_()
+  , in_member_(false)
+  {
+    // 15: largest window, 32: detect the gzip or zlib header
+    if( inflateInit2(&this->stream_, 15 + 32) != Z_OK )
+      throw bbrd::FileError("cannot decompress '" + this->path_ + "'");
+  }
+
+  ~GzipDecompressor() override
+  {
+    inflateEnd(&this->stream_);
+  }
+
+  std::size_t read(char * dest, std::size_t size) override
+  {
+    size = std::min<std::size_t>(size, std::numeric_limits<uInt>::max());
+    this->stream_.next_out = reinterpret_cast<Bytef *>(dest);
+    this->stream_.avail_out = static_cast<uInt>(size);
+
+    while( this->stream_.avail_out > 0 )
+    {
+      if( this->stream_.avail_in == 0 )
+      {
+        auto bytes_read = this->read_raw_(
+            &this->input_[0], this->input_.size());
+        if( bytes_read == 0 )
+        {
+          if( this->in_member_ )
+            throw bbrd::FileError(
+                "cannot decompress '" + this->path_ + "': unexpected end of"
+                " file");
+          break;
+        }
+
+        this->stream_.next_in = reinterpret_cast<Bytef *>(&this->input_[0]);
+        this->stream_.avail_in = static_cast<uInt>(bytes_read);
+      }
+
+      this->in_member_ = true;
+      auto status = inflate(&this->stream_, Z_NO_FLUSH);
+      if( status == Z_STREAM_END )
+      {
+        // Another member may follow
+        this->in_member_ = false;
+        inflateReset(&this->stream_);
+      }
+      else if( status != Z_OK )
+      {
+        throw bbrd::FileError(
+            "cannot decompress '" + this->path_ + "': "
+            + ( this->stream_.msg ? this->stream_.msg : "corrupt input" ));
+      }
+    }
+
+    return size - this->stream_.avail_out;
+  }
+
+private:
+  bbrd::RawReader read_raw_;
+  std::string path_;
+  std::string input_;
+  z_stream stream_;
+  /// Set if the current member has not been decompressed completely
+  bool in_member_;
+};
+#endif
+
+
+#ifdef BBRD_WITH_ZSTD
+using DStreamPtr = std::unique_ptr<ZSTD_DStream, decltype(&ZSTD_freeDStream)>;
+
+
+DStreamPtr CreateDStreamOrThrow()
+{
+  DStreamPtr stream(ZSTD_createDStream(), &ZSTD_freeDStream);
+  if( !stream )
+    throw std::bad_alloc();
+
+  return stream;
+}
+
+
+/// Decompress from input to output until output is full or input is
+/// exhausted. frame_done is set if the last frame was completed. Returns the
+/// number of bytes written.
+std::size_t DecompressStreamOrThrow(ZSTD_DStream * stream,
+                                    ZSTD_inBuffer& input,
+                                    ZSTD_outBuffer& output,
+                                    bool& frame_done,
+                                    const std::string& path)
+{
+  auto output_begin = output.pos;
+  while( output.pos < output.size )
+  {
+    if( input.pos == input.size && frame_done )
+      break;
+
+    auto input_pos = input.pos;
+    auto output_pos = output.pos;
+    auto result = ZSTD_decompressStream(stream, &output, &input);
+    if( ZSTD_isError(result) )
+      throw bbrd::FileError(
+          "cannot decompress '" + path + "': "
+          + ZSTD_getErrorName(result));
+
+    frame_done = ( result == 0 );
+    // Without progress, the last frame is missing its end
+    if( input.pos == input_pos && output.pos == output_pos )
+      throw bbrd::FileError(
+          "cannot decompress '" + path + "': unexpected end of file");
+  }
+
+  return output.pos - output_begin;
+}
+
+
+/// Decompress a single frame into memory.
+std::string DecompressFrameOrThrow(std::string_view frame,
+                                   const std::string& path)
+{
+  std::string contents;
+  auto content_size = ZSTD_getFrameContentSize(frame.data(), frame.size());
+  if( content_size != ZSTD_CONTENTSIZE_UNKNOWN &&
+      content_size != ZSTD_CONTENTSIZE_ERROR )
+  {
+    contents.resize(static_cast<std::size_t>(content_size));
+    auto result = ZSTD_decompress(
+        &contents[0], contents.size(), frame.data(), frame.size());
+    if( ZSTD_isError(result) )
+      throw bbrd::FileError(
+          "cannot decompress '" + path + "': "
+          + ZSTD_getErrorName(result));
+
+    contents.resize(result);
+    return contents;
+  }
+
+  // The size is not stored in the frame header, e.g. if it was compressed
+  // from a pipe
+  auto stream = CreateDStreamOrThrow();
+  ZSTD_inBuffer input{frame.data(), frame.size(), 0};
+  bool frame_done = true;
+  for(;;)
+  {
+    auto size = contents.size();
+    contents.resize(std::max<std::size_t>(size * 2, ZSTD_DStreamOutSize()));
+    ZSTD_outBuffer output{&contents[size], contents.size() - size, 0};
+    auto written = DecompressStreamOrThrow(
+        stream.get(), input, output, frame_done, path);
+    contents.resize(size + written);
+    if( output.pos < output.size )
+      return contents;
+  }
+}
+
+
+/// Decompresses zstd archives. The compressed input is read completely: It
+/// is a small fraction of the decompressed size. If there are several
+/// frames, up to thread_count frames are decompressed at the same time while
+/// the previous ones are consumed. Otherwise the single frame is streamed.
+class ZstdDecompressor : public bbrd::Decompressor
+{
+public:
+  ZstdDecompressor(const bbrd::RawReader& read_raw,
+                   std::string path,
+                   unsigned thread_count)
+  : path_(std::move(path))
+  , compressed_(ReadAll(read_raw))
+  , frames_()
+  , next_frame_(0)
+  , pending_()
+  , decoded_()
+  , decoded_pos_(0)
+  , thread_count_(thread_count)
+  , stream_(CreateDStreamOrThrow())
+  , input_{this->compressed_.data(), this->compressed_.size(), 0}
+  , frame_done_(true)
+  {
+    if( this->thread_count_ == 0 )
+      this->thread_count_ = std::max(std::thread::hardware_concurrency(), 1u);
+
+    if( this->thread_count_ < 2 )
+      return;
+
+    std::string_view rest(this->compressed_);
+    while( !rest.empty() )
+    {
+      auto frame_size = ZSTD_findFrameCompressedSize(rest.data(), rest.size());
+      if( ZSTD_isError(frame_size) )
+        throw bbrd::FileError(
+            "cannot decompress '" + this->path_ + "': "
+            + ZSTD_getErrorName(frame_size));
+
+      this->frames_.push_back(rest.substr(0, frame_size));
+      rest.remove_prefix(frame_size);
+    }
+
+    // A single frame is streamed instead
+    if( this->frames_.size() < 2 )
+      this->frames_.clear();
+  }
+
+  std::size_t read(char * dest, std::size_t size) override
+  {
+    if( this->frames_.empty() )
+    {
+      ZSTD_outBuffer output{dest, size, 0};
+      return DecompressStreamOrThrow(
+          this->stream_.get(), this->input_, output, this->frame_done_,
+          this->path_);
+    }
+
+    std::size_t written = 0;
+    while( written < size )
+    {
+      if( this->decoded_pos_ == this->decoded_.size() )
+      {
+        this->start_frames();
+        if( this->pending_.empty() )
+          break;
+
+        this->decoded_ = this->pending_.front().get();
+        this->decoded_pos_ = 0;
+        this->pending_.pop_front();
+        this->start_frames();
+        continue;
+      }
+
+      auto count = std::min(size - written,
+                            this->decoded_.size() - this->decoded_pos_);
+      std::memcpy(dest + written, &this->decoded_[this->decoded_pos_], count);
+      this->decoded_pos_ += count;
+      written += count;
+    }
+
+    return written;
+  }
+
+private:
+  static std::string ReadAll(const bbrd::RawReader& read_raw)
+  {
+    std::string compressed;
+    std::size_t size = 0;
+    for(;;)
+    {
+      compressed.resize(size + input_size);
+      auto bytes_read = read_raw(&compressed[size], input_size);
+      if( bytes_read == 0 )
+        break;
+      size += bytes_read;
+    }
+
+    compressed.resize(size);
+    return compressed;
+  }
+
+  /// Keep thread_count frames being decompressed.
+  void start_frames()
+  {
+    while( this->pending_.size() < this->thread_count_ &&
+           this->next_frame_ < this->frames_.size() )
+      this->pending_.push_back(std::async(
+          std::launch::async,
+          DecompressFrameOrThrow,
+          this->frames_[this->next_frame_++],
+          this->path_));
+  }
+
+  std::string path_;
+  std::string compressed_;
+  /// Views into compressed_, empty if the input is streamed
+  std::vector<std::string_view> frames_;
+  std::size_t next_frame_;
+  std::deque<std::future<std::string>> pending_;
+  /// The frame that is being consumed
+  std::string decoded_;
+  std::size_t decoded_pos_;
+  unsigned thread_count_;
+  DStreamPtr stream_;
+  ZSTD_inBuffer input_;
+  bool frame_done_;
+};
+#endif
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+Compression DetectCompression(std::string_view head) noexcept
+{
+  if( head.substr(0, 2) == "\x1f\x8b" )
+    return Compression::gzip;
+
+  if( head.substr(0, 4) == "\x28\xb5\x2f\xfd" )
+    return Compression::zstd;
+
+  return Compression::none;
+}
+
+std::unique_ptr<Decompressor> Decompressor::Create(Compression compression,
+                                                   RawReader read_raw,
+                                                   const std::string& path,
+                                                   unsigned thread_count)
+{
+  (void)read_raw;
+  (void)thread_count;
+  switch( compression )
+  {
+    case Compression::gzip:
+#ifdef BBRD_WITH_ZLIB
+      return std::make_unique<GzipDecompressor>(std::move(read_raw), path);
+#else
+      throw FileError("cannot read '" + path + "': gzip is not supported by"
+                      " this build");
+#endif
+
+    case Compression::zstd:
+#ifdef BBRD_WITH_ZSTD
+      return std::make_unique<ZstdDecompressor>(read_raw, path, thread_count);
+#else
+      throw FileError("cannot read '" + path + "': zstd is not supported by"
+                      " this build");
+#endif
+
+    case Compression::none:
+      break;
+  }
+
+  throw FileError("cannot read '" + path + "': not compressed");
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,66 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+
+
+namespace bbrd {
+
+
+enum class Compression
+{
+  none,
+  gzip,
+  zstd,
+};
+
+
+/// The number of bytes at the beginning of a file that identify its
+/// compression.
+constexpr std::size_t compression_magic_size = 4;
+
+
+/// Identify the compression of a file by its first bytes.
+Compression DetectCompression(std::string_view head) noexcept;
+
+
+/// Reads up to size bytes of the compressed input to dest. Returns 0 at the
+/// end of the input. Throws FileError on failure.
+using RawReader = std::function<std::size_t(char * dest, std::size_t size)>;
+
+
+/// Decompresses input read by a RawReader, piece by piece.
+class Decompressor
+{
+public:
+  /// Throws FileError if this build does not support compression.
+  /// The frames of a zstd archive with several frames (e.g. written by
+  /// `zstd -T0 --rsyncable` or pzstd) are decompressed by thread_count
+  /// threads. If thread_count is 0, the number of cores is used.
+  static std::unique_ptr<Decompressor> Create(Compression compression,
+                                              RawReader read_raw,
+                                              const std::string& path,
+                                              unsigned thread_count = 0);
+
+  Decompressor() = default;
+  virtual ~Decompressor() = default;
+
+  Decompressor(Decompressor&&) = delete;
+  Decompressor(const Decompressor&) = delete;
+  Decompressor& operator=(Decompressor&&) = delete;
+  Decompressor& operator=(const Decompressor&) = delete;
+
+  /// Decompress up to size bytes to dest. Returns 0 at the end of the input.
+  /// Throws FileError if the input is corrupt or truncated.
+  virtual std::size_t read(char * dest, std::size_t size) = 0;
+};
+
+
+} // namespace bbrd
+
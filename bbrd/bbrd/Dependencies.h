@@ -3,10 +3,14 @@
 
 #pragma once
 
+#include "bbrd/DependencySet.h"
+#include "bbrd/File.h"
+#include "bbrd/RecipeInterner.h"
+#include "bbrd/TaskDependencies.h"
+
 #include <optional>
-#include <stdexcept>
+#include <string>
 #include <string_view>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -17,19 +21,52 @@ namespace bbrd {
 class Dependencies
 {
 public:
-  using Id = std::size_t;
-  using DependencyVector = std::vector<std::pair<Id, Id>>;
-  using RecipesByStringView = std::unordered_map<std::string_view, Id>;
-  using RecipesById = std::vector<std::string_view>;
-
-  explicit Dependencies(std::string buffer)
+  using Id = DependencySet::Id;
+  using DependencyVector = DependencySet::DependencyVector;
+  using RecipesById = RecipeInterner::Names;
+
+  /// Extract dependencies from buffer. All recipe names are views into the
+  /// buffer, which is kept alive by Dependencies.
+  /// The buffer is split at line boundaries and parsed by thread_count
+  /// threads. If thread_count is 0, it is chosen depending on the number of
+  /// cores and the size of the buffer.
+  /// If with_tasks is set, the dependencies between tasks are kept as well.
+  explicit Dependencies(FileBuffer buffer,
+                        unsigned thread_count = 0,
+                        bool with_tasks = false)
   : buffer_(std::move(buffer))
-  , next_id_(0)
   , dependencies_()
-  , recipes_by_string_()
-  , recipes_by_id_()
+  , recipes_()
+  , tasks_()
+  , parsed_count_(0)
+  , input_size_(buffer_.size())
   {
-    this->extract_from_dot(this->buffer_);
+    if( with_tasks )
+      this->tasks_.emplace();
+    this->extract_from_dot_parallel(this->buffer_.view(), thread_count);
+  }
+
+  explicit Dependencies(std::string buffer,
+                        unsigned thread_count = 0,
+                        bool with_tasks = false)
+  : Dependencies(FileBuffer(std::move(buffer)), thread_count, with_tasks)
+  {}
+
+  /// Extract dependencies from the chunks of reader while they are being read.
+  /// Recipe names are copied, therefore memory usage depends on the number of
+  /// distinct recipes and dependencies, but not on the size of the input.
+  explicit Dependencies(ChunkedReader& reader, bool with_tasks = false)
+  : buffer_()
+  , dependencies_()
+  // The chunks are reused, therefore names are copied
+  , recipes_(true)
+  , tasks_()
+  , parsed_count_(0)
+  , input_size_(0)
+  {
+    if( with_tasks )
+      this->tasks_.emplace(true);
+    this->extract_from_chunks(reader);
   }
 
   Dependencies(Dependencies&& other) = default;
@@ -37,45 +74,95 @@ public:
   Dependencies& operator=(Dependencies&& other) = default;
   Dependencies& operator=(const Dependencies& other) = delete;
 
+  /// Unique dependencies between recipes, in the order they first appear.
   DependencyVector::const_iterator begin() const noexcept
-  { return this->dependencies_.begin(); }
+  { return this->dependencies_.dependencies().begin(); }
 
   DependencyVector::const_iterator end() const noexcept
-  { return this->dependencies_.end(); }
+  { return this->dependencies_.dependencies().end(); }
+
+  /// The number of task dependencies behind each dependency between recipes,
+  /// in the same order as begin() to end().
+  const DependencySet::MultiplicityVector& multiplicities() const noexcept
+  { return this->dependencies_.multiplicities(); }
+
+  /// The number of task dependencies between different recipes.
+  std::size_t task_dependency_count() const noexcept
+  { return this->dependencies_.total_count(); }
+
+  /// The number of dependencies between tasks that were parsed, including
+  /// those between tasks of the same recipe.
+  std::size_t parsed_dependency_count() const noexcept
+  { return this->parsed_count_; }
+
+  /// The number of bytes that were parsed.
+  std::size_t input_size() const noexcept
+  { return this->input_size_; }
+
+  /// The parsed input, empty if it was read in chunks.
+  std::string_view input() const noexcept
+  { return this->buffer_.view(); }
+
+  /// The ratio of distinct recipes to slots of the hash table of names.
+  double recipe_table_load() const noexcept
+  { return this->recipes_.load_factor(); }
 
   std::string_view get_recipe_name(Id index) const
-  { return this->recipes_by_id_.at(index); }
+  { return this->recipes_.names().at(index); }
 
   std::optional<Id> get_recipe_id(std::string_view recipe) const
-  {
-    auto it = this->recipes_by_string_.find(recipe);
-    if( it == this->recipes_by_string_.end() )
-      return {};
-
-    return it->second;
-  }
+  { return this->recipes_.find(recipe); }
 
   std::size_t distinct_recipe_count() const noexcept
-  { return this->next_id_; }
+  { return this->recipes_.size(); }
+
+  /// Recipe names in the order of their ids.
+  RecipesById::const_iterator names_begin() const noexcept
+  { return this->recipes_.names().begin(); }
 
-  RecipesByStringView::const_iterator names_begin() const noexcept
-  { return this->recipes_by_string_.begin(); }
+  RecipesById::const_iterator names_end() const noexcept
+  { return this->recipes_.names().end(); }
 
-  RecipesByStringView::const_iterator names_end() const noexcept
-  { return this->recipes_by_string_.end(); }
+  /// The dependencies between tasks, if they were kept. Recipes whose tasks
+  /// only depend on each other have an id, but no dependencies between
+  /// recipes.
+  const std::optional<TaskDependencies>& tasks() const noexcept
+  { return this->tasks_; }
 
 private:
-  void extract_from_dot(const std::string& buffer);
-  void add_dependency(std::string_view to, std::string_view from);
-  Id get_or_create_id(std::string_view recipe);
-
-  std::string buffer_;
-  Id next_id_;
-  DependencyVector dependencies_;
-  RecipesByStringView recipes_by_string_;
-  RecipesById recipes_by_id_;
+  void extract_from_dot(std::string_view buffer);
+  void extract_from_dot_parallel(std::string_view buffer,
+                                 unsigned thread_count);
+  void extract_from_chunks(ChunkedReader& reader);
+  void merge(const RecipesById& names,
+             const DependencySet& dependencies,
+             const std::optional<TaskDependencies>& tasks);
+  void add_dependency(std::string_view to,
+                      std::string_view to_task,
+                      std::string_view from,
+                      std::string_view from_task);
+
+  FileBuffer buffer_;
+  DependencySet dependencies_;
+  /// Recipe names are views into buffer_, unless they are read in chunks.
+  RecipeInterner recipes_;
+  std::optional<TaskDependencies> tasks_;
+  std::size_t parsed_count_;
+  std::size_t input_size_;
 };
 
 
+/// The recipes that recipe directly depends on, or that directly depend on
+/// recipe if reverse is set, in the same order as the adjacent recipes of a
+/// DependencyGraph. Only the lines of buffer that mention recipe are parsed:
+/// No ids are assigned and no graph is built. The names are views into
+/// buffer. Returns nothing if recipe is not part of a dependency between
+/// recipes.
+std::optional<std::vector<std::string_view>> ScanAdjacentRecipes(
+    std::string_view buffer,
+    std::string_view recipe,
+    bool reverse);
+
+
 } // namespace bbrd
 
@@ -2,17 +2,29 @@
 // License: MIT
 
 #include "bbrd/DependencyGraph.h"
+#include "bbrd/Condensation.h"
+#include "bbrd/CsrGraph.h"
 #include "bbrd/Dependencies.h"
+#include "bbrd/GraphImage.h"
+#include "bbrd/PathSearch.h"
+#include "bbrd/Schedule.h"
+#include "bbrd/TaskDependencies.h"
+#include "bbrd/TransitiveReduction.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <iomanip>
+#include <ios>
 #include <iterator>
+#include <optional>
 #include <ostream>
 #include <stdexcept>
+#include <string>
 #include <string_view>
+#include <tuple>
 #include <utility>
 #include <vector>
-#include <boost/graph/adjacency_list.hpp>
 #include <boost/graph/breadth_first_search.hpp>
-#include <boost/graph/reverse_graph.hpp>
 #include <boost/range/iterator_range.hpp>
 
 
@@ -28,7 +40,7 @@ public:
   {}
 
   template<class Graph>
-  void discover_vertex(bbrd::Dependencies::Id id, const Graph&)
+  void discover_vertex(bbrd::CsrGraph::Vertex id, const Graph&)
   {
     *(this->out_++) = id;
   }
@@ -42,18 +54,27 @@ template<typename OutputIterator>
 DependencyRecorder(OutputIterator) -> DependencyRecorder<OutputIterator>;
 
 
+/// Tasks are selected with "recipe:task", recipes only contain letters,
+/// digits and dashes.
+bool IsTaskSelector(std::string_view selector) noexcept
+{
+  return selector.find(':') != std::string_view::npos;
+}
+
+
 } // namespace
 
 
 namespace bbrd {
 
 
-DependencyGraph::DependencyGraph(Dependencies dependencies)
-: dependencies_(std::move(dependencies))
-, graph_(
-    this->dependencies_.begin(),
-    this->dependencies_.end(),
-    this->dependencies_.distinct_recipe_count())
+DependencyGraph::DependencyGraph(const Dependencies& dependencies)
+: image_(GraphImage::Build(dependencies))
+{
+}
+
+DependencyGraph::DependencyGraph(GraphImage image)
+: image_(std::move(image))
 {
 }
 
@@ -62,41 +83,358 @@ void DependencyGraph::list_recipe_depends(
     bool reverse,
     std::ostream& out) const
 {
+  if( IsTaskSelector(recipe) )
+  {
+    auto task = this->get_task_id_or_throw(recipe);
+    std::vector<GraphImage::Id> tasks;
+    auto it = std::back_inserter(tasks);
+    DependencyRecorder dependency_recorder(it);
+    boost::breadth_first_search(
+        reverse ? this->image_.task_reverse() : this->image_.task_forward(),
+        task,
+        boost::visitor(dependency_recorder));
+
+    for(auto t = tasks.rbegin(); t != tasks.rend() - 1; ++t)
+      this->print_task(*t, out) << "\n";
+    return;
+  }
+
   auto id = this->get_dependency_id_or_throw(recipe);
-  std::vector<Dependencies::Id> dependencies;
-  auto it = std::back_inserter(dependencies);
+  for(auto recipe_id : this->transitive_recipes(id, reverse))
+    out << this->image_.recipe_name(recipe_id) << "\n";
+}
+
+std::vector<GraphImage::Id> DependencyGraph::transitive_recipes(
+    GraphImage::Id recipe,
+    bool reverse) const
+{
+  std::vector<GraphImage::Id> recipes;
+  if( this->image_.has_closure() )
+  {
+    const auto& closure = reverse ? this->image_.reverse_closure()
+                                  : this->image_.forward_closure();
+    closure.for_each_reachable(recipe, [&recipes](GraphImage::Id recipe_id){
+      recipes.push_back(recipe_id);
+    });
+    return recipes;
+  }
+
+  // Search the graph between strongly connected components, which visits
+  // every cycle once instead of once per member
+  const auto& condensation = this->image_.condensation();
+  std::vector<Condensation::Component> components;
+  auto it = std::back_inserter(components);
   DependencyRecorder dependency_recorder(it);
 
-  if( reverse )
+  boost::breadth_first_search(
+      reverse ? condensation.reverse() : condensation.forward(),
+      condensation.component_of(recipe),
+      boost::visitor(dependency_recorder));
+
+  for(auto c : components)
+    for(auto member = condensation.members_begin(c);
+        member != condensation.members_end(c);
+        ++member)
+      if( *member != recipe )
+        recipes.push_back(*member);
+
+  // The same order as the closure index
+  std::sort(recipes.begin(), recipes.end());
+  return recipes;
+}
+
+void DependencyGraph::list(std::ostream& out) const
+{
+  for(GraphImage::Id id = 0; id < this->image_.recipe_count(); ++id)
+    if( this->image_.in_recipe_graph(id) )
+      out << this->image_.recipe_name(id) << "\n";
+}
+
+bool DependencyGraph::depends_on(
+    std::string_view recipe,
+    std::string_view dependency) const
+{
+  if( IsTaskSelector(recipe) || IsTaskSelector(dependency) )
   {
-    boost::breadth_first_search(
-        boost::make_reverse_graph(this->graph_),
-        id,
-        boost::visitor(dependency_recorder));
+    auto from = this->get_task_id_or_throw(recipe);
+    auto to = this->get_task_id_or_throw(dependency);
+    return !ShortestPath(this->image_.task_forward(),
+                         this->image_.task_reverse(),
+                         from,
+                         to).empty();
+  }
+
+  auto from = this->get_dependency_id_or_throw(recipe);
+  auto to = this->get_dependency_id_or_throw(dependency);
+  if( this->image_.has_closure() )
+    return this->image_.forward_closure().reaches(from, to);
+
+  if( from == to )
+    return false;
+
+  const auto& condensation = this->image_.condensation();
+  auto source = condensation.component_of(from);
+  auto target = condensation.component_of(to);
+  if( source == target )
+    return true;
+
+  // Depth-first search over the components that stops as soon as target is
+  // found. Successors have smaller numbers than their predecessors,
+  // therefore components with a smaller number than target cannot reach it.
+  const auto& graph = condensation.forward();
+  std::vector<bool> seen(condensation.component_count(), false);
+  std::vector<Condensation::Component> stack(1, source);
+  seen[source] = true;
+  while( !stack.empty() )
+  {
+    auto c = stack.back();
+    stack.pop_back();
+    for(auto d : boost::make_iterator_range(adjacent_vertices(c, graph)))
+    {
+      if( d == target )
+        return true;
+      if( d > target && !seen[d] )
+      {
+        seen[d] = true;
+        stack.push_back(d);
+      }
+    }
+  }
+
+  return false;
+}
+
+std::size_t DependencyGraph::list_paths(
+    std::string_view recipe,
+    std::string_view dependency,
+    std::size_t limit,
+    std::ostream& out) const
+{
+  if( IsTaskSelector(recipe) || IsTaskSelector(dependency) )
+  {
+    auto from = this->get_task_id_or_throw(recipe);
+    auto to = this->get_task_id_or_throw(dependency);
+    auto paths = ShortestPaths(this->image_.task_forward(),
+                               this->image_.task_reverse(),
+                               from,
+                               to,
+                               limit);
+    for(const auto& path : paths)
+    {
+      this->print_task(path.front(), out);
+      for(auto t = path.begin() + 1; t != path.end(); ++t)
+        this->print_task(*t, out << " -> ");
+      out << "\n";
+    }
+
+    return paths.size();
+  }
+
+  auto from = this->get_dependency_id_or_throw(recipe);
+  auto to = this->get_dependency_id_or_throw(dependency);
+  auto paths = ShortestPaths(
+      this->image_.forward(), this->image_.reverse(), from, to, limit);
+
+  for(const auto& path : paths)
+  {
+    out << this->image_.recipe_name(path.front());
+    for(auto v = path.begin() + 1; v != path.end(); ++v)
+      out << " -> " << this->image_.recipe_name(*v);
+    out << "\n";
+
+    // The task dependencies behind every step, indented
+    if( this->image_.has_tasks() )
+      for(auto v = path.begin(); v + 1 != path.end(); ++v)
+        this->list_task_dependencies(*v, *(v + 1), out);
+  }
+
+  return paths.size();
+}
+
+void DependencyGraph::export_dot(
+    bool reduce,
+    unsigned thread_count,
+    std::ostream& out) const
+{
+  auto forward = this->image_.forward();
+  std::vector<CsrGraph::Edge> edges;
+  if( reduce )
+  {
+    std::optional<GraphImage> indexed;
+    if( !this->image_.has_closure() )
+      indexed = this->image_.with_closure(thread_count);
+    const auto& image = indexed ? *indexed : this->image_;
+    edges = TransitiveReduction(
+        forward, image.condensation(), image.forward_closure(), thread_count);
   }
   else
   {
-    boost::breadth_first_search(
-        this->graph_,
-        id,
-        boost::visitor(dependency_recorder));
+    edges.reserve(forward.edge_count());
+    for(CsrGraph::Vertex v = 0; v < forward.vertex_count(); ++v)
+      for(auto w : boost::make_iterator_range(adjacent_vertices(v, forward)))
+        edges.push_back(CsrGraph::Edge{v, w});
   }
 
-  if( dependencies.size() )
+  // A single buffer is much faster than many small writes to the stream
+  std::string dot = "digraph depends {\n";
+  auto append_name = [this, &dot](CsrGraph::Vertex v){
+    dot.append("\"").append(this->image_.recipe_name(v)).append("\"");
+  };
+  for(CsrGraph::Vertex v = 0; v < forward.vertex_count(); ++v)
+    if( this->image_.in_recipe_graph(v) )
+    {
+      append_name(v);
+      dot.append("\n");
+    }
+  for(const auto& edge : edges)
   {
-    assert(dependencies.front() == id);
-    for(auto recipe_id = dependencies.rbegin() ;
-        recipe_id != (dependencies.rend() - 1);
-        ++recipe_id)
-      out << this->dependencies_.get_recipe_name(*recipe_id) << "\n";
+    append_name(edge.source);
+    dot.append(" -> ");
+    append_name(edge.target);
+    dot.append("\n");
   }
+  dot.append("}\n");
+
+  out.write(dot.data(), static_cast<std::streamsize>(dot.size()));
 }
 
-void DependencyGraph::list(std::ostream& out) const
+void DependencyGraph::list_cycles(std::ostream& out) const
 {
-  auto it = this->dependencies_.names_begin();
-  for(; it != this->dependencies_.names_end(); ++it)
-    out << it->first << "\n";
+  const auto& condensation = this->image_.condensation();
+  for(Condensation::Component c = 0; c < condensation.component_count(); ++c)
+  {
+    if( condensation.member_count(c) < 2 )
+      continue;
+
+    auto member = condensation.members_begin(c);
+    out << this->image_.recipe_name(*member);
+    while( ++member != condensation.members_end(c) )
+      out << " " << this->image_.recipe_name(*member);
+    out << "\n";
+  }
+}
+
+void DependencyGraph::print_schedule_profile(
+    bool build_order,
+    unsigned thread_count,
+    std::ostream& out) const
+{
+  this->require_tasks_or_throw();
+
+  auto forward = this->image_.task_forward();
+  auto schedule = Schedule::Compute(
+      forward, this->image_.task_reverse(), thread_count);
+
+  std::size_t widest = 0;
+  for(std::size_t l = 1; l < schedule.level_count(); ++l)
+    if( schedule.level_width(l) > schedule.level_width(widest) )
+      widest = l;
+
+  out << "tasks: " << forward.vertex_count() << "\n"
+      << "dependencies: " << forward.edge_count() << "\n"
+      << "levels: " << schedule.level_count() << "\n";
+  if( schedule.level_count() )
+    out << "max parallelism: " << schedule.level_width(widest)
+        << " (level " << widest << ")\n"
+        << "average parallelism: "
+        << double(forward.vertex_count()) / double(schedule.level_count())
+        << "\n";
+
+  out << "level widths:\n";
+  for(std::size_t l = 0; l < schedule.level_count(); ++l)
+    out << "  " << l << " " << schedule.level_width(l) << "\n";
+
+  out << "critical path: " << schedule.critical_path.size() << " tasks\n";
+  for(auto task : schedule.critical_path)
+    this->print_task(task, out << "  ") << "\n";
+
+  // A recipe appears once, at its first task on the critical path
+  out << "critical path recipes:";
+  std::vector<bool> seen(this->image_.recipe_count(), false);
+  for(auto task : schedule.critical_path)
+  {
+    auto recipe = this->image_.task_recipe(task);
+    if( !seen[recipe] )
+      out << " " << this->image_.recipe_name(recipe);
+    seen[recipe] = true;
+  }
+  out << "\n";
+
+  if( !build_order )
+    return;
+
+  out << "build order:\n";
+  for(std::size_t l = 0; l < schedule.level_count(); ++l)
+    for(auto i = schedule.level_offsets[l];
+        i < schedule.level_offsets[l + 1];
+        ++i)
+      this->print_task(schedule.order[i], out << "  " << l << " ") << "\n";
+}
+
+void DependencyGraph::print_critical_path(
+    const std::vector<double>& seconds,
+    unsigned thread_count,
+    std::ostream& out) const
+{
+  this->require_tasks_or_throw();
+  if( seconds.size() != this->image_.task_count() )
+    throw std::invalid_argument("expected the duration of every task");
+
+  auto forward = this->image_.task_forward();
+  auto reverse = this->image_.task_reverse();
+  auto schedule = Schedule::Compute(forward, reverse, thread_count);
+  auto critical = CriticalPath::Compute(schedule, forward, reverse, seconds);
+
+  auto flags = out.flags();
+  auto precision = out.precision();
+  out << std::fixed << std::setprecision(2);
+
+  out << "critical path: " << critical.length << " seconds, "
+      << critical.path.size() << " tasks\n"
+      << "  start duration task\n";
+  for(auto task : critical.path)
+  {
+    out << "  " << critical.finish[task] - seconds[task]
+        << " " << seconds[task] << " ";
+    this->print_task(task, out) << "\n";
+  }
+
+  struct RecipeTime
+  {
+    GraphImage::Id recipe;
+    double slack;
+    double total;
+  };
+  std::vector<RecipeTime> recipes;
+  for(GraphImage::Id r = 0; r < this->image_.recipe_count(); ++r)
+  {
+    auto begin = this->image_.recipe_tasks_begin(r);
+    auto end = this->image_.recipe_tasks_end(r);
+    if( begin == end )
+      continue;
+
+    RecipeTime time{r, critical.slack[begin], 0};
+    for(auto task = begin; task != end; ++task)
+    {
+      time.slack = std::min(time.slack, critical.slack[task]);
+      time.total += seconds[task];
+    }
+    recipes.push_back(time);
+  }
+  std::sort(recipes.begin(), recipes.end(),
+            [](const RecipeTime& a, const RecipeTime& b){
+              return std::make_tuple(a.slack, -a.total, a.recipe)
+                   < std::make_tuple(b.slack, -b.total, b.recipe);
+            });
+
+  out << "recipes:\n"
+      << "  slack total recipe\n";
+  for(const auto& time : recipes)
+    out << "  " << time.slack << " " << time.total << " "
+        << this->image_.recipe_name(time.recipe) << "\n";
+
+  out.flags(flags);
+  out.precision(precision);
 }
 
 void DependencyGraph::list_adjacent_recipes(
@@ -104,40 +442,82 @@ void DependencyGraph::list_adjacent_recipes(
     bool reverse,
     std::ostream& out) const
 {
-  if( reverse )
-    this->list_adjacent_recipes_of_graph(
-        boost::make_reverse_graph(this->graph_),
-        recipe,
-        out);
-  else
-    this->list_adjacent_recipes_of_graph(
-        this->graph_,
-        recipe,
-        out);
+  if( IsTaskSelector(recipe) )
+  {
+    auto task = this->get_task_id_or_throw(recipe);
+    auto graph = reverse ? this->image_.task_reverse()
+                         : this->image_.task_forward();
+    for(auto t : boost::make_iterator_range(adjacent_vertices(task, graph)))
+      this->print_task(t, out) << "\n";
+    return;
+  }
+
+  auto id = this->get_dependency_id_or_throw(recipe);
+  auto it_pair = this->adjacent_recipes(id, reverse);
+  for(auto recipe_id : boost::make_iterator_range(it_pair))
+    out << this->image_.recipe_name(recipe_id) << "\n";
 }
 
-Dependencies::Id DependencyGraph::get_dependency_id_or_throw(
+GraphImage::Id DependencyGraph::get_dependency_id_or_throw(
     std::string_view recipe) const
 {
-  auto id = this->dependencies_.get_recipe_id(recipe);
+  auto id = this->find(recipe);
   if( !id )
     throw std::runtime_error(std::string("recipe not found: ").append(recipe));
 
   return *id;
 }
 
-template<typename GraphType>
-void DependencyGraph::list_adjacent_recipes_of_graph(
-    const GraphType& graph,
-    std::string_view recipe,
+
+void DependencyGraph::require_tasks_or_throw() const
+{
+  if( !this->image_.has_tasks() )
+    throw std::runtime_error("the graph does not contain tasks (use --tasks)");
+}
+
+GraphImage::Id DependencyGraph::get_task_id_or_throw(
+    std::string_view selector) const
+{
+  this->require_tasks_or_throw();
+
+  // The tasks of a recipe may only depend on each other
+  auto colon = selector.find(':');
+  auto recipe = this->image_.find(selector.substr(0, colon));
+  if( !recipe )
+    throw std::runtime_error(
+        std::string("recipe not found: ").append(selector.substr(0, colon)));
+  auto task = this->image_.find_task(*recipe, selector.substr(colon + 1));
+  if( !task )
+    throw std::runtime_error(std::string("task not found: ").append(selector));
+
+  return *task;
+}
+
+std::ostream& DependencyGraph::print_task(
+    GraphImage::Id task,
     std::ostream& out) const
 {
-  auto id = this->get_dependency_id_or_throw(recipe);
-  auto it_pair = boost::adjacent_vertices(id, graph);
-  for(auto recipe_id : boost::make_iterator_range(it_pair))
-    out << this->dependencies_.get_recipe_name(recipe_id) << "\n";
+  return out << this->image_.recipe_name(this->image_.task_recipe(task))
+             << ":" << this->image_.task_name(task);
 }
 
+void DependencyGraph::list_task_dependencies(
+    GraphImage::Id recipe,
+    GraphImage::Id dependency,
+    std::ostream& out) const
+{
+  auto graph = this->image_.task_forward();
+  for(auto task = this->image_.recipe_tasks_begin(recipe);
+      task != this->image_.recipe_tasks_end(recipe);
+      ++task)
+    for(auto t : boost::make_iterator_range(adjacent_vertices(task, graph)))
+      if( this->image_.task_recipe(t) == dependency )
+      {
+        out << "  ";
+        this->print_task(task, out) << " -> ";
+        this->print_task(t, out) << "\n";
+      }
+}
 
-} // namespace bbrd
 
+} // namespace bbrd
@@ -3,32 +3,42 @@
 
 #pragma once
 
+#include "bbrd/CsrGraph.h"
 #include "bbrd/Dependencies.h"
+#include "bbrd/GraphImage.h"
 
+#include <cstddef>
+#include <optional>
 #include <ostream>
 #include <string_view>
-#include <boost/graph/adjacency_list.hpp>
+#include <utility>
+#include <vector>
 
 
 namespace bbrd {
 
 
+/// Answers queries about the dependencies between recipes. If the image
+/// contains tasks, every query also accepts tasks as "recipe:task", e.g.
+/// "curl:do_compile", and answers with tasks.
 class DependencyGraph
 {
 public:
-  using OutEdgeList = boost::hash_setS;
-  using VertexList = boost::vecS;
-  using Directed = boost::bidirectionalS;
-  using Graph = boost::adjacency_list<OutEdgeList,
-                                      VertexList,
-                                      Directed>;
-
-  explicit DependencyGraph(Dependencies dependencies);
+  // The graph never changes after construction. Both directions are stored
+  // in compressed sparse row format, i.e. the out edges of all vertices are
+  // kept in contiguous arrays, sorted by vertex.
+  using Graph = CsrGraph;
+
+  explicit DependencyGraph(const Dependencies& dependencies);
+  explicit DependencyGraph(GraphImage image);
   DependencyGraph(DependencyGraph&&) = default;
   DependencyGraph(const DependencyGraph&) = delete;
   DependencyGraph& operator=(DependencyGraph&& other) = default;
   DependencyGraph& operator=(const DependencyGraph& other) = delete;
 
+  /// List the transitive dependencies of recipe, or its transitive reverse
+  /// dependencies if reverse is set, in id order. The order does not depend
+  /// on whether the image has a closure index.
   void list_recipe_depends(
       std::string_view recipe,
       bool reverse,
@@ -39,16 +49,96 @@ public:
       std::ostream& out) const;
   void list(std::ostream& out) const;
 
-private:
-  Dependencies::Id get_dependency_id_or_throw(std::string_view recipe) const;
-  template<typename GraphType>
-  void list_adjacent_recipes_of_graph(
-      const GraphType& graph,
+  /// List up to limit shortest chains of dependencies from recipe to
+  /// dependency, one per line, e.g. "image -> curl -> openssl". Returns the
+  /// number of chains, which is 0 if recipe does not depend on dependency.
+  /// If the image contains tasks, every step of a chain between recipes is
+  /// followed by the task dependencies behind it.
+  std::size_t list_paths(
       std::string_view recipe,
+      std::string_view dependency,
+      std::size_t limit,
+      std::ostream& out) const;
+
+  /// Write the recipes and the dependencies between them as DOT. If reduce
+  /// is set, dependencies that are implied by other dependencies are left
+  /// out (see TransitiveReduction), using the closure index of the image,
+  /// which is computed if missing. The graph is written all at once.
+  void export_dot(bool reduce, unsigned thread_count, std::ostream& out) const;
+
+  /// List the members of every strongly connected component with more than
+  /// one recipe, i.e. of every dependency cycle. One line per component.
+  void list_cycles(std::ostream& out) const;
+
+  /// Print how well the tasks of the graph can be built in parallel: The
+  /// width of every level (see Schedule), the tasks of a critical path and
+  /// their recipes. If build_order is set, all tasks are listed level by
+  /// level. Requires tasks.
+  void print_schedule_profile(
+      bool build_order,
+      unsigned thread_count,
+      std::ostream& out) const;
+
+  /// Print the critical path of the task graph, weighted by the duration of
+  /// every task in seconds (see Buildstats), followed by every recipe with
+  /// the smallest slack of its tasks and their total duration. Recipes with
+  /// the least slack and the most time are listed first: Speeding them up
+  /// shortens the build the most. Requires tasks.
+  void print_critical_path(
+      const std::vector<double>& seconds,
+      unsigned thread_count,
+      std::ostream& out) const;
+
+  /// Returns true if recipe transitively depends on dependency. Constant time
+  /// if the image has a closure index.
+  bool depends_on(std::string_view recipe, std::string_view dependency) const;
+
+  /// The id of recipe, which is also the id of the image. Recipes that are
+  /// not part of the graph between recipes are not found, whether or not the
+  /// image contains tasks.
+  std::optional<GraphImage::Id> find(std::string_view recipe) const noexcept
+  {
+    auto id = this->image_.find(recipe);
+    if( id && !this->image_.in_recipe_graph(*id) )
+      return {};
+    return id;
+  }
+
+  /// The ids of the recipes that recipe directly depends on (or that
+  /// directly depend on recipe, if reverse is set) in the order of
+  /// list_adjacent_recipes. The range points into the graph. recipe must
+  /// exist.
+  std::pair<const GraphImage::Id *, const GraphImage::Id *> adjacent_recipes(
+      GraphImage::Id recipe,
+      bool reverse) const noexcept
+  {
+    return adjacent_vertices(
+        recipe, reverse ? this->image_.reverse() : this->image_.forward());
+  }
+
+  /// The ids of the transitive dependencies of recipe (or of its transitive
+  /// reverse dependencies) in the order of list_recipe_depends. recipe must
+  /// exist.
+  std::vector<GraphImage::Id> transitive_recipes(GraphImage::Id recipe,
+                                                 bool reverse) const;
+
+  const GraphImage& image() const noexcept
+  { return this->image_; }
+
+private:
+  GraphImage::Id get_dependency_id_or_throw(std::string_view recipe) const;
+  void require_tasks_or_throw() const;
+  GraphImage::Id get_task_id_or_throw(std::string_view selector) const;
+  std::ostream& print_task(GraphImage::Id task, std::ostream& out) const;
+
+  /// List the dependencies between the tasks of recipe and the tasks of
+  /// dependency, one per line, indented.
+  void list_task_dependencies(
+      GraphImage::Id recipe,
+      GraphImage::Id dependency,
       std::ostream& out) const;
 
-  Dependencies dependencies_;
-  Graph graph_;
+  GraphImage image_;
 };
 
 
@@ -0,0 +1,122 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/DependencySet.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <vector>
+
+
+namespace {
+
+
+/// Initial number of slots, must be a power of two.
+constexpr std::size_t initial_slot_count = 1 << 10;
+
+/// log2(initial_slot_count)
+constexpr unsigned initial_slot_bits = 10;
+
+
+std::uint64_t PackKey(bbrd::DependencySet::Id to,
+                      bbrd::DependencySet::Id from) noexcept
+{
+  return (static_cast<std::uint64_t>(to) << 32)
+       | static_cast<std::uint64_t>(from);
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+DependencySet::DependencySet()
+: dependencies_()
+, multiplicities_()
+, total_count_(0)
+, keys_(initial_slot_count, empty_key)
+, indexes_(initial_slot_count, 0)
+, shift_(64 - initial_slot_bits)
+{
+}
+
+bool DependencySet::add(Id to, Id from, std::uint32_t multiplicity)
+{
+  // The empty key is reserved, therefore the largest 32 bit id is excluded
+  constexpr Id max_id = std::numeric_limits<std::uint32_t>::max() - 1;
+  if( to > max_id || from > max_id )
+    throw std::out_of_range("recipe id does not fit in 32 bits");
+
+  this->total_count_ += multiplicity;
+
+  auto key = PackKey(to, from);
+  auto slot = this->slot_of(key);
+  if( this->keys_[slot] == key )
+  {
+    this->multiplicities_[this->indexes_[slot]] += multiplicity;
+    return false;
+  }
+
+  this->keys_[slot] = key;
+  this->indexes_[slot] = static_cast<std::uint32_t>(
+      this->dependencies_.size());
+  this->dependencies_.push_back({to, from});
+  this->multiplicities_.push_back(multiplicity);
+
+  // Keep the load factor at or below 1/2
+  if( this->dependencies_.size() * 2 > this->keys_.size() )
+    this->grow();
+
+  return true;
+}
+
+std::optional<std::size_t> DependencySet::find(Id to, Id from) const noexcept
+{
+  constexpr Id max_id = std::numeric_limits<std::uint32_t>::max() - 1;
+  if( to > max_id || from > max_id )
+    return std::nullopt;
+
+  auto key = PackKey(to, from);
+  auto slot = this->slot_of(key);
+  if( this->keys_[slot] != key )
+    return std::nullopt;
+
+  return this->indexes_[slot];
+}
+
+std::size_t DependencySet::slot_of(std::uint64_t key) const noexcept
+{
+  // Fibonacci hashing, followed by linear probing
+  auto mask = this->keys_.size() - 1;
+  auto slot = static_cast<std::size_t>(
+      (key * UINT64_C(0x9E3779B97F4A7C15)) >> this->shift_);
+  while( this->keys_[slot] != key && this->keys_[slot] != empty_key )
+    slot = (slot + 1) & mask;
+
+  return slot;
+}
+
+void DependencySet::grow()
+{
+  this->keys_.assign(this->keys_.size() * 2, empty_key);
+  this->indexes_.assign(this->keys_.size(), 0);
+  this->shift_--;
+
+  for(std::size_t i = 0; i < this->dependencies_.size(); ++i)
+  {
+    const auto& [to, from] = this->dependencies_[i];
+    auto key = PackKey(to, from);
+    auto slot = this->slot_of(key);
+    this->keys_[slot] = key;
+    this->indexes_[slot] = static_cast<std::uint32_t>(i);
+  }
+}
+
+
+} // namespace bbrd
+
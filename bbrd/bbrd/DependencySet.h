@@ -0,0 +1,72 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// A set of dependencies between recipes, in the order they were first added.
+/// Bitbake's task-depends.dot contains many task dependencies between the
+/// same two recipes. These are collapsed into a single dependency while
+/// counting how many task dependencies are behind it (its multiplicity).
+///
+/// Lookup is done with an open addressing hash table of both ids packed into
+/// a single 64 bit key.
+class DependencySet
+{
+public:
+  /// The same as RecipeInterner::Id: A dependency takes 8 bytes.
+  using Id = std::uint32_t;
+  using DependencyVector = std::vector<std::pair<Id, Id>>;
+  using MultiplicityVector = std::vector<std::uint32_t>;
+
+  DependencySet();
+
+  /// Add a dependency multiplicity times. Returns true if it was not yet
+  /// contained. Throws std::out_of_range if an id is the largest 32 bit
+  /// value, which is reserved.
+  bool add(Id to, Id from, std::uint32_t multiplicity = 1);
+
+  /// The index of a dependency in dependencies(), if it was added.
+  std::optional<std::size_t> find(Id to, Id from) const noexcept;
+
+  /// Unique dependencies, in the order they were first added.
+  const DependencyVector& dependencies() const noexcept
+  { return this->dependencies_; }
+
+  /// The number of times each dependency was added, in the same order as
+  /// dependencies().
+  const MultiplicityVector& multiplicities() const noexcept
+  { return this->multiplicities_; }
+
+  /// The number of dependencies including duplicates.
+  std::size_t total_count() const noexcept
+  { return this->total_count_; }
+
+private:
+  static constexpr std::uint64_t empty_key = ~std::uint64_t(0);
+
+  std::size_t slot_of(std::uint64_t key) const noexcept;
+  void grow();
+
+  DependencyVector dependencies_;
+  MultiplicityVector multiplicities_;
+  std::size_t total_count_;
+  /// Hash table of packed keys. The index of the dependency in dependencies_
+  /// is stored in the same slot of indexes_.
+  std::vector<std::uint64_t> keys_;
+  std::vector<std::uint32_t> indexes_;
+  unsigned shift_;
+};
+
+
+} // namespace bbrd
+
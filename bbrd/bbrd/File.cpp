@@ -2,11 +2,26 @@
 // License: MIT
 
 #include "bbrd/File.h"
+#include "bbrd/Decompression.h"
+#include "bbrd/Hash.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
 #include <fstream>
-#include <sstream>
+#include <memory>
+#include <string>
+#include <utility>
 // strerror_r, strerror_s are not part of the C++ stdlib
 #include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 
 namespace {
@@ -40,6 +55,78 @@ std::string StrError(int errnum)
 }
 
 
+#ifndef _WIN32
+/// Closes the file descriptor on destruction.
+class FileDescriptor
+{
+public:
+  explicit FileDescriptor(int fd) noexcept
+  : fd_(fd)
+  {}
+
+  ~FileDescriptor()
+  {
+    if( this->fd_ >= 0 )
+      close(this->fd_);
+  }
+
+  FileDescriptor(const FileDescriptor&) = delete;
+  FileDescriptor& operator=(const FileDescriptor&) = delete;
+
+  int get() const noexcept
+  { return this->fd_; }
+
+private:
+  int fd_;
+};
+
+
+/// Read up to size bytes from fd into dest. Returns the number of bytes read,
+/// which is 0 at the end of the file.
+std::size_t ReadSomeOrThrow(
+    int fd, char * dest, std::size_t size, const std::string& path)
+{
+  for(;;)
+  {
+    auto bytes_read = read(fd, dest, size);
+    if( bytes_read >= 0 )
+      return static_cast<std::size_t>(bytes_read);
+
+    if( errno != EINTR )
+      throw bbrd::FileError(
+        "cannot read '" + path + "': " + StrError(errno)
+      );
+  }
+}
+
+
+/// Read everything from fd into a string. The contents are copied exactly
+/// once, from the kernel into the string.
+std::string ReadDescriptorOrThrow(int fd, const std::string& path)
+{
+  constexpr std::size_t min_read_size = 1 << 16;
+
+  std::string buffer;
+  std::size_t size = 0;
+  for(;;)
+  {
+    if( buffer.size() - size < min_read_size )
+      buffer.resize(std::max(buffer.size() * 2, size + min_read_size));
+
+    auto bytes_read = ReadSomeOrThrow(
+        fd, &buffer[size], buffer.size() - size, path);
+    if( bytes_read == 0 )
+      break;
+
+    size += bytes_read;
+  }
+
+  buffer.resize(size);
+  return buffer;
+}
+#endif
+
+
 } // namespace
 
 
@@ -52,31 +139,506 @@ FileError::FileError(const std::string& msg) noexcept
 }
 
 
-std::string ReadFileOrThrow(const std::string& path)
+FileBuffer::FileBuffer() noexcept
+: mapping_(nullptr)
+, owned_()
+, data_("")
+, size_(0)
 {
-  std::ifstream file(path, std::ios::in | std::ios::binary);
+}
 
-  if( file.fail() )
+FileBuffer::FileBuffer(std::string contents)
+: mapping_(nullptr)
+  // Own the string through a pointer: Moving a std::string may move its
+  // contents (small string optimization), which would invalidate views into
+  // the buffer.
+, owned_(std::make_unique<std::string>(std::move(contents)))
+, data_(this->owned_->data())
+, size_(this->owned_->size())
+{
+}
+
+FileBuffer::~FileBuffer()
+{
+  this->release();
+}
+
+FileBuffer::FileBuffer(FileBuffer&& other) noexcept
+: mapping_(std::exchange(other.mapping_, nullptr))
+, owned_(std::move(other.owned_))
+, data_(std::exchange(other.data_, ""))
+, size_(std::exchange(other.size_, 0))
+{
+}
+
+FileBuffer& FileBuffer::operator=(FileBuffer&& other) noexcept
+{
+  if( this != &other )
+  {
+    this->release();
+    this->mapping_ = std::exchange(other.mapping_, nullptr);
+    this->owned_ = std::move(other.owned_);
+    this->data_ = std::exchange(other.data_, "");
+    this->size_ = std::exchange(other.size_, 0);
+  }
+
+  return *this;
+}
+
+FileBuffer FileBuffer::Map(int fd,
+                           std::size_t size,
+                           const std::string& path,
+                           FileAccess access)
+{
+#ifndef _WIN32
+  void * mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if( mapping == MAP_FAILED )
+    throw FileError(
+      "cannot map '" + path + "': " + StrError(errno)
+    );
+
+  // The hints are not essential, therefore errors are ignored.
+  if( access == FileAccess::sequential )
+  {
+    madvise(mapping, size, MADV_SEQUENTIAL);
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  }
+  else
+  {
+    madvise(mapping, size, MADV_RANDOM);
+  }
+
+  FileBuffer buffer;
+  buffer.mapping_ = mapping;
+  buffer.data_ = static_cast<const char *>(mapping);
+  buffer.size_ = size;
+  return buffer;
+#else
+  (void)fd;
+  (void)size;
+  (void)access;
+  throw FileError("cannot map '" + path + "': not supported");
+#endif
+}
+
+void FileBuffer::release() noexcept
+{
+#ifndef _WIN32
+  if( this->mapping_ )
+    munmap(this->mapping_, this->size_);
+#endif
+  this->mapping_ = nullptr;
+  this->owned_.reset();
+  this->data_ = "";
+  this->size_ = 0;
+}
+
+
+ChunkedReader::ChunkedReader(const std::string& path,
+                             std::size_t chunk_size,
+                             unsigned thread_count)
+: path_(path)
+, fd_(-1)
+, close_fd_(true)
+, thread_count_(thread_count)
+, head_()
+, detected_(false)
+, decompressor_()
+, buffers_()
+, sizes_()
+, filled_(0)
+, read_index_(0)
+, holds_chunk_(false)
+, eof_(false)
+, stop_(false)
+, error_()
+, mutex_()
+, cond_()
+, thread_()
+{
+#ifndef _WIN32
+  this->fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if( this->fd_ == -1 )
+  {
+    if( path != "-" )
+      throw FileError(
+        "cannot access '" + path + "': " + StrError(errno)
+      );
+
+    this->fd_ = STDIN_FILENO;
+    this->close_fd_ = false;
+  }
+#ifdef POSIX_FADV_SEQUENTIAL
+  posix_fadvise(this->fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  for(auto& buffer : this->buffers_)
+    buffer.resize(std::max<std::size_t>(chunk_size, 1));
+
+  this->thread_ = std::thread(&ChunkedReader::read_loop, this);
+#else
+  (void)chunk_size;
+  (void)thread_count;
+  throw FileError("cannot read '" + path + "' in chunks: not supported");
+#endif
+}
+
+ChunkedReader::~ChunkedReader()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->stop_ = true;
+  }
+  this->cond_.notify_all();
+
+  if( this->thread_.joinable() )
+    this->thread_.join();
+
+#ifndef _WIN32
+  if( this->close_fd_ && this->fd_ >= 0 )
+    close(this->fd_);
+#endif
+}
+
+bool ChunkedReader::next(std::string_view& chunk)
+{
+  std::unique_lock<std::mutex> lock(this->mutex_);
+
+  // Hand the previous chunk back to the reader
+  if( this->holds_chunk_ )
+  {
+    this->holds_chunk_ = false;
+    this->filled_--;
+    this->read_index_ = (this->read_index_ + 1) % buffer_count;
+    this->cond_.notify_all();
+  }
+
+  this->cond_.wait(lock, [this]{ return this->filled_ || this->eof_; });
+
+  if( !this->filled_ )
+  {
+    if( this->error_ )
+      std::rethrow_exception(this->error_);
+
+    return false;
+  }
+
+  this->holds_chunk_ = true;
+  chunk = std::string_view(
+      this->buffers_[this->read_index_].data(),
+      this->sizes_[this->read_index_]);
+  return true;
+}
+
+void ChunkedReader::read_loop() noexcept
+{
+#ifndef _WIN32
+  std::size_t write_index = 0;
+  for(;;)
+  {
+    {
+      std::unique_lock<std::mutex> lock(this->mutex_);
+      this->cond_.wait(lock, [this]{
+        return this->stop_ || this->filled_ < buffer_count;
+      });
+      if( this->stop_ )
+        return;
+    }
+
+    // The buffer at write_index is not visible to the consumer until filled_
+    // is incremented, therefore it can be written to without holding the lock.
+    auto& buffer = this->buffers_[write_index];
+    std::size_t size = 0;
+    std::exception_ptr error;
+    try
+    {
+      size = this->fill(buffer);
+    }
+    catch( ... )
+    {
+      error = std::current_exception();
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      if( size )
+      {
+        this->sizes_[write_index] = size;
+        this->filled_++;
+      }
+      if( size < buffer.size() )
+      {
+        this->eof_ = true;
+        this->error_ = error;
+      }
+    }
+    this->cond_.notify_all();
+
+    if( size < buffer.size() )
+      return;
+
+    write_index = (write_index + 1) % buffer_count;
+  }
+#endif
+}
+
+#ifndef _WIN32
+std::size_t ChunkedReader::fill(std::string& buffer)
+{
+  if( !this->detected_ )
+  {
+    this->detected_ = true;
+    this->head_.resize(compression_magic_size);
+    std::size_t size = 0;
+    while( size < this->head_.size() )
+    {
+      auto bytes_read = ReadSomeOrThrow(
+          this->fd_, &this->head_[size], this->head_.size() - size,
+          this->path_);
+      if( bytes_read == 0 )
+        break;
+      size += bytes_read;
+    }
+    this->head_.resize(size);
+
+    auto compression = DetectCompression(this->head_);
+    if( compression != Compression::none )
+      this->decompressor_ = Decompressor::Create(
+          compression,
+          [this](char * dest, std::size_t count){
+            return this->read_raw(dest, count);
+          },
+          this->path_,
+          this->thread_count_);
+  }
+
+  std::size_t size = 0;
+  while( size < buffer.size() )
+  {
+    auto bytes_read = this->decompressor_
+      ? this->decompressor_->read(&buffer[size], buffer.size() - size)
+      : this->read_raw(&buffer[size], buffer.size() - size);
+    if( bytes_read == 0 )
+      break;
+    size += bytes_read;
+  }
+
+  return size;
+}
+
+std::size_t ChunkedReader::read_raw(char * dest, std::size_t size)
+{
+  if( this->head_.empty() )
+    return ReadSomeOrThrow(this->fd_, dest, size, this->path_);
+
+  auto count = std::min(size, this->head_.size());
+  std::copy(this->head_.begin(),
+            this->head_.begin() + static_cast<std::ptrdiff_t>(count),
+            dest);
+  this->head_.erase(0, count);
+  return count;
+}
+#endif
+
+
+bool IsRegularFile(const std::string& path)
+{
+#ifndef _WIN32
+  struct stat file_stat;
+  if( stat(path.c_str(), &file_stat) == -1 )
+    return path != "-";
+
+  return S_ISREG(file_stat.st_mode);
+#else
+  (void)path;
+  return true;
+#endif
+}
+
+
+FileBuffer ReadFileOrThrow(const std::string& path, FileAccess access)
+{
+#ifndef _WIN32
+  FileDescriptor file(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+
+  if( file.get() == -1 )
   {
     if( path == "-" )
-      return ReadFileOrThrow("/dev/stdin");
+      return FileBuffer(ReadDescriptorOrThrow(STDIN_FILENO, path));
     else
       throw FileError(
         "cannot access '" + path + "': " + StrError(errno)
       );
   }
 
-  std::stringstream buffer;
-  buffer << file.rdbuf();
+  struct stat file_stat;
+  if( fstat(file.get(), &file_stat) == -1 )
+    throw FileError(
+      "cannot access '" + path + "': " + StrError(errno)
+    );
+
+  // Regular files are mapped, everything else (e.g. named pipes) is read.
+  if( S_ISREG(file_stat.st_mode) && file_stat.st_size > 0 )
+    return FileBuffer::Map(
+        file.get(),
+        static_cast<std::size_t>(file_stat.st_size),
+        path,
+        access);
+
+  return FileBuffer(ReadDescriptorOrThrow(file.get(), path));
+#else
+  (void)access;
+  std::ifstream file(path, std::ios::in | std::ios::binary);
 
   if( file.fail() )
+    throw FileError(
+      "cannot access '" + path + "': " + StrError(errno)
+    );
+
+  std::string buffer;
+  char chunk[1 << 16];
+  while( file.read(chunk, sizeof(chunk)) || file.gcount() )
+    buffer.append(chunk, static_cast<std::size_t>(file.gcount()));
+
+  if( file.bad() )
     throw FileError(
       "cannot read '" + path + "': " + StrError(errno)
     );
 
-  return buffer.str();
+  return FileBuffer(std::move(buffer));
+#endif
 }
 
 
-} // namespace bbrd
+FileStamp ReadFileStampOrThrow(const std::string& path)
+{
+#ifndef _WIN32
+  FileDescriptor file(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+  if( file.get() == -1 )
+    throw FileError(
+      "cannot access '" + path + "': " + StrError(errno)
+    );
+
+  struct stat file_stat;
+  if( fstat(file.get(), &file_stat) == -1 )
+    throw FileError(
+      "cannot access '" + path + "': " + StrError(errno)
+    );
+
+  if( !S_ISREG(file_stat.st_mode) )
+    throw FileError("cannot stamp '" + path + "': not a regular file");
+
+  FileStamp stamp;
+  stamp.device = static_cast<std::uint64_t>(file_stat.st_dev);
+  stamp.inode = static_cast<std::uint64_t>(file_stat.st_ino);
+  stamp.size = static_cast<std::uint64_t>(file_stat.st_size);
+  stamp.mtime_ns = static_cast<std::int64_t>(file_stat.st_mtim.tv_sec)
+                     * 1000000000
+                 + static_cast<std::int64_t>(file_stat.st_mtim.tv_nsec);
+
+  constexpr std::size_t edge_size = 256 << 10;
+  constexpr std::size_t block_size = 16 << 10;
+  constexpr std::size_t block_count = 32;
+
+  auto size = static_cast<std::size_t>(stamp.size);
+  auto hash = HashBytes(std::string_view(
+      reinterpret_cast<const char *>(&stamp.size), sizeof(stamp.size)));
+  std::string buffer;
+  auto hash_range = [&](std::size_t offset, std::size_t length){
+    buffer.resize(length);
+    std::size_t done = 0;
+    while( done < length )
+    {
+      auto bytes_read = pread(file.get(),
+                              &buffer[done],
+                              length - done,
+                              static_cast<off_t>(offset + done));
+      if( bytes_read == -1 && errno == EINTR )
+        continue;
+      if( bytes_read == -1 )
+        throw FileError(
+          "cannot read '" + path + "': " + StrError(errno)
+        );
+      if( bytes_read == 0 )
+        throw FileError("cannot read '" + path + "': file was truncated");
+      done += static_cast<std::size_t>(bytes_read);
+    }
+    hash = HashBytes(buffer, hash);
+  };
+
+  if( size <= 2 * edge_size + block_count * block_size )
+  {
+    hash_range(0, size);
+  }
+  else
+  {
+    hash_range(0, edge_size);
+    auto stride = (size - 2 * edge_size) / block_count;
+    for(std::size_t i = 0; i < block_count; ++i)
+      hash_range(edge_size + i * stride, block_size);
+    hash_range(size - edge_size, edge_size);
+  }
 
+  stamp.content_hash = hash;
+  return stamp;
+#else
+  throw FileError("cannot stamp '" + path + "': not supported");
+#endif
+}
+
+
+void WriteFileOrThrow(const std::string& path, std::string_view contents)
+{
+#ifndef _WIN32
+  auto tmp_path = path + ".tmp." + std::to_string(getpid());
+  {
+    FileDescriptor file(open(tmp_path.c_str(),
+                             O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                             0644));
+    if( file.get() == -1 )
+      throw FileError(
+        "cannot create '" + tmp_path + "': " + StrError(errno)
+      );
+
+    while( !contents.empty() )
+    {
+      auto written = write(file.get(), contents.data(), contents.size());
+      if( written == -1 && errno == EINTR )
+        continue;
+      if( written == -1 )
+      {
+        auto error = errno;
+        unlink(tmp_path.c_str());
+        throw FileError(
+          "cannot write '" + tmp_path + "': " + StrError(error)
+        );
+      }
+      contents.remove_prefix(static_cast<std::size_t>(written));
+    }
+  }
+#else
+  auto tmp_path = path + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::out | std::ios::binary);
+    file.write(contents.data(),
+               static_cast<std::streamsize>(contents.size()));
+    if( !file )
+      throw FileError("cannot write '" + tmp_path + "'");
+  }
+#endif
+
+  if( std::rename(tmp_path.c_str(), path.c_str()) != 0 )
+  {
+    auto error = errno;
+    std::remove(tmp_path.c_str());
+    throw FileError(
+      "cannot rename '" + tmp_path + "' to '" + path + "': "
+      + StrError(error)
+    );
+  }
+}
+
+
+} // namespace bbrd
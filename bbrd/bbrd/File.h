@@ -3,8 +3,17 @@
 
 #pragma once
 
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <stdexcept>
+#include <thread>
 
 
 namespace bbrd {
@@ -18,9 +27,167 @@ public:
 };
 
 
+/// How the contents of a mapped file will be accessed.
+enum class FileAccess
+{
+  /// Read front to back exactly once, e.g. by the parser
+  sequential,
+  /// Random reads, e.g. lookups in a cache
+  random,
+};
+
+
+/// Read-only contents of a file. Regular files are memory mapped, everything
+/// else (stdin, named pipes) is read into an owned buffer.
+/// The address of the contents is stable, even if a FileBuffer is moved.
+class FileBuffer
+{
+public:
+  FileBuffer() noexcept;
+  explicit FileBuffer(std::string contents);
+  ~FileBuffer();
+
+  FileBuffer(FileBuffer&& other) noexcept;
+  FileBuffer(const FileBuffer& other) = delete;
+  FileBuffer& operator=(FileBuffer&& other) noexcept;
+  FileBuffer& operator=(const FileBuffer& other) = delete;
+
+  /// Map size bytes of the open file descriptor fd. Throws FileError on
+  /// failure.
+  static FileBuffer Map(int fd,
+                        std::size_t size,
+                        const std::string& path,
+                        FileAccess access = FileAccess::sequential);
+
+  const char * data() const noexcept
+  { return this->data_; }
+
+  std::size_t size() const noexcept
+  { return this->size_; }
+
+  std::string_view view() const noexcept
+  { return std::string_view(this->data_, this->size_); }
+
+  bool is_mapped() const noexcept
+  { return this->mapping_ != nullptr; }
+
+private:
+  void release() noexcept;
+
+  void * mapping_;
+  std::unique_ptr<std::string> owned_;
+  const char * data_;
+  std::size_t size_;
+};
+
+
+class Decompressor;
+
+
+/// Reads a file in fixed-size chunks on a background thread, so that reading
+/// the next chunks overlaps with processing the current one.
+/// Can read regular files as well as named pipes and "-" (stdin).
+/// Files compressed with gzip or zstd are detected by their first bytes and
+/// decompressed on the background thread, the chunks are decompressed.
+class ChunkedReader
+{
+public:
+  static constexpr std::size_t default_chunk_size = 1 << 20;
+
+  /// Open path and start reading. Throws FileError on failure.
+  /// thread_count is passed on to the Decompressor, see there.
+  explicit ChunkedReader(const std::string& path,
+                         std::size_t chunk_size = default_chunk_size,
+                         unsigned thread_count = 0);
+  ~ChunkedReader();
+
+  ChunkedReader(ChunkedReader&& other) = delete;
+  ChunkedReader(const ChunkedReader& other) = delete;
+  ChunkedReader& operator=(ChunkedReader&& other) = delete;
+  ChunkedReader& operator=(const ChunkedReader& other) = delete;
+
+  /// Wait for the next chunk. Returns false at the end of the file. The chunk
+  /// stays valid until the next call. Throws FileError on failure.
+  bool next(std::string_view& chunk);
+
+private:
+  /// A ring of buffers: One buffer is being processed while the others are
+  /// being filled.
+  static constexpr std::size_t buffer_count = 4;
+
+  void read_loop() noexcept;
+  /// Fill buffer with the next bytes of the (decompressed) file. Returns the
+  /// number of bytes, which is less than the size of buffer at the end.
+  std::size_t fill(std::string& buffer);
+  std::size_t read_raw(char * dest, std::size_t size);
+
+  std::string path_;
+  int fd_;
+  bool close_fd_;
+  unsigned thread_count_;
+  /// The first bytes of the file, read ahead to detect its compression
+  std::string head_;
+  bool detected_;
+  std::unique_ptr<Decompressor> decompressor_;
+  std::array<std::string, buffer_count> buffers_;
+  std::array<std::size_t, buffer_count> sizes_;
+  std::size_t filled_;
+  std::size_t read_index_;
+  bool holds_chunk_;
+  bool eof_;
+  bool stop_;
+  std::exception_ptr error_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  std::thread thread_;
+};
+
+
+/// Returns true if path refers to a regular file, which can be memory mapped.
+bool IsRegularFile(const std::string& path);
+
+
 /// Read file at path to buffer. Throws FileError on failure.
-/// Can read regular files as well as named pipes.
-std::string ReadFileOrThrow(const std::string& path);
+/// Regular files are memory mapped. Named pipes and "-" (stdin) are read
+/// into memory.
+FileBuffer ReadFileOrThrow(const std::string& path,
+                           FileAccess access = FileAccess::sequential);
+
+
+/// Identifies a regular file and its contents.
+struct FileStamp
+{
+  std::uint64_t device;
+  std::uint64_t inode;
+  std::uint64_t size;
+  std::int64_t mtime_ns;
+  /// Hash of the size and a sample of the contents: The first and last
+  /// 256 KiB and 32 evenly spaced blocks in between. Reads at most 1.5 MiB,
+  /// regardless of the size of the file.
+  std::uint64_t content_hash;
+
+  bool operator==(const FileStamp& other) const noexcept
+  {
+    return this->device == other.device
+        && this->inode == other.inode
+        && this->size == other.size
+        && this->mtime_ns == other.mtime_ns
+        && this->content_hash == other.content_hash;
+  }
+
+  bool operator!=(const FileStamp& other) const noexcept
+  { return !(*this == other); }
+};
+
+
+/// Stat and sample the regular file at path. Throws FileError on failure.
+FileStamp ReadFileStampOrThrow(const std::string& path);
+
+
+/// Replace the file at path with contents. The contents are written to a
+/// temporary file which is then renamed, so readers never see a partially
+/// written file. Throws FileError on failure.
+void WriteFileOrThrow(const std::string& path, std::string_view contents);
 
 
 } // namespace bbtd
@@ -0,0 +1,126 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/GraphCache.h"
+#include "bbrd/File.h"
+#include "bbrd/GraphImage.h"
+#include "bbrd/Hash.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+
+namespace {
+
+
+constexpr const char * cache_suffix = ".bbrd-cache";
+
+
+/// Returns true if files can be created in the directory of file.
+bool IsDirectoryOfWritable(const std::string& file)
+{
+#ifndef _WIN32
+  auto slash = file.rfind('/');
+  auto directory = ( slash == std::string::npos )
+    ? std::string(".")
+    : file.substr(0, slash == 0 ? 1 : slash);
+  return access(directory.c_str(), W_OK) == 0;
+#else
+  (void)file;
+  return true;
+#endif
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+std::string GraphCachePath(const std::string& input_file,
+                           const FileStamp& input_stamp,
+                           const std::string& cache_dir)
+{
+  if( cache_dir.empty() )
+    return input_file + cache_suffix;
+
+  auto slash = input_file.rfind('/');
+  auto file_name = ( slash == std::string::npos )
+    ? input_file
+    : input_file.substr(slash + 1);
+
+  auto hash = HashBytes(std::string_view(
+      reinterpret_cast<const char *>(&input_stamp.device),
+      sizeof(input_stamp.device)));
+  hash = HashBytes(std::string_view(
+      reinterpret_cast<const char *>(&input_stamp.inode),
+      sizeof(input_stamp.inode)), hash);
+
+  char hex[17];
+  std::snprintf(hex, sizeof(hex), "%016llx",
+                static_cast<unsigned long long>(hash));
+
+  auto path = cache_dir;
+  if( path.back() != '/' )
+    path += '/';
+
+  return path + file_name + "." + hex + cache_suffix;
+}
+
+std::string DefaultGraphCacheDir(const std::string& input_file)
+{
+  if( IsDirectoryOfWritable(input_file) )
+    return "";
+
+  const char * xdg_cache_home = std::getenv("XDG_CACHE_HOME");
+  if( xdg_cache_home && xdg_cache_home[0] == '/' )
+    return std::string(xdg_cache_home) + "/bbrd";
+
+  const char * home = std::getenv("HOME");
+  if( home && home[0] )
+    return std::string(home) + "/.cache/bbrd";
+
+  return "";
+}
+
+std::optional<GraphImage> LoadGraphCache(const std::string& path,
+                                         const FileStamp& input_stamp)
+{
+  try
+  {
+    if( !IsRegularFile(path) )
+      return {};
+
+    GraphImage image(ReadFileOrThrow(path, FileAccess::random));
+    if( image.source() != input_stamp )
+      return {};
+
+    return image;
+  }
+  catch( const FileError& )
+  {
+    return {};
+  }
+  catch( const GraphImageError& )
+  {
+    return {};
+  }
+}
+
+void WriteGraphCache(const std::string& path, const GraphImage& image)
+{
+  WriteFileOrThrow(path, image.bytes());
+}
+
+
+} // namespace bbrd
+
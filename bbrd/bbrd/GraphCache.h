@@ -0,0 +1,43 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/File.h"
+#include "bbrd/GraphImage.h"
+
+#include <optional>
+#include <string>
+
+
+namespace bbrd {
+
+
+/// Path of the cached graph of input_file. The cache is stored next to
+/// input_file, or in cache_dir if it is not empty. Files in cache_dir are
+/// named after the device and inode of input_file, so that files with the
+/// same name in different directories do not collide.
+std::string GraphCachePath(const std::string& input_file,
+                           const FileStamp& input_stamp,
+                           const std::string& cache_dir = "");
+
+
+/// The directory of the cached graph of input_file if none was given: Empty
+/// (next to input_file) if the directory of input_file is writable,
+/// otherwise the cache directory of the user, $XDG_CACHE_HOME/bbrd or
+/// ~/.cache/bbrd.
+std::string DefaultGraphCacheDir(const std::string& input_file);
+
+
+/// Map the cached graph at path. Returns nothing if there is no cache, if it
+/// is invalid or if it was built from a different version of the input file.
+std::optional<GraphImage> LoadGraphCache(const std::string& path,
+                                         const FileStamp& input_stamp);
+
+
+/// Store image at path. Throws FileError on failure.
+void WriteGraphCache(const std::string& path, const GraphImage& image);
+
+
+} // namespace bbrd
+
@@ -0,0 +1,176 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/GraphDiff.h"
+#include "bbrd/CsrGraph.h"
+#include "bbrd/GraphImage.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <ostream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+
+namespace {
+
+
+using Id = bbrd::CsrGraph::Vertex;
+
+
+constexpr Id no_id = std::numeric_limits<Id>::max();
+
+
+/// The dependencies of graph, with ids mapped by shared_id, packed into 64
+/// bits each and sorted.
+std::vector<std::uint64_t> SortedDependencies(const bbrd::CsrGraph& graph,
+                                              const std::vector<Id>& shared_id)
+{
+  std::vector<std::uint64_t> dependencies;
+  dependencies.reserve(graph.edge_count());
+  for(Id v = 0; v < graph.vertex_count(); ++v)
+    for(auto w = graph.targets_begin(v); w != graph.targets_end(v); ++w)
+      dependencies.push_back(
+          ( std::uint64_t(shared_id[v]) << 32 ) | shared_id[*w]);
+  std::sort(dependencies.begin(), dependencies.end());
+  return dependencies;
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+GraphDiff GraphDiff::Compute(const GraphImage& old_image,
+                             const GraphImage& new_image,
+                             bool transitive)
+{
+  if( transitive && !( old_image.has_closure() && new_image.has_closure() ) )
+    throw std::invalid_argument("a transitive diff requires closure indexes");
+
+  // Recipes of the new image keep their ids. Recipes that were removed are
+  // numbered after them.
+  std::vector<Id> old_to_shared(old_image.recipe_count());
+  std::vector<Id> new_to_old(new_image.recipe_count(), no_id);
+  std::vector<Id> new_to_shared(new_image.recipe_count());
+  std::iota(new_to_shared.begin(), new_to_shared.end(), 0);
+
+  // The name of every shared id
+  std::vector<std::string_view> names;
+  names.reserve(new_image.recipe_count());
+  for(Id v = 0; v < new_image.recipe_count(); ++v)
+    names.push_back(new_image.recipe_name(v));
+
+  // Recipes whose tasks only depend on each other have an id if the image
+  // contains tasks, but are neither added nor removed
+  GraphDiff diff;
+  for(Id v = 0; v < old_image.recipe_count(); ++v)
+  {
+    auto name = old_image.recipe_name(v);
+    auto id = new_image.find(name);
+    if( id && old_image.in_recipe_graph(v) && new_image.in_recipe_graph(*id) )
+    {
+      old_to_shared[v] = static_cast<Id>(*id);
+      new_to_old[*id] = v;
+    }
+    else
+    {
+      old_to_shared[v] = static_cast<Id>(names.size());
+      names.push_back(name);
+      if( old_image.in_recipe_graph(v) )
+        diff.removed_recipes.push_back(name);
+    }
+  }
+
+  for(Id v = 0; v < new_image.recipe_count(); ++v)
+    if( new_to_old[v] == no_id && new_image.in_recipe_graph(v) )
+      diff.added_recipes.push_back(names[v]);
+
+  auto dependency_of = [&names](std::uint64_t dependency){
+    return Dependency{names[dependency >> 32], names[dependency & 0xffffffff]};
+  };
+
+  auto old_dependencies = SortedDependencies(old_image.forward(),
+                                             old_to_shared);
+  auto new_dependencies = SortedDependencies(new_image.forward(),
+                                             new_to_shared);
+  std::vector<std::uint64_t> changed;
+  std::set_difference(new_dependencies.begin(), new_dependencies.end(),
+                      old_dependencies.begin(), old_dependencies.end(),
+                      std::back_inserter(changed));
+  for(auto dependency : changed)
+    diff.added_dependencies.push_back(dependency_of(dependency));
+
+  changed.clear();
+  std::set_difference(old_dependencies.begin(), old_dependencies.end(),
+                      new_dependencies.begin(), new_dependencies.end(),
+                      std::back_inserter(changed));
+  for(auto dependency : changed)
+    diff.removed_dependencies.push_back(dependency_of(dependency));
+
+  if( transitive )
+  {
+    // The recipe whose transitive dependencies last contained a shared id
+    std::vector<Id> in_old(names.size(), no_id);
+    std::vector<Id> in_new(names.size(), no_id);
+    const auto& old_closure = old_image.forward_closure();
+    const auto& new_closure = new_image.forward_closure();
+    for(Id v = 0; v < new_image.recipe_count(); ++v)
+    {
+      auto old_v = new_to_old[v];
+      if( old_v == no_id )
+        continue;
+
+      old_closure.for_each_reachable(old_v, [&](Id w){
+        in_old[old_to_shared[w]] = v;
+      });
+      new_closure.for_each_reachable(v, [&](Id w){
+        in_new[w] = v;
+        if( in_old[w] != v )
+          diff.added_transitive.push_back({names[v], names[w]});
+      });
+      old_closure.for_each_reachable(old_v, [&](Id w){
+        auto shared = old_to_shared[w];
+        if( in_new[shared] != v )
+          diff.removed_transitive.push_back({names[v], names[shared]});
+      });
+    }
+  }
+
+  std::sort(diff.added_recipes.begin(), diff.added_recipes.end());
+  std::sort(diff.removed_recipes.begin(), diff.removed_recipes.end());
+  for(auto list : {&diff.added_dependencies,
+                   &diff.removed_dependencies,
+                   &diff.added_transitive,
+                   &diff.removed_transitive})
+    std::sort(list->begin(), list->end());
+
+  return diff;
+}
+
+void GraphDiff::print(std::ostream& out) const
+{
+  for(auto recipe : this->removed_recipes)
+    out << "- " << recipe << "\n";
+  for(auto recipe : this->added_recipes)
+    out << "+ " << recipe << "\n";
+  for(const auto& [to, from] : this->removed_dependencies)
+    out << "- " << to << " -> " << from << "\n";
+  for(const auto& [to, from] : this->added_dependencies)
+    out << "+ " << to << " -> " << from << "\n";
+  for(const auto& [to, from] : this->removed_transitive)
+    out << "- " << to << " ->* " << from << "\n";
+  for(const auto& [to, from] : this->added_transitive)
+    out << "+ " << to << " ->* " << from << "\n";
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,62 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/GraphImage.h"
+
+#include <ostream>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// The recipes and dependencies that were added or removed between two
+/// graphs, e.g. before and after bumping a layer. All names point into the
+/// images, which must outlive the diff.
+struct GraphDiff
+{
+  using Dependency = std::pair<std::string_view, std::string_view>;
+
+  /// Compare the recipe graphs of old_image and new_image. Recipes of
+  /// old_image are mapped to the ids of new_image by name, recipes that only
+  /// exist in old_image are numbered after them. The dependencies of both
+  /// graphs are then packed into 64 bits each, sorted and merged.
+  ///
+  /// If transitive is set, the changes in the transitive dependencies of
+  /// every recipe that is part of both graphs are computed as well, which
+  /// requires the closure index of both images.
+  static GraphDiff Compute(const GraphImage& old_image,
+                           const GraphImage& new_image,
+                           bool transitive = false);
+
+  bool empty() const noexcept
+  {
+    return this->added_recipes.empty()
+        && this->removed_recipes.empty()
+        && this->added_dependencies.empty()
+        && this->removed_dependencies.empty()
+        && this->added_transitive.empty()
+        && this->removed_transitive.empty();
+  }
+
+  /// One line per change, e.g. "+ curl -> openssl", "- zlib" or, for
+  /// transitive dependencies, "+ curl ->* libc". Removals are listed before
+  /// additions, everything is ordered by name.
+  void print(std::ostream& out) const;
+
+  // Ordered by name
+  std::vector<std::string_view> added_recipes = {};
+  std::vector<std::string_view> removed_recipes = {};
+  std::vector<Dependency> added_dependencies = {};
+  std::vector<Dependency> removed_dependencies = {};
+  std::vector<Dependency> added_transitive = {};
+  std::vector<Dependency> removed_transitive = {};
+};
+
+
+} // namespace bbrd
+
@@ -0,0 +1,773 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/GraphImage.h"
+#include "bbrd/ClosureIndex.h"
+#include "bbrd/Condensation.h"
+#include "bbrd/Hash.h"
+#include "bbrd/TaskDependencies.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+
+constexpr char image_magic[8] = {'B', 'B', 'R', 'D', 'G', 'R', 'P', 'H'};
+constexpr std::uint32_t image_version = 4;
+constexpr std::uint32_t image_byte_order = 0x01020304;
+constexpr std::uint32_t empty_id = std::numeric_limits<std::uint32_t>::max();
+
+
+struct Header
+{
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  bbrd::FileStamp source;
+  std::uint64_t recipe_count;
+  std::uint64_t dependency_count;
+  std::uint64_t slot_count;
+  std::uint64_t names_size;
+  std::uint64_t component_count;
+  std::uint64_t condensed_dependency_count;
+  /// One if the image contains a closure index, zero otherwise.
+  std::uint64_t closure;
+  /// One if the image contains the task graph, zero otherwise.
+  std::uint64_t tasks;
+  std::uint64_t task_name_count;
+  std::uint64_t task_names_size;
+  std::uint64_t task_count;
+  std::uint64_t task_dependency_count;
+};
+
+
+std::size_t Align(std::size_t offset) noexcept
+{
+  return (offset + 7) & ~std::size_t(7);
+}
+
+
+/// The size of count elements of element_size bytes.
+std::size_t Size(std::uint64_t count, std::size_t element_size) noexcept
+{
+  return static_cast<std::size_t>(count) * element_size;
+}
+
+
+/// Byte offsets of the sections of an image.
+struct Layout
+{
+  explicit Layout(const Header& h) noexcept
+  : name_offsets(Align(sizeof(Header)))
+  , forward_offsets(name_offsets + Size(h.recipe_count + 1, 8))
+  , forward_targets(forward_offsets + Size(h.recipe_count + 1, 8))
+  , reverse_offsets(Align(forward_targets + Size(h.dependency_count, 4)))
+  , reverse_targets(reverse_offsets + Size(h.recipe_count + 1, 8))
+  , index(Align(reverse_targets + Size(h.dependency_count, 4)))
+  , names(index + Size(h.slot_count, 8))
+  , component_of(Align(names + Size(h.names_size, 1)))
+  , member_offsets(Align(component_of + Size(h.recipe_count, 4)))
+  , members(member_offsets + Size(h.component_count + 1, 8))
+  , condensed_forward_offsets(Align(members + Size(h.recipe_count, 4)))
+  , condensed_forward_targets(condensed_forward_offsets
+                                + Size(h.component_count + 1, 8))
+  , condensed_reverse_offsets(Align(condensed_forward_targets
+                                      + Size(h.condensed_dependency_count, 4)))
+  , condensed_reverse_targets(condensed_reverse_offsets
+                                + Size(h.component_count + 1, 8))
+  , task_name_offsets(Align(condensed_reverse_targets
+                              + Size(h.condensed_dependency_count, 4)))
+  , task_names(task_name_offsets
+                 + Size(h.tasks ? h.task_name_count + 1 : 0, 8))
+  , tasks(Align(task_names + Size(h.task_names_size, 1)))
+  , recipe_task_offsets(Align(tasks + Size(h.task_count, 4)))
+  , task_forward_offsets(recipe_task_offsets
+                           + Size(h.tasks ? h.recipe_count + 1 : 0, 8))
+  , task_forward_targets(task_forward_offsets
+                           + Size(h.tasks ? h.task_count + 1 : 0, 8))
+  , task_reverse_offsets(Align(task_forward_targets
+                                 + Size(h.task_dependency_count, 4)))
+  , task_reverse_targets(task_reverse_offsets
+                           + Size(h.tasks ? h.task_count + 1 : 0, 8))
+  , forward_closure(Align(task_reverse_targets
+                            + Size(h.task_dependency_count, 4)))
+  , reverse_closure(forward_closure + Size(h.closure ? h.component_count : 0,
+                                           ClosureRowSize(h)))
+  , size(reverse_closure + Size(h.closure ? h.component_count : 0,
+                                ClosureRowSize(h)))
+  {}
+
+  static std::size_t ClosureRowSize(const Header& h) noexcept
+  {
+    return bbrd::ClosureIndex::WordsPerRow(
+        static_cast<std::size_t>(h.recipe_count)) * 8;
+  }
+
+  std::size_t name_offsets;
+  std::size_t forward_offsets;
+  std::size_t forward_targets;
+  std::size_t reverse_offsets;
+  std::size_t reverse_targets;
+  std::size_t index;
+  std::size_t names;
+  std::size_t component_of;
+  std::size_t member_offsets;
+  std::size_t members;
+  std::size_t condensed_forward_offsets;
+  std::size_t condensed_forward_targets;
+  std::size_t condensed_reverse_offsets;
+  std::size_t condensed_reverse_targets;
+  std::size_t task_name_offsets;
+  std::size_t task_names;
+  std::size_t tasks;
+  std::size_t recipe_task_offsets;
+  std::size_t task_forward_offsets;
+  std::size_t task_forward_targets;
+  std::size_t task_reverse_offsets;
+  std::size_t task_reverse_targets;
+  std::size_t forward_closure;
+  std::size_t reverse_closure;
+  std::size_t size;
+};
+
+
+template<typename T>
+const T * SectionAt(const char * image, std::size_t offset) noexcept
+{
+  return static_cast<const T *>(static_cast<const void *>(image + offset));
+}
+
+
+template<typename T>
+T * SectionAt(char * image, std::size_t offset) noexcept
+{
+  return static_cast<T *>(static_cast<void *>(image + offset));
+}
+
+
+std::uint32_t Fingerprint(std::uint64_t hash) noexcept
+{
+  return static_cast<std::uint32_t>(hash >> 32);
+}
+
+
+/// Sort the dependencies by key with a counting sort. Stores the start of
+/// every key's run in offsets and the other end of the edge in targets.
+template<typename Key, typename Value>
+void CountingSort(const bbrd::Dependencies& dependencies,
+                  std::size_t recipe_count,
+                  Key key,
+                  Value value,
+                  std::uint64_t * offsets,
+                  std::uint32_t * targets)
+{
+  std::fill(offsets, offsets + recipe_count + 1, 0);
+  for(const auto& dependency : dependencies)
+    offsets[key(dependency) + 1]++;
+
+  for(std::size_t i = 0; i < recipe_count; ++i)
+    offsets[i + 1] += offsets[i];
+
+  std::vector<std::uint64_t> next(offsets, offsets + recipe_count);
+  for(const auto& dependency : dependencies)
+    targets[next[key(dependency)]++] =
+      static_cast<std::uint32_t>(value(dependency));
+}
+
+
+/// Copy the arrays of condensation to their sections in image.
+void WriteCondensation(const bbrd::Condensation::Data& condensation,
+                       const Layout& layout,
+                       char * image)
+{
+  auto copy = [image](const auto& section, std::size_t offset){
+    using T = typename std::decay_t<decltype(section)>::value_type;
+    std::copy(section.begin(), section.end(), SectionAt<T>(image, offset));
+  };
+  copy(condensation.component_of, layout.component_of);
+  copy(condensation.member_offsets, layout.member_offsets);
+  copy(condensation.members, layout.members);
+  copy(condensation.forward_offsets, layout.condensed_forward_offsets);
+  copy(condensation.forward_targets, layout.condensed_forward_targets);
+  copy(condensation.reverse_offsets, layout.condensed_reverse_offsets);
+  copy(condensation.reverse_targets, layout.condensed_reverse_targets);
+}
+
+
+/// The dependencies between tasks, deduplicated and sorted, and the tasks
+/// that occur in them.
+struct TaskGraph
+{
+  using Node = bbrd::TaskDependencies::Node;
+
+  explicit TaskGraph(const bbrd::TaskDependencies& tasks)
+  : names(tasks.task_names())
+  , names_size(0)
+  , dependencies(tasks.dependencies())
+  , nodes()
+  {
+    for(auto name : this->names)
+      this->names_size += name.size();
+
+    std::sort(this->dependencies.begin(), this->dependencies.end());
+    this->dependencies.erase(
+        std::unique(this->dependencies.begin(), this->dependencies.end()),
+        this->dependencies.end());
+
+    this->nodes.reserve(this->dependencies.size());
+    for(auto dependency : this->dependencies)
+    {
+      this->nodes.push_back(bbrd::TaskDependencies::To(dependency));
+      this->nodes.push_back(bbrd::TaskDependencies::From(dependency));
+    }
+    std::sort(this->nodes.begin(), this->nodes.end());
+    this->nodes.erase(std::unique(this->nodes.begin(), this->nodes.end()),
+                      this->nodes.end());
+    this->nodes.shrink_to_fit();
+  }
+
+  /// The index of node in nodes, which must contain it.
+  std::uint32_t index_of(Node node) const noexcept
+  {
+    return static_cast<std::uint32_t>(
+        std::lower_bound(this->nodes.begin(), this->nodes.end(), node)
+        - this->nodes.begin());
+  }
+
+  /// Store the task graph in the task sections of image.
+  void write(const Layout& layout,
+             std::size_t recipe_count,
+             char * image) const
+  {
+    auto name_offsets =
+      SectionAt<std::uint64_t>(image, layout.task_name_offsets);
+    std::size_t name_offset = 0;
+    for(std::size_t i = 0; i < this->names.size(); ++i)
+    {
+      name_offsets[i] = name_offset;
+      std::memcpy(image + layout.task_names + name_offset,
+                  this->names[i].data(),
+                  this->names[i].size());
+      name_offset += this->names[i].size();
+    }
+    name_offsets[this->names.size()] = name_offset;
+
+    std::copy(this->nodes.begin(),
+              this->nodes.end(),
+              SectionAt<Node>(image, layout.tasks));
+
+    // Tasks are sorted by recipe, the tasks of a recipe are contiguous
+    auto recipe_offsets =
+      SectionAt<std::uint64_t>(image, layout.recipe_task_offsets);
+    std::size_t task = 0;
+    for(std::size_t recipe = 0; recipe <= recipe_count; ++recipe)
+    {
+      while( task < this->nodes.size() &&
+             bbrd::TaskDependencies::RecipeOf(this->nodes[task]) < recipe )
+        ++task;
+      recipe_offsets[recipe] = task;
+    }
+
+    // Dependencies are sorted by their first task, which yields the forward
+    // edges in order
+    auto task_count = this->nodes.size();
+    auto forward_offsets =
+      SectionAt<std::uint64_t>(image, layout.task_forward_offsets);
+    auto forward_targets =
+      SectionAt<std::uint32_t>(image, layout.task_forward_targets);
+    auto reverse_offsets =
+      SectionAt<std::uint64_t>(image, layout.task_reverse_offsets);
+    auto reverse_targets =
+      SectionAt<std::uint32_t>(image, layout.task_reverse_targets);
+    std::fill(forward_offsets, forward_offsets + task_count + 1, 0);
+    std::fill(reverse_offsets, reverse_offsets + task_count + 1, 0);
+    std::vector<std::uint32_t> sources;
+    sources.reserve(this->dependencies.size());
+    for(std::size_t i = 0; i < this->dependencies.size(); ++i)
+    {
+      auto dependency = this->dependencies[i];
+      auto to = this->index_of(bbrd::TaskDependencies::To(dependency));
+      auto from = this->index_of(bbrd::TaskDependencies::From(dependency));
+      sources.push_back(to);
+      forward_targets[i] = from;
+      forward_offsets[to + 1]++;
+      reverse_offsets[from + 1]++;
+    }
+
+    for(std::size_t i = 0; i < task_count; ++i)
+    {
+      forward_offsets[i + 1] += forward_offsets[i];
+      reverse_offsets[i + 1] += reverse_offsets[i];
+    }
+
+    std::vector<std::uint64_t> next(reverse_offsets,
+                                    reverse_offsets + task_count);
+    for(std::size_t i = 0; i < this->dependencies.size(); ++i)
+      reverse_targets[next[forward_targets[i]]++] = sources[i];
+  }
+
+  bbrd::RecipeInterner::Names names;
+  std::size_t names_size;
+  std::vector<std::uint64_t> dependencies;
+  std::vector<Node> nodes;
+};
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+GraphImageError::GraphImageError(const std::string& msg) noexcept
+: std::runtime_error(msg)  // noexcept
+{
+}
+
+
+GraphImage GraphImage::Build(const Dependencies& dependencies,
+                             const FileStamp& source)
+{
+  auto recipe_count = dependencies.distinct_recipe_count();
+  auto dependency_count = static_cast<std::size_t>(
+      std::distance(dependencies.begin(), dependencies.end()));
+
+  // Keep the load factor of the index at or below 1/2
+  std::size_t slot_count = 1;
+  while( slot_count < recipe_count * 2 )
+    slot_count *= 2;
+
+  std::size_t names_size = 0;
+  for(auto name = dependencies.names_begin();
+      name != dependencies.names_end();
+      ++name)
+    names_size += name->size();
+
+  Header header{};
+  std::memcpy(header.magic, image_magic, sizeof(image_magic));
+  header.version = image_version;
+  header.byte_order = image_byte_order;
+  header.source = source;
+  header.recipe_count = recipe_count;
+  header.dependency_count = dependency_count;
+  header.slot_count = slot_count;
+  header.names_size = names_size;
+  header.component_count = 0;
+  header.condensed_dependency_count = 0;
+  header.closure = 0;
+
+  std::optional<TaskGraph> task_graph;
+  if( dependencies.tasks() )
+  {
+    task_graph.emplace(*dependencies.tasks());
+    header.tasks = 1;
+    header.task_name_count = task_graph->names.size();
+    header.task_names_size = task_graph->names_size;
+    header.task_count = task_graph->nodes.size();
+    header.task_dependency_count = task_graph->dependencies.size();
+  }
+
+  Layout layout(header);
+  std::string buffer(layout.size, '\0');
+  auto image = &buffer[0];
+  std::memcpy(image, &header, sizeof(header));
+
+  auto name_offsets = SectionAt<std::uint64_t>(image, layout.name_offsets);
+  auto index = SectionAt<Slot>(image, layout.index);
+  std::fill(index, index + slot_count, Slot{0, empty_id});
+  std::size_t name_offset = 0;
+  std::uint32_t id = 0;
+  for(auto name = dependencies.names_begin();
+      name != dependencies.names_end();
+      ++name, ++id)
+  {
+    name_offsets[id] = name_offset;
+    std::memcpy(image + layout.names + name_offset,
+                name->data(),
+                name->size());
+    name_offset += name->size();
+
+    auto hash = HashBytes(*name);
+    auto slot = static_cast<std::size_t>(hash) & (slot_count - 1);
+    while( index[slot].id != empty_id )
+      slot = (slot + 1) & (slot_count - 1);
+    index[slot] = Slot{Fingerprint(hash), id};
+  }
+  name_offsets[recipe_count] = name_offset;
+
+  CountingSort(dependencies,
+               recipe_count,
+               [](const auto& dependency){ return dependency.first; },
+               [](const auto& dependency){ return dependency.second; },
+               SectionAt<std::uint64_t>(image, layout.forward_offsets),
+               SectionAt<std::uint32_t>(image, layout.forward_targets));
+  CountingSort(dependencies,
+               recipe_count,
+               [](const auto& dependency){ return dependency.second; },
+               [](const auto& dependency){ return dependency.first; },
+               SectionAt<std::uint64_t>(image, layout.reverse_offsets),
+               SectionAt<std::uint32_t>(image, layout.reverse_targets));
+
+  // The size of the condensation is only known once it is computed
+  auto condensation = Condensation::Compute(CsrGraph(
+      SectionAt<std::uint64_t>(image, layout.forward_offsets),
+      SectionAt<std::uint32_t>(image, layout.forward_targets),
+      recipe_count));
+  header.component_count = condensation.member_offsets.size() - 1;
+  header.condensed_dependency_count = condensation.forward_targets.size();
+  layout = Layout(header);
+  buffer.resize(layout.size);
+  image = &buffer[0];
+  std::memcpy(image, &header, sizeof(header));
+  WriteCondensation(condensation, layout, image);
+  if( task_graph )
+    task_graph->write(layout, recipe_count, image);
+
+  return GraphImage(FileBuffer(std::move(buffer)));
+}
+
+GraphImage::GraphImage(FileBuffer buffer)
+: buffer_(std::move(buffer))
+, source_()
+, recipe_count_(0)
+, dependency_count_(0)
+, slot_count_(0)
+, name_offsets_(nullptr)
+, forward_offsets_(nullptr)
+, forward_targets_(nullptr)
+, reverse_offsets_(nullptr)
+, reverse_targets_(nullptr)
+, index_(nullptr)
+, names_(nullptr)
+, condensation_()
+, task_name_count_(0)
+, task_count_(0)
+, task_name_offsets_(nullptr)
+, task_names_(nullptr)
+, tasks_(nullptr)
+, recipe_task_offsets_(nullptr)
+, task_forward_offsets_(nullptr)
+, task_forward_targets_(nullptr)
+, task_reverse_offsets_(nullptr)
+, task_reverse_targets_(nullptr)
+, forward_closure_()
+, reverse_closure_()
+{
+  auto image = this->buffer_.data();
+  auto size = this->buffer_.size();
+
+  Header header;
+  if( size < sizeof(header) )
+    throw GraphImageError("graph image is truncated");
+
+  std::memcpy(&header, image, sizeof(header));
+  if( std::memcmp(header.magic, image_magic, sizeof(image_magic)) != 0 )
+    throw GraphImageError("not a graph image");
+
+  if( header.version != image_version ||
+      header.byte_order != image_byte_order )
+    throw GraphImageError("unsupported graph image version");
+
+  // Bound the counts before computing the layout, so it cannot overflow
+  if( header.recipe_count >= empty_id ||
+      header.dependency_count > size ||
+      header.slot_count > size ||
+      header.names_size > size ||
+      header.component_count > header.recipe_count ||
+      header.condensed_dependency_count > size ||
+      header.closure > 1 ||
+      header.tasks > 1 ||
+      header.task_name_count > size ||
+      header.task_names_size > size ||
+      header.task_count >= empty_id ||
+      header.task_count > size ||
+      header.task_dependency_count > size )
+    throw GraphImageError("graph image is corrupt");
+
+  if( !header.tasks &&
+      ( header.task_name_count || header.task_names_size ||
+        header.task_count || header.task_dependency_count ) )
+    throw GraphImageError("graph image is corrupt");
+
+  Layout layout(header);
+  if( layout.size != size ||
+      header.slot_count <= header.recipe_count ||
+      ( header.slot_count & (header.slot_count - 1) ) != 0 )
+    throw GraphImageError("graph image is corrupt");
+
+  this->source_ = header.source;
+  this->recipe_count_ = static_cast<std::size_t>(header.recipe_count);
+  this->dependency_count_ = static_cast<std::size_t>(header.dependency_count);
+  this->slot_count_ = static_cast<std::size_t>(header.slot_count);
+  this->name_offsets_ =
+    SectionAt<std::uint64_t>(image, layout.name_offsets);
+  this->forward_offsets_ =
+    SectionAt<std::uint64_t>(image, layout.forward_offsets);
+  this->forward_targets_ =
+    SectionAt<std::uint32_t>(image, layout.forward_targets);
+  this->reverse_offsets_ =
+    SectionAt<std::uint64_t>(image, layout.reverse_offsets);
+  this->reverse_targets_ =
+    SectionAt<std::uint32_t>(image, layout.reverse_targets);
+  this->index_ = SectionAt<Slot>(image, layout.index);
+  this->names_ = image + layout.names;
+  auto component_of = SectionAt<std::uint32_t>(image, layout.component_of);
+  auto member_offsets =
+    SectionAt<std::uint64_t>(image, layout.member_offsets);
+  auto members = SectionAt<std::uint32_t>(image, layout.members);
+  auto condensed_forward_offsets =
+    SectionAt<std::uint64_t>(image, layout.condensed_forward_offsets);
+  auto condensed_forward_targets =
+    SectionAt<std::uint32_t>(image, layout.condensed_forward_targets);
+  auto condensed_reverse_offsets =
+    SectionAt<std::uint64_t>(image, layout.condensed_reverse_offsets);
+  auto condensed_reverse_targets =
+    SectionAt<std::uint32_t>(image, layout.condensed_reverse_targets);
+  this->condensation_ = Condensation(
+      component_of,
+      member_offsets,
+      members,
+      condensed_forward_offsets,
+      condensed_forward_targets,
+      condensed_reverse_offsets,
+      condensed_reverse_targets,
+      this->recipe_count_,
+      static_cast<std::size_t>(header.component_count));
+  if( header.tasks )
+  {
+    this->task_name_count_ = static_cast<std::size_t>(header.task_name_count);
+    this->task_count_ = static_cast<std::size_t>(header.task_count);
+    this->task_name_offsets_ =
+      SectionAt<std::uint64_t>(image, layout.task_name_offsets);
+    this->task_names_ = image + layout.task_names;
+    this->tasks_ = SectionAt<TaskDependencies::Node>(image, layout.tasks);
+    this->recipe_task_offsets_ =
+      SectionAt<std::uint64_t>(image, layout.recipe_task_offsets);
+    this->task_forward_offsets_ =
+      SectionAt<std::uint64_t>(image, layout.task_forward_offsets);
+    this->task_forward_targets_ =
+      SectionAt<std::uint32_t>(image, layout.task_forward_targets);
+    this->task_reverse_offsets_ =
+      SectionAt<std::uint64_t>(image, layout.task_reverse_offsets);
+    this->task_reverse_targets_ =
+      SectionAt<std::uint32_t>(image, layout.task_reverse_targets);
+  }
+
+  if( header.closure )
+  {
+    this->forward_closure_ = ClosureIndex(
+        component_of,
+        SectionAt<ClosureIndex::Word>(image, layout.forward_closure),
+        this->recipe_count_);
+    this->reverse_closure_ = ClosureIndex(
+        component_of,
+        SectionAt<ClosureIndex::Word>(image, layout.reverse_closure),
+        this->recipe_count_);
+  }
+
+  // Check everything that is used to index into the image. This is linear in
+  // the number of recipes and dependencies, which is a small fraction of the
+  // size of the task-depends.dot the image was built from.
+  auto check_offsets = [](const std::uint64_t * offsets,
+                          std::size_t count,
+                          std::uint64_t last){
+    if( offsets[0] != 0 || offsets[count] != last )
+      return false;
+    for(std::size_t i = 0; i < count; ++i)
+      if( offsets[i] > offsets[i + 1] )
+        return false;
+    return true;
+  };
+  auto check_ids = [](const std::uint32_t * ids,
+                      std::size_t count,
+                      std::uint64_t limit){
+    for(std::size_t i = 0; i < count; ++i)
+      if( ids[i] >= limit )
+        return false;
+    return true;
+  };
+  auto check_index = [this](){
+    std::size_t used = 0;
+    for(std::size_t i = 0; i < this->slot_count_; ++i)
+      if( this->index_[i].id != empty_id )
+      {
+        if( this->index_[i].id >= this->recipe_count_ )
+          return false;
+        ++used;
+      }
+    return used == this->recipe_count_;
+  };
+  // Building the closure relies on the order of the components: Successors
+  // have smaller numbers.
+  auto check_order = [&header, condensed_forward_offsets,
+                      condensed_forward_targets](){
+    for(std::size_t c = 0; c < header.component_count; ++c)
+      for(auto i = condensed_forward_offsets[c];
+          i < condensed_forward_offsets[c + 1];
+          ++i)
+        if( condensed_forward_targets[i] >= c )
+          return false;
+    return true;
+  };
+
+  auto n = this->recipe_count_;
+  auto m = this->dependency_count_;
+  auto c = static_cast<std::size_t>(header.component_count);
+  auto e = static_cast<std::size_t>(header.condensed_dependency_count);
+  if( !check_offsets(this->name_offsets_, n, header.names_size) ||
+      !check_offsets(this->forward_offsets_, n, m) ||
+      !check_offsets(this->reverse_offsets_, n, m) ||
+      !check_ids(this->forward_targets_, m, n) ||
+      !check_ids(this->reverse_targets_, m, n) ||
+      !check_index() ||
+      !check_ids(component_of, n, c) ||
+      !check_offsets(member_offsets, c, n) ||
+      !check_ids(members, n, n) ||
+      !check_offsets(condensed_forward_offsets, c, e) ||
+      !check_offsets(condensed_reverse_offsets, c, e) ||
+      !check_ids(condensed_forward_targets, e, c) ||
+      !check_ids(condensed_reverse_targets, e, c) ||
+      !check_order() )
+    throw GraphImageError("graph image is corrupt");
+
+  if( !header.tasks )
+    return;
+
+  // Tasks are sorted and grouped by recipe
+  auto check_tasks = [this](){
+    for(std::size_t recipe = 0; recipe < this->recipe_count_; ++recipe)
+      for(auto i = this->recipe_task_offsets_[recipe];
+          i < this->recipe_task_offsets_[recipe + 1];
+          ++i)
+      {
+        auto node = this->tasks_[i];
+        if( TaskDependencies::RecipeOf(node) != recipe ||
+            TaskDependencies::TaskOf(node) >= this->task_name_count_ ||
+            ( i > 0 && this->tasks_[i - 1] >= node ) )
+          return false;
+      }
+    return true;
+  };
+
+  auto t = this->task_count_;
+  auto d = static_cast<std::size_t>(header.task_dependency_count);
+  if( !check_offsets(this->task_name_offsets_,
+                     this->task_name_count_,
+                     header.task_names_size) ||
+      !check_offsets(this->recipe_task_offsets_, n, t) ||
+      !check_tasks() ||
+      !check_offsets(this->task_forward_offsets_, t, d) ||
+      !check_offsets(this->task_reverse_offsets_, t, d) ||
+      !check_ids(this->task_forward_targets_, d, t) ||
+      !check_ids(this->task_reverse_targets_, d, t) )
+    throw GraphImageError("graph image is corrupt");
+}
+
+GraphImage GraphImage::with_closure(unsigned thread_count) const
+{
+  Header header;
+  std::memcpy(&header, this->buffer_.data(), sizeof(header));
+  header.closure = 1;
+  Layout layout(header);
+
+  // The closure is appended to the sections that do not depend on it
+  std::string buffer(layout.size, '\0');
+  auto image = &buffer[0];
+  std::memcpy(image, this->buffer_.data(), layout.forward_closure);
+  std::memcpy(image, &header, sizeof(header));
+
+  ClosureIndex::Build(
+      this->condensation_,
+      false,
+      SectionAt<ClosureIndex::Word>(image, layout.forward_closure),
+      thread_count);
+  ClosureIndex::Build(
+      this->condensation_,
+      true,
+      SectionAt<ClosureIndex::Word>(image, layout.reverse_closure),
+      thread_count);
+
+  return GraphImage(FileBuffer(std::move(buffer)));
+}
+
+std::string_view GraphImage::recipe_name(std::size_t id) const
+{
+  if( id >= this->recipe_count_ )
+    throw std::out_of_range("recipe id out of range");
+
+  auto begin = this->name_offsets_[id];
+  return std::string_view(
+      this->names_ + begin,
+      static_cast<std::size_t>(this->name_offsets_[id + 1] - begin));
+}
+
+std::string_view GraphImage::task_name(std::size_t task) const
+{
+  if( task >= this->task_count_ )
+    throw std::out_of_range("task id out of range");
+
+  auto name = TaskDependencies::TaskOf(this->tasks_[task]);
+  auto begin = this->task_name_offsets_[name];
+  return std::string_view(
+      this->task_names_ + begin,
+      static_cast<std::size_t>(this->task_name_offsets_[name + 1] - begin));
+}
+
+std::optional<GraphImage::Id> GraphImage::find_task(
+    Id recipe,
+    std::string_view task) const noexcept
+{
+  if( !this->has_tasks() || recipe >= this->recipe_count_ )
+    return {};
+
+  // The tasks of recipe all have distinct names. There are few of them.
+  auto first = this->tasks_ + this->recipe_task_offsets_[recipe];
+  auto last = this->tasks_ + this->recipe_task_offsets_[recipe + 1];
+  for(auto it = first; it != last; ++it)
+  {
+    auto name = TaskDependencies::TaskOf(*it);
+    auto begin = this->task_name_offsets_[name];
+    auto size = static_cast<std::size_t>(
+        this->task_name_offsets_[name + 1] - begin);
+    if( std::string_view(this->task_names_ + begin, size) == task )
+      return static_cast<Id>(it - this->tasks_);
+  }
+
+  return {};
+}
+
+std::optional<GraphImage::Id> GraphImage::find(
+    std::string_view recipe) const noexcept
+{
+  // The index always has at least one empty slot
+  auto hash = HashBytes(recipe);
+  auto fingerprint = Fingerprint(hash);
+  auto mask = this->slot_count_ - 1;
+  for(auto slot = static_cast<std::size_t>(hash) & mask;;
+      slot = (slot + 1) & mask)
+  {
+    const auto& s = this->index_[slot];
+    if( s.id == empty_id )
+      return {};
+
+    if( s.fingerprint == fingerprint && this->recipe_name(s.id) == recipe )
+      return s.id;
+  }
+}
+
+
+} // namespace bbrd
+
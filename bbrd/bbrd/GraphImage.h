@@ -0,0 +1,237 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/ClosureIndex.h"
+#include "bbrd/Condensation.h"
+#include "bbrd/CsrGraph.h"
+#include "bbrd/Dependencies.h"
+#include "bbrd/File.h"
+#include "bbrd/TaskDependencies.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+
+namespace bbrd {
+
+
+/// Thrown if a buffer does not contain a valid GraphImage.
+class GraphImageError : public std::runtime_error
+{
+public:
+  explicit GraphImageError(const std::string& msg) noexcept;
+};
+
+
+/// The dependency graph between recipes in a single flat buffer, which is
+/// used as is in memory and on disk. A stored image is memory mapped and
+/// queried without any deserialization.
+///
+/// Layout, every section is aligned to 8 bytes:
+///   Header
+///   uint64 name_offsets[recipe_count + 1]     into names
+///   uint64 forward_offsets[recipe_count + 1]  into forward_targets
+///   uint32 forward_targets[dependency_count]
+///   uint64 reverse_offsets[recipe_count + 1]  into reverse_targets
+///   uint32 reverse_targets[dependency_count]
+///   Slot   index[slot_count]                  name lookup
+///   char   names[names_size]
+///   uint32 component_of[recipe_count]         see Condensation
+///   uint64 member_offsets[component_count + 1]
+///   uint32 members[recipe_count]
+///   uint64 condensed_forward_offsets[component_count + 1]
+///   uint32 condensed_forward_targets[condensed_dependency_count]
+///   uint64 condensed_reverse_offsets[component_count + 1]
+///   uint32 condensed_reverse_targets[condensed_dependency_count]
+/// If the image contains the task graph (see TaskDependencies):
+///   uint64 task_name_offsets[task_name_count + 1]  into task_names
+///   char   task_names[task_names_size]
+///   uint32 tasks[task_count]                       sorted
+///   uint64 recipe_task_offsets[recipe_count + 1]   into tasks
+///   uint64 task_forward_offsets[task_count + 1]
+///   uint32 task_forward_targets[task_dependency_count]
+///   uint64 task_reverse_offsets[task_count + 1]
+///   uint32 task_reverse_targets[task_dependency_count]
+/// Optionally followed by a transitive closure index (see ClosureIndex):
+///   uint64 forward_closure[component_count][words_per_row]
+///   uint64 reverse_closure[component_count][words_per_row]
+/// The index is an open addressing hash table with linear probing. Every slot
+/// holds a recipe id and a fingerprint of the hash of its name. All integers
+/// are stored in native byte order.
+class GraphImage
+{
+public:
+  using Id = CsrGraph::Vertex;
+
+  /// Build the image of dependencies. source identifies the file the
+  /// dependencies were parsed from, if any.
+  static GraphImage Build(const Dependencies& dependencies,
+                          const FileStamp& source = FileStamp());
+
+  /// Use the image stored in buffer. Throws GraphImageError if buffer does
+  /// not contain a valid image.
+  explicit GraphImage(FileBuffer buffer);
+
+  GraphImage(GraphImage&& other) = default;
+  GraphImage(const GraphImage& other) = delete;
+  GraphImage& operator=(GraphImage&& other) = default;
+  GraphImage& operator=(const GraphImage& other) = delete;
+
+  std::size_t recipe_count() const noexcept
+  { return this->recipe_count_; }
+
+  std::size_t dependency_count() const noexcept
+  { return this->dependency_count_; }
+
+  /// Throws std::out_of_range if there is no recipe with this id.
+  std::string_view recipe_name(std::size_t id) const;
+
+  std::optional<Id> find(std::string_view recipe) const noexcept;
+
+  /// Returns false for recipes whose tasks only depend on each other. They
+  /// have an id if the image contains tasks, but are not part of the graph
+  /// between recipes.
+  bool in_recipe_graph(Id recipe) const noexcept
+  {
+    return this->forward_offsets_[recipe] != this->forward_offsets_[recipe + 1]
+        || this->reverse_offsets_[recipe] != this->reverse_offsets_[recipe + 1];
+  }
+
+  /// Edges from recipes to their dependencies.
+  CsrGraph forward() const noexcept
+  {
+    return CsrGraph(this->forward_offsets_,
+                    this->forward_targets_,
+                    this->recipe_count_);
+  }
+
+  /// Edges from recipes to the recipes that depend on them.
+  CsrGraph reverse() const noexcept
+  {
+    return CsrGraph(this->reverse_offsets_,
+                    this->reverse_targets_,
+                    this->recipe_count_);
+  }
+
+  /// The strongly connected components of forward() and the acyclic graph
+  /// between them.
+  const Condensation& condensation() const noexcept
+  { return this->condensation_; }
+
+  /// Returns true if the image contains the dependencies between tasks.
+  bool has_tasks() const noexcept
+  { return this->tasks_ != nullptr; }
+
+  /// The number of tasks, i.e. of distinct pairs of recipe and task name.
+  /// Tasks are numbered by recipe, then by task name.
+  std::size_t task_count() const noexcept
+  { return this->task_count_; }
+
+  /// Throws std::out_of_range if there is no task with this id.
+  std::string_view task_name(std::size_t task) const;
+
+  /// The recipe of a task, which must exist.
+  Id task_recipe(std::size_t task) const noexcept
+  {
+    return static_cast<Id>(
+        TaskDependencies::RecipeOf(this->tasks_[task]));
+  }
+
+  /// The tasks of recipe are numbered from recipe_tasks_begin(recipe) to
+  /// recipe_tasks_end(recipe).
+  Id recipe_tasks_begin(Id recipe) const noexcept
+  { return static_cast<Id>(this->recipe_task_offsets_[recipe]); }
+
+  Id recipe_tasks_end(Id recipe) const noexcept
+  { return static_cast<Id>(this->recipe_task_offsets_[recipe + 1]); }
+
+  /// The id of the task of recipe, e.g. "do_compile".
+  std::optional<Id> find_task(Id recipe, std::string_view task) const noexcept;
+
+  /// Edges from tasks to the tasks they depend on. Empty unless has_tasks().
+  CsrGraph task_forward() const noexcept
+  {
+    return CsrGraph(this->task_forward_offsets_,
+                    this->task_forward_targets_,
+                    this->task_count_);
+  }
+
+  /// Edges from tasks to the tasks that depend on them.
+  CsrGraph task_reverse() const noexcept
+  {
+    return CsrGraph(this->task_reverse_offsets_,
+                    this->task_reverse_targets_,
+                    this->task_count_);
+  }
+
+  /// A copy of this image with a transitive closure index in both
+  /// directions, built by thread_count threads (0: number of cores).
+  /// The index takes recipe_count^2 / 4 bytes at most.
+  GraphImage with_closure(unsigned thread_count = 0) const;
+
+  bool has_closure() const noexcept
+  { return !this->forward_closure_.empty(); }
+
+  /// The transitive dependencies of every recipe. Empty unless
+  /// has_closure().
+  const ClosureIndex& forward_closure() const noexcept
+  { return this->forward_closure_; }
+
+  /// The transitive reverse dependencies of every recipe. Empty unless
+  /// has_closure().
+  const ClosureIndex& reverse_closure() const noexcept
+  { return this->reverse_closure_; }
+
+  /// The file this image was built from.
+  const FileStamp& source() const noexcept
+  { return this->source_; }
+
+  /// The raw image, e.g. to store it on disk.
+  std::string_view bytes() const noexcept
+  { return this->buffer_.view(); }
+
+private:
+  struct Slot
+  {
+    std::uint32_t fingerprint;
+    std::uint32_t id;
+  };
+
+  // Pointers into buffer_ stay valid when moving, because the address of its
+  // contents is stable.
+  FileBuffer buffer_;
+  FileStamp source_;
+  std::size_t recipe_count_;
+  std::size_t dependency_count_;
+  std::size_t slot_count_;
+  const std::uint64_t * name_offsets_;
+  const std::uint64_t * forward_offsets_;
+  const std::uint32_t * forward_targets_;
+  const std::uint64_t * reverse_offsets_;
+  const std::uint32_t * reverse_targets_;
+  const Slot * index_;
+  const char * names_;
+  Condensation condensation_;
+  std::size_t task_name_count_;
+  std::size_t task_count_;
+  const std::uint64_t * task_name_offsets_;
+  const char * task_names_;
+  const TaskDependencies::Node * tasks_;
+  const std::uint64_t * recipe_task_offsets_;
+  const std::uint64_t * task_forward_offsets_;
+  const std::uint32_t * task_forward_targets_;
+  const std::uint64_t * task_reverse_offsets_;
+  const std::uint32_t * task_reverse_targets_;
+  ClosureIndex forward_closure_;
+  ClosureIndex reverse_closure_;
+};
+
+
+} // namespace bbrd
+
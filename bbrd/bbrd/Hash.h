@@ -0,0 +1,34 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+
+namespace bbrd {
+
+
+constexpr std::uint64_t hash_bytes_seed = UINT64_C(0xcbf29ce484222325);
+
+
+/// FNV-1a. Unlike std::hash, the result is the same on every platform and
+/// build, therefore it can be stored on disk. Hashes can be chained by
+/// passing the previous result as seed.
+inline std::uint64_t HashBytes(std::string_view bytes,
+                               std::uint64_t seed = hash_bytes_seed) noexcept
+{
+  auto hash = seed;
+  for(auto c : bytes)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= UINT64_C(0x100000001b3);
+  }
+
+  return hash;
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,414 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/MergedGraph.h"
+#include "bbrd/Hash.h"
+
+#include <algorithm>
+#include <deque>
+#include <future>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+
+namespace {
+
+
+constexpr bbrd::MergedGraph::SetId no_set =
+  std::numeric_limits<bbrd::MergedGraph::SetId>::max();
+
+constexpr std::size_t word_bits = 64;
+
+
+bool Intersects(const std::uint64_t * a,
+                const std::uint64_t * b,
+                std::size_t word_count) noexcept
+{
+  for(std::size_t i = 0; i < word_count; ++i)
+    if( a[i] & b[i] )
+      return true;
+
+  return false;
+}
+
+
+/// Sort the dependencies by key into offsets, targets and sets, see CsrGraph.
+/// Dependencies with the same key keep their order.
+template<typename Key, typename Value>
+void CountingSort(const bbrd::DependencySet::DependencyVector& dependencies,
+                  const std::vector<bbrd::MergedGraph::SetId>& sets,
+                  std::size_t recipe_count,
+                  Key key,
+                  Value value,
+                  std::vector<std::uint64_t>& offsets,
+                  std::vector<bbrd::MergedGraph::Id>& targets,
+                  std::vector<bbrd::MergedGraph::SetId>& target_sets)
+{
+  offsets.assign(recipe_count + 1, 0);
+  for(const auto& dependency : dependencies)
+    offsets[key(dependency) + 1]++;
+
+  for(std::size_t i = 0; i < recipe_count; ++i)
+    offsets[i + 1] += offsets[i];
+
+  targets.resize(dependencies.size());
+  target_sets.resize(dependencies.size());
+  std::vector<std::uint64_t> next(offsets.begin(), offsets.end() - 1);
+  for(std::size_t i = 0; i < dependencies.size(); ++i)
+  {
+    auto position = next[key(dependencies[i])]++;
+    targets[position] =
+      static_cast<bbrd::MergedGraph::Id>(value(dependencies[i]));
+    target_sets[position] = sets[i];
+  }
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+MergedGraph MergedGraph::Merge(std::vector<std::string> source_names,
+                               const ReadSource& read,
+                               unsigned thread_count)
+{
+  if( thread_count == 0 )
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+  MergedGraph graph(std::move(source_names));
+  auto source_count = graph.source_count();
+
+  // Only the sources that are being read or merged are kept in memory
+  std::deque<std::future<GraphImage>> pending;
+  std::size_t next = 0;
+  auto start_reading = [&]{
+    for(; pending.size() < thread_count && next < source_count; ++next)
+      pending.push_back(std::async(std::launch::async, [&read, next]{
+        return read(next);
+      }));
+  };
+
+  start_reading();
+  for(std::size_t source = 0; source < source_count; ++source)
+  {
+    auto image = pending.front().get();
+    pending.pop_front();
+    start_reading();
+    graph.add(source, image);
+  }
+
+  graph.build();
+  return graph;
+}
+
+MergedGraph::MergedGraph(std::vector<std::string> source_names)
+: source_names_(std::move(source_names))
+, words_per_set_(std::max<std::size_t>(
+      ( this->source_names_.size() + word_bits - 1 ) / word_bits, 1))
+, sets_()
+, set_index_()
+, with_source_cache_()
+// Names are copied, the images are released after merging
+, recipes_(true)
+, recipe_sets_()
+, dependencies_()
+, dependency_sets_()
+, forward_offsets_()
+, forward_targets_()
+, forward_sets_()
+, reverse_offsets_()
+, reverse_targets_()
+, reverse_sets_()
+{
+  // The empty set has id 0
+  SourceSet empty(this->words_per_set_, 0);
+  this->intern_set(empty.data());
+}
+
+std::optional<std::size_t> MergedGraph::find_source(
+    std::string_view name) const noexcept
+{
+  auto it = std::find(this->source_names_.begin(),
+                      this->source_names_.end(),
+                      name);
+  if( it == this->source_names_.end() )
+    return std::nullopt;
+
+  return static_cast<std::size_t>(it - this->source_names_.begin());
+}
+
+std::optional<MergedGraph::Id> MergedGraph::find(
+    std::string_view recipe) const noexcept
+{
+  if( auto id = this->recipes_.find(recipe) )
+    return static_cast<Id>(*id);
+
+  return std::nullopt;
+}
+
+MergedGraph::SourceSet MergedGraph::make_source_set(
+    const std::vector<std::size_t>& sources) const
+{
+  SourceSet set(this->words_per_set_, 0);
+  if( sources.empty() )
+  {
+    for(std::size_t source = 0; source < this->source_count(); ++source)
+      set[source / word_bits] |= std::uint64_t(1) << ( source % word_bits );
+    return set;
+  }
+
+  for(auto source : sources)
+  {
+    if( source >= this->source_count() )
+      throw std::out_of_range("no such source");
+    set[source / word_bits] |= std::uint64_t(1) << ( source % word_bits );
+  }
+
+  return set;
+}
+
+MergedGraph::SourceSet MergedGraph::recipe_sources(Id recipe) const
+{
+  auto words = this->set_words(this->recipe_sets_.at(recipe));
+  return SourceSet(words, words + this->words_per_set_);
+}
+
+std::vector<std::pair<MergedGraph::Id, MergedGraph::SourceSet>>
+MergedGraph::adjacent_recipes(Id recipe,
+                              bool reverse,
+                              const SourceSet& filter) const
+{
+  const auto& offsets = reverse ? this->reverse_offsets_
+                                : this->forward_offsets_;
+  const auto& targets = reverse ? this->reverse_targets_
+                                : this->forward_targets_;
+  const auto& sets = reverse ? this->reverse_sets_ : this->forward_sets_;
+
+  std::vector<std::pair<Id, SourceSet>> adjacent;
+  for(auto i = offsets.at(recipe); i < offsets.at(recipe + 1); ++i)
+  {
+    auto words = this->set_words(sets[i]);
+    if( !Intersects(words, filter.data(), this->words_per_set_) )
+      continue;
+
+    SourceSet sources(filter);
+    for(std::size_t w = 0; w < this->words_per_set_; ++w)
+      sources[w] &= words[w];
+    adjacent.push_back({targets[i], std::move(sources)});
+  }
+
+  return adjacent;
+}
+
+std::vector<std::pair<MergedGraph::Id, MergedGraph::SourceSet>>
+MergedGraph::transitive_recipes(Id recipe,
+                                bool reverse,
+                                const SourceSet& filter) const
+{
+  const auto& offsets = reverse ? this->reverse_offsets_
+                                : this->forward_offsets_;
+  const auto& targets = reverse ? this->reverse_targets_
+                                : this->forward_targets_;
+  const auto& sets = reverse ? this->reverse_sets_ : this->forward_sets_;
+  auto word_count = this->words_per_set_;
+
+  if( recipe >= this->recipe_count() )
+    throw std::out_of_range("no such recipe");
+
+  // The sources in which every recipe was reached. A recipe is searched
+  // again whenever it is reached in more sources, which happens at most
+  // once per source.
+  std::vector<std::uint64_t> reached(this->recipe_count() * word_count, 0);
+  std::vector<bool> queued(this->recipe_count(), false);
+  std::deque<Id> queue;
+  std::copy(filter.begin(), filter.end(), &reached[recipe * word_count]);
+  queue.push_back(recipe);
+  queued[recipe] = true;
+
+  while( !queue.empty() )
+  {
+    auto v = queue.front();
+    queue.pop_front();
+    queued[v] = false;
+
+    for(auto i = offsets[v]; i < offsets[v + 1]; ++i)
+    {
+      auto w = targets[i];
+      auto edge = this->set_words(sets[i]);
+      bool grown = false;
+      for(std::size_t k = 0; k < word_count; ++k)
+      {
+        auto add = reached[v * word_count + k] & edge[k]
+                 & ~reached[w * word_count + k];
+        if( add )
+        {
+          reached[w * word_count + k] |= add;
+          grown = true;
+        }
+      }
+
+      if( grown && !queued[w] )
+      {
+        queue.push_back(w);
+        queued[w] = true;
+      }
+    }
+  }
+
+  std::vector<std::pair<Id, SourceSet>> transitive;
+  for(Id v = 0; v < this->recipe_count(); ++v)
+  {
+    auto first = reached.begin() + static_cast<std::ptrdiff_t>(
+        v * word_count);
+    auto last = first + static_cast<std::ptrdiff_t>(word_count);
+    if( v != recipe && std::any_of(first, last, [](auto w){ return w; }) )
+      transitive.push_back({v, SourceSet(first, last)});
+  }
+
+  return transitive;
+}
+
+void MergedGraph::list(const SourceSet& filter, std::ostream& out) const
+{
+  for(Id v = 0; v < this->recipe_count(); ++v)
+  {
+    auto sources = this->recipe_sources(v);
+    for(std::size_t w = 0; w < this->words_per_set_; ++w)
+      sources[w] &= filter[w];
+    if( std::any_of(sources.begin(), sources.end(), [](auto w){ return w; }) )
+      this->print(v, sources, out);
+  }
+}
+
+void MergedGraph::list_recipe_depends(std::string_view recipe,
+                                      bool reverse,
+                                      bool transitive,
+                                      const SourceSet& filter,
+                                      std::ostream& out) const
+{
+  auto id = this->find(recipe);
+  if( !id )
+    throw std::runtime_error(std::string("recipe not found: ").append(recipe));
+
+  auto recipes = transitive
+    ? this->transitive_recipes(*id, reverse, filter)
+    : this->adjacent_recipes(*id, reverse, filter);
+  for(const auto& [v, sources] : recipes)
+    this->print(v, sources, out);
+}
+
+void MergedGraph::add(std::size_t source, const GraphImage& image)
+{
+  this->with_source_cache_.assign(this->source_set_count(), no_set);
+
+  auto forward = image.forward();
+  auto reverse = image.reverse();
+  std::vector<Id> merged_id(image.recipe_count());
+  for(Id v = 0; v < image.recipe_count(); ++v)
+  {
+    auto id = this->recipes_.get_or_create(image.recipe_name(v));
+    if( id == this->recipe_sets_.size() )
+      this->recipe_sets_.push_back(0);
+    merged_id[v] = static_cast<Id>(id);
+
+    // Recipes whose tasks only depend on each other have an id, but are not
+    // part of the recipe graph
+    if( out_degree(v, forward) || out_degree(v, reverse) )
+      this->recipe_sets_[id] = this->with_source(this->recipe_sets_[id],
+                                                 source);
+  }
+
+  for(Id v = 0; v < image.recipe_count(); ++v)
+    for(auto w = forward.targets_begin(v); w != forward.targets_end(v); ++w)
+    {
+      auto to = merged_id[v];
+      auto from = merged_id[*w];
+      std::size_t index = this->dependency_sets_.size();
+      if( this->dependencies_.add(to, from) )
+        this->dependency_sets_.push_back(0);
+      else
+        index = *this->dependencies_.find(to, from);
+
+      this->dependency_sets_[index] = this->with_source(
+          this->dependency_sets_[index], source);
+    }
+}
+
+void MergedGraph::build()
+{
+  const auto& dependencies = this->dependencies_.dependencies();
+  CountingSort(dependencies,
+               this->dependency_sets_,
+               this->recipe_count(),
+               [](const auto& dependency){ return dependency.first; },
+               [](const auto& dependency){ return dependency.second; },
+               this->forward_offsets_,
+               this->forward_targets_,
+               this->forward_sets_);
+  CountingSort(dependencies,
+               this->dependency_sets_,
+               this->recipe_count(),
+               [](const auto& dependency){ return dependency.second; },
+               [](const auto& dependency){ return dependency.first; },
+               this->reverse_offsets_,
+               this->reverse_targets_,
+               this->reverse_sets_);
+  this->with_source_cache_.clear();
+  this->with_source_cache_.shrink_to_fit();
+}
+
+MergedGraph::SetId MergedGraph::intern_set(const std::uint64_t * words)
+{
+  auto hash = HashBytes(std::string_view(
+      reinterpret_cast<const char *>(words),
+      this->words_per_set_ * sizeof(std::uint64_t)));
+
+  auto [first, last] = this->set_index_.equal_range(hash);
+  for(auto it = first; it != last; ++it)
+    if( std::equal(words,
+                   words + this->words_per_set_,
+                   this->set_words(it->second)) )
+      return it->second;
+
+  auto id = static_cast<SetId>(this->source_set_count());
+  this->sets_.insert(this->sets_.end(), words, words + this->words_per_set_);
+  this->set_index_.insert({hash, id});
+  return id;
+}
+
+MergedGraph::SetId MergedGraph::with_source(SetId set, std::size_t source)
+{
+  // Sets that were created while merging this source already contain it
+  if( set >= this->with_source_cache_.size() )
+    return set;
+
+  if( this->with_source_cache_[set] == no_set )
+  {
+    SourceSet words(this->set_words(set),
+                    this->set_words(set) + this->words_per_set_);
+    words[source / word_bits] |= std::uint64_t(1) << ( source % word_bits );
+    this->with_source_cache_[set] = this->intern_set(words.data());
+  }
+
+  return this->with_source_cache_[set];
+}
+
+void MergedGraph::print(Id recipe,
+                        const SourceSet& sources,
+                        std::ostream& out) const
+{
+  out << this->recipe_name(recipe);
+  for(std::size_t source = 0; source < this->source_count(); ++source)
+    if( sources[source / word_bits] & ( std::uint64_t(1)
+                                        << ( source % word_bits ) ) )
+      out << "\t" << this->source_names_[source];
+  out << "\n";
+}
+
+
+} // namespace bbrd
+
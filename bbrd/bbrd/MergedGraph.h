@@ -0,0 +1,160 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/DependencySet.h"
+#include "bbrd/GraphImage.h"
+#include "bbrd/RecipeInterner.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// The recipe graphs of several task-depends.dot files (sources), e.g. of
+/// different images or MACHINEs, merged into one graph. Recipes share their
+/// ids across sources.
+///
+/// Every dependency and every recipe refers to the set of sources it is part
+/// of. A set is a bitmask with one bit per source. Each distinct set is
+/// stored once and referred to by a 32 bit index, therefore dependencies that
+/// most sources share do not take more memory per source.
+class MergedGraph
+{
+public:
+  using Id = GraphImage::Id;
+  using SetId = std::uint32_t;
+  /// A set of sources, one bit per source.
+  using SourceSet = std::vector<std::uint64_t>;
+  /// Returns the graph of a source, which is identified by its index.
+  using ReadSource = std::function<GraphImage(std::size_t source)>;
+
+  /// Read the graphs of all sources and merge them. Up to thread_count
+  /// sources are read at the same time (0: number of cores), and merged in
+  /// order while the next ones are being read. Recipes are numbered in the
+  /// order they first appear in the sources.
+  static MergedGraph Merge(std::vector<std::string> source_names,
+                           const ReadSource& read,
+                           unsigned thread_count = 0);
+
+  MergedGraph(MergedGraph&&) = default;
+  MergedGraph(const MergedGraph&) = delete;
+  MergedGraph& operator=(MergedGraph&&) = default;
+  MergedGraph& operator=(const MergedGraph&) = delete;
+
+  std::size_t source_count() const noexcept
+  { return this->source_names_.size(); }
+
+  const std::string& source_name(std::size_t source) const
+  { return this->source_names_.at(source); }
+
+  std::optional<std::size_t> find_source(std::string_view name) const noexcept;
+
+  std::size_t recipe_count() const noexcept
+  { return this->recipes_.size(); }
+
+  std::size_t dependency_count() const noexcept
+  { return this->dependencies_.dependencies().size(); }
+
+  /// The number of distinct sets of sources.
+  std::size_t source_set_count() const noexcept
+  { return this->sets_.size() / this->words_per_set_; }
+
+  std::string_view recipe_name(Id recipe) const
+  { return this->recipes_.names().at(recipe); }
+
+  std::optional<Id> find(std::string_view recipe) const noexcept;
+
+  /// A set of the given sources, or of all sources if there are none.
+  SourceSet make_source_set(const std::vector<std::size_t>& sources) const;
+
+  /// The sources that contain recipe.
+  SourceSet recipe_sources(Id recipe) const;
+
+  /// The recipes that recipe directly depends on (or that directly depend on
+  /// recipe, if reverse is set) in any source of filter, each with the
+  /// sources of filter that contain the dependency.
+  std::vector<std::pair<Id, SourceSet>> adjacent_recipes(
+      Id recipe,
+      bool reverse,
+      const SourceSet& filter) const;
+
+  /// The same for transitive dependencies, ordered by id. A recipe is listed
+  /// with the sources of filter in which it can be reached from recipe.
+  /// Dependencies are only followed within the same source.
+  std::vector<std::pair<Id, SourceSet>> transitive_recipes(
+      Id recipe,
+      bool reverse,
+      const SourceSet& filter) const;
+
+  /// List all recipes of filter, one per line, each followed by the sources
+  /// that contain it: "recipe\tsource\tsource...".
+  void list(const SourceSet& filter, std::ostream& out) const;
+
+  /// List the direct or transitive dependencies of recipe in the same format.
+  /// Throws std::runtime_error if recipe is not part of any source.
+  void list_recipe_depends(std::string_view recipe,
+                           bool reverse,
+                           bool transitive,
+                           const SourceSet& filter,
+                           std::ostream& out) const;
+
+private:
+  explicit MergedGraph(std::vector<std::string> source_names);
+
+  /// Merge the graph of source.
+  void add(std::size_t source, const GraphImage& image);
+
+  /// Build both directions of the merged graph.
+  void build();
+
+  /// Returns the id of the set, which is created if it does not exist.
+  SetId intern_set(const std::uint64_t * words);
+
+  /// Returns the set with the sources of set and source.
+  SetId with_source(SetId set, std::size_t source);
+
+  const std::uint64_t * set_words(SetId set) const noexcept
+  { return this->sets_.data() + set * this->words_per_set_; }
+
+  void print(Id recipe, const SourceSet& sources, std::ostream& out) const;
+
+  std::vector<std::string> source_names_;
+  std::size_t words_per_set_;
+  /// The words of every distinct set, set after set
+  std::vector<std::uint64_t> sets_;
+  /// Sets by the hash of their words
+  std::unordered_multimap<std::uint64_t, SetId> set_index_;
+  /// Set with an additional source, by set. Only valid for the source that
+  /// is being merged.
+  std::vector<SetId> with_source_cache_;
+  RecipeInterner recipes_;
+  /// The sources of every recipe, by id
+  std::vector<SetId> recipe_sets_;
+  /// Distinct dependencies across all sources
+  DependencySet dependencies_;
+  /// The sources of every dependency, in the order of dependencies_
+  std::vector<SetId> dependency_sets_;
+  // Both directions in compressed sparse row format, see CsrGraph. Every
+  // edge has the set of its dependency.
+  std::vector<std::uint64_t> forward_offsets_;
+  std::vector<Id> forward_targets_;
+  std::vector<SetId> forward_sets_;
+  std::vector<std::uint64_t> reverse_offsets_;
+  std::vector<Id> reverse_targets_;
+  std::vector<SetId> reverse_sets_;
+};
+
+
+} // namespace bbrd
+
@@ -0,0 +1,218 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/PathSearch.h"
+#include "bbrd/CsrGraph.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+
+using Vertex = bbrd::CsrGraph::Vertex;
+
+
+constexpr std::uint32_t unreached = std::numeric_limits<std::uint32_t>::max();
+
+
+/// One direction of a bidirectional breadth-first search.
+struct Search
+{
+  Search(const bbrd::CsrGraph& searched_graph, Vertex start)
+  : graph(searched_graph)
+  , distance(searched_graph.vertex_count(), unreached)
+  , parent(searched_graph.vertex_count(), unreached)
+  , frontier(1, start)
+  , depth(0)
+  {
+    this->distance[start] = 0;
+    this->parent[start] = start;
+  }
+
+  /// The sum of the out degrees of the frontier, i.e. the cost of the next
+  /// expansion.
+  std::size_t cost() const noexcept
+  {
+    std::size_t cost = 0;
+    for(auto v : this->frontier)
+      cost += static_cast<std::size_t>(
+          this->graph.targets_end(v) - this->graph.targets_begin(v));
+    return cost;
+  }
+
+  /// Visit the next layer. Returns the vertex with the smallest total
+  /// distance that was reached by both searches, or unreached.
+  Vertex expand(const Search& other)
+  {
+    Vertex meet = unreached;
+    std::uint64_t best = std::numeric_limits<std::uint64_t>::max();
+    std::vector<Vertex> next;
+    this->depth++;
+    for(auto v : this->frontier)
+      for(auto w = this->graph.targets_begin(v);
+          w != this->graph.targets_end(v);
+          ++w)
+      {
+        if( this->distance[*w] != unreached )
+          continue;
+
+        this->distance[*w] = this->depth;
+        this->parent[*w] = v;
+        next.push_back(*w);
+        if( other.distance[*w] != unreached &&
+            std::uint64_t(this->depth) + other.distance[*w] < best )
+        {
+          best = std::uint64_t(this->depth) + other.distance[*w];
+          meet = *w;
+        }
+      }
+
+    this->frontier = std::move(next);
+    return meet;
+  }
+
+  const bbrd::CsrGraph& graph;
+  std::vector<std::uint32_t> distance;
+  std::vector<Vertex> parent;
+  std::vector<Vertex> frontier;
+  std::uint32_t depth;
+};
+
+
+/// Run a bidirectional search. Returns the vertex where both searches met on
+/// a shortest path, or unreached.
+Vertex Meet(Search& forward, Search& backward)
+{
+  while( !forward.frontier.empty() && !backward.frontier.empty() )
+  {
+    // Once the searches meet, a shortest path goes through one of the
+    // vertices of the layer that was just visited
+    auto meet = forward.cost() <= backward.cost()
+      ? forward.expand(backward)
+      : backward.expand(forward);
+    if( meet != unreached )
+      return meet;
+  }
+
+  return unreached;
+}
+
+
+/// The distance of every vertex to `to` that is at most max_distance away.
+std::vector<std::uint32_t> DistancesTo(const bbrd::CsrGraph& reverse,
+                                       Vertex to,
+                                       std::uint32_t max_distance)
+{
+  std::vector<std::uint32_t> distance(reverse.vertex_count(), unreached);
+  std::vector<Vertex> queue(1, to);
+  distance[to] = 0;
+  for(std::size_t i = 0; i < queue.size(); ++i)
+  {
+    auto v = queue[i];
+    if( distance[v] == max_distance )
+      break;
+
+    for(auto w = reverse.targets_begin(v); w != reverse.targets_end(v); ++w)
+      if( distance[*w] == unreached )
+      {
+        distance[*w] = distance[v] + 1;
+        queue.push_back(*w);
+      }
+  }
+
+  return distance;
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+Path ShortestPath(const CsrGraph& forward,
+                  const CsrGraph& reverse,
+                  CsrGraph::Vertex from,
+                  CsrGraph::Vertex to)
+{
+  if( from == to )
+    return {};
+
+  Search from_search(forward, from);
+  Search to_search(reverse, to);
+  auto meet = Meet(from_search, to_search);
+  if( meet == unreached )
+    return {};
+
+  Path path;
+  for(auto v = meet; v != from; v = from_search.parent[v])
+    path.push_back(from_search.parent[v]);
+  std::reverse(path.begin(), path.end());
+  for(auto v = meet; v != to; v = to_search.parent[v])
+    path.push_back(v);
+  path.push_back(to);
+
+  return path;
+}
+
+std::vector<Path> ShortestPaths(const CsrGraph& forward,
+                                const CsrGraph& reverse,
+                                CsrGraph::Vertex from,
+                                CsrGraph::Vertex to,
+                                std::size_t limit)
+{
+  auto shortest = ShortestPath(forward, reverse, from, to);
+  if( shortest.empty() || limit == 0 )
+    return {};
+
+  if( limit == 1 )
+    return {shortest};
+
+  // Every step along a shortest path gets exactly one step closer to `to`.
+  // Following only such steps never leads into a dead end.
+  auto length = static_cast<std::uint32_t>(shortest.size() - 1);
+  auto distance = DistancesTo(reverse, to, length);
+
+  std::vector<Path> paths;
+  Path path(1, from);
+  // The position of the next out edge to try of every vertex on path
+  std::vector<const Vertex *> next(1, forward.targets_begin(from));
+  while( !next.empty() && paths.size() < limit )
+  {
+    auto v = path.back();
+    if( v == to )
+    {
+      paths.push_back(path);
+      path.pop_back();
+      next.pop_back();
+      continue;
+    }
+
+    auto& w = next.back();
+    while( w != forward.targets_end(v) && distance[*w] != distance[v] - 1 )
+      ++w;
+
+    if( w == forward.targets_end(v) )
+    {
+      path.pop_back();
+      next.pop_back();
+      continue;
+    }
+
+    auto target = *w++;
+    path.push_back(target);
+    next.push_back(forward.targets_begin(target));
+  }
+
+  return paths;
+}
+
+
+} // namespace bbrd
+
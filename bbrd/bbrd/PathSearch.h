@@ -0,0 +1,41 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/CsrGraph.h"
+
+#include <cstddef>
+#include <vector>
+
+
+namespace bbrd {
+
+
+using Path = std::vector<CsrGraph::Vertex>;
+
+
+/// A shortest path from `from` to `to` in forward, including both ends.
+/// reverse must contain the edges of forward, reversed. Returns an empty path
+/// if `to` is not reachable from `from`, or if both are the same.
+///
+/// Searches breadth-first from both ends at once, always expanding the
+/// smaller frontier, which visits far fewer vertices than a search from one
+/// end if the path is short.
+Path ShortestPath(const CsrGraph& forward,
+                  const CsrGraph& reverse,
+                  CsrGraph::Vertex from,
+                  CsrGraph::Vertex to);
+
+
+/// Up to limit different shortest paths from `from` to `to`, ordered by the
+/// order of the out edges of forward. See ShortestPath.
+std::vector<Path> ShortestPaths(const CsrGraph& forward,
+                                const CsrGraph& reverse,
+                                CsrGraph::Vertex from,
+                                CsrGraph::Vertex to,
+                                std::size_t limit);
+
+
+} // namespace bbrd
+
@@ -3,6 +3,10 @@
 
 #include "bbrd/ProgramOptions.h"
 
+#include <algorithm>
+#include <string>
+#include <vector>
+
 
 namespace bbrd {
 
@@ -15,7 +19,8 @@ ProgramOptions::ProgramOptions()
   this->desc_.add_options()
     ("task-depends-dot", po::value<std::string>()
       ->value_name("<file>"),
-      "The task-depends.dot file generated by `bitbake -g`")
+      "The task-depends.dot file generated by `bitbake -g`, optionally"
+      " compressed with gzip or zstd")
     ("recipe", po::value<std::string>()
       ->value_name("<recipe_name>"),
       "Select a recipe")
@@ -24,6 +29,81 @@ ProgramOptions::ProgramOptions()
     ("rdepends,r", "List reverse dependencies of recipe")
     ("transitive,t", "List all transitive dependencies"
                      " of the given recipe")
+    ("depends-on", po::value<std::string>()
+      ->value_name("<recipe_name>"),
+      "Print \"yes\" if recipe transitively depends on the given recipe,"
+      " \"no\" otherwise")
+    ("path", po::value<std::string>()
+      ->value_name("<recipe_name>"),
+      "Print a shortest chain of dependencies from recipe to the given"
+      " recipe. Fails if there is none")
+    ("all-paths", po::value<std::size_t>()
+      ->value_name("<k>"),
+      "With --path, print up to k shortest chains")
+    ("cycles", "List the recipes of every dependency cycle,"
+               " one cycle per line")
+    ("export-dot", "Write the recipes and the dependencies between them"
+                   " as DOT")
+    ("reduce", "With --export-dot, leave out dependencies that are implied"
+               " by other dependencies (transitive reduction)")
+    ("diff", po::value<std::string>()
+      ->value_name("<old.dot>"),
+      "List the recipes and dependencies that were added to or removed from"
+      " old.dot, e.g. \"+ curl -> openssl\". With --transitive, also list"
+      " changed transitive dependencies (\"->*\")")
+    ("merge,m", po::value<std::vector<std::string>>()
+      ->value_name("<file>")->composing(),
+      "Merge another task-depends.dot (e.g. of another image or MACHINE)"
+      " into the graph, can be repeated. Recipes are then listed with the"
+      " files that contain them, separated by tabs")
+    ("source", po::value<std::vector<std::string>>()
+      ->value_name("<file>")->composing(),
+      "With --merge, only follow the dependencies of the given files, can be"
+      " repeated")
+    ("schedule-profile", "Print how well the tasks can be built in parallel:"
+                         " the width of every level of the task graph and"
+                         " a critical path. Implies --tasks")
+    ("build-order", "With --schedule-profile, also list all tasks level by"
+                    " level")
+    ("buildstats", po::value<std::string>()
+      ->value_name("<dir>"),
+      "Print the critical path of the task graph, weighted by the duration"
+      " of the tasks in the buildstats directory, and the slack of every"
+      " recipe. Implies --tasks")
+    ("batch,b", po::value<std::string>()
+      ->value_name("<file>"),
+      "Answer the queries in file (\"-\" for stdin), one per line,"
+      " e.g. \"rdeps -t openssl\"")
+    ("serve", po::value<std::string>()
+      ->value_name("<socket>"),
+      "Keep the graph in memory and answer queries on a Unix domain socket."
+      " The graph is reloaded when task-depends.dot changes")
+    ("connect", po::value<std::string>()
+      ->value_name("<socket>"),
+      "Send the query to the server listening on socket"
+      " instead of reading task-depends.dot")
+    ("jobs,j", po::value<unsigned>()
+      ->value_name("<n>"),
+      "Number of threads used for parsing and batch queries"
+      " (default: depends on number of cores and file size)")
+    ("tasks", "Keep the dependencies between tasks and store them in the"
+              " cache. Recipes can then be replaced by \"recipe:task\","
+              " e.g. \"curl:do_compile\"")
+    ("closure", "Index the transitive closure of the graph and store it in"
+                " the cache, which speeds up --transitive and --depends-on")
+    ("no-cache", "Neither read nor write the cached graph")
+    ("stats", "Print the wall and CPU time of every phase (reading,"
+              " parsing, building the graph, the query), counters such as"
+              " the number of recipes and of lines without dependencies, and"
+              " the peak RSS to stderr")
+    ("stats-json", "Same as --stats, as a JSON object")
+    ("stats-trace", po::value<std::string>()
+      ->value_name("<file>"),
+      "Write the phases to file in the Chrome trace event format")
+    ("cache-dir", po::value<std::string>()
+      ->value_name("<dir>"),
+      "Directory of the cached graph (default: next to"
+      " task-depends.dot, or ~/.cache/bbrd if its directory is read-only)")
     ("help,h", "Print this help message")
     ("version,V", "Print version")
   ;
@@ -47,11 +127,158 @@ void ProgramOptions::store_and_validate_or_throw(int argc, const char * argv[])
   if( this->contains("help") || this->contains("version") )
     return;
 
-  if( !this->contains("task-depends-dot") )
+  if( this->contains("connect") )
+  {
+    if( this->contains("serve") ||
+        this->contains("batch") ||
+        this->contains("depends-on") ||
+        this->contains("path") ||
+        this->contains("cycles") ||
+        this->contains("schedule-profile") ||
+        this->contains("buildstats") ||
+        this->contains("diff") ||
+        this->contains("export-dot") ||
+        this->contains("merge") )
+      throw po::error("--connect cannot be combined with --serve, --batch,"
+                      " --depends-on, --path, --cycles, --schedule-profile,"
+                      " --buildstats, --diff, --export-dot or --merge");
+
+    // The server already knows task-depends.dot, the only positional
+    // argument is the recipe
+    if( this->contains("recipe") )
+      throw po::error("provide a recipe, but no task-depends.dot"
+                      " with --connect");
+
+    if( this->contains("task-depends-dot") )
+    {
+      auto recipe = this->vm_["task-depends-dot"];
+      this->vm_.erase("task-depends-dot");
+      this->vm_.insert({"recipe", recipe});
+    }
+  }
+  else if( !this->contains("task-depends-dot") )
+  {
     throw po::error("missing task-depends.dot");
+  }
 
   if( this->contains("depends") && this->contains("rdepends") )
     throw po::error("provide either --depends or --rdepends, not both");
+
+  if( this->contains("serve") &&
+      ( this->contains("recipe") || this->contains("batch") ) )
+    throw po::error("--serve cannot be combined with a recipe or --batch");
+
+  if( this->contains("serve") && this->get("task-depends-dot") == "-" )
+    throw po::error("--serve requires a file, not stdin");
+
+  if( this->contains("batch") && this->contains("recipe") )
+    throw po::error("provide either --batch or a recipe, not both");
+
+  if( this->contains("batch") &&
+      this->get("batch") == "-" &&
+      this->get("task-depends-dot") == "-" )
+    throw po::error("cannot read both task-depends.dot and --batch from stdin");
+
+  if( this->contains("cycles") &&
+      ( this->contains("recipe") ||
+        this->contains("batch") ||
+        this->contains("serve") ) )
+    throw po::error("--cycles cannot be combined with a recipe, --batch"
+                    " or --serve");
+
+  if( this->contains("schedule-profile") &&
+      ( this->contains("recipe") ||
+        this->contains("batch") ||
+        this->contains("serve") ||
+        this->contains("cycles") ) )
+    throw po::error("--schedule-profile cannot be combined with a recipe,"
+                    " --batch, --serve or --cycles");
+
+  if( this->contains("buildstats") &&
+      ( this->contains("recipe") ||
+        this->contains("batch") ||
+        this->contains("serve") ||
+        this->contains("cycles") ||
+        this->contains("schedule-profile") ) )
+    throw po::error("--buildstats cannot be combined with a recipe, --batch,"
+                    " --serve, --cycles or --schedule-profile");
+
+  if( this->contains("diff") &&
+      ( this->contains("recipe") ||
+        this->contains("batch") ||
+        this->contains("serve") ||
+        this->contains("cycles") ||
+        this->contains("schedule-profile") ||
+        this->contains("buildstats") ) )
+    throw po::error("--diff cannot be combined with a recipe, --batch,"
+                    " --serve, --cycles, --schedule-profile or --buildstats");
+
+  if( this->contains("diff") &&
+      this->get("diff") == "-" &&
+      this->get("task-depends-dot") == "-" )
+    throw po::error("cannot read both files of --diff from stdin");
+
+  if( this->contains("export-dot") &&
+      ( this->contains("recipe") ||
+        this->contains("batch") ||
+        this->contains("serve") ||
+        this->contains("cycles") ||
+        this->contains("schedule-profile") ||
+        this->contains("buildstats") ||
+        this->contains("diff") ) )
+    throw po::error("--export-dot cannot be combined with a recipe, --batch,"
+                    " --serve, --cycles, --schedule-profile, --buildstats"
+                    " or --diff");
+
+  if( this->contains("merge") &&
+      ( this->contains("batch") ||
+        this->contains("serve") ||
+        this->contains("cycles") ||
+        this->contains("schedule-profile") ||
+        this->contains("buildstats") ||
+        this->contains("diff") ||
+        this->contains("export-dot") ||
+        this->contains("depends-on") ||
+        this->contains("path") ||
+        this->contains("tasks") ) )
+    throw po::error("--merge cannot be combined with --batch, --serve,"
+                    " --cycles, --schedule-profile, --buildstats, --diff,"
+                    " --export-dot, --depends-on, --path or --tasks");
+
+  if( this->contains("merge") )
+  {
+    auto files = this->get<std::vector<std::string>>("merge");
+    files.push_back(this->get("task-depends-dot"));
+    if( std::count(files.begin(), files.end(), "-") > 1 )
+      throw po::error("cannot read more than one file of --merge from stdin");
+  }
+
+  if( this->contains("source") && !this->contains("merge") )
+    throw po::error("--source requires --merge");
+
+  if( this->contains("reduce") && !this->contains("export-dot") )
+    throw po::error("--reduce requires --export-dot");
+
+  if( this->contains("build-order") && !this->contains("schedule-profile") )
+    throw po::error("--build-order requires --schedule-profile");
+
+  if( this->contains("depends-on") && !this->contains("recipe") )
+    throw po::error("--depends-on requires a recipe");
+
+  if( this->contains("path") && !this->contains("recipe") )
+    throw po::error("--path requires a recipe");
+
+  if( this->contains("depends-on") && this->contains("path") )
+    throw po::error("provide either --depends-on or --path, not both");
+
+  if( this->contains("all-paths") && !this->contains("path") )
+    throw po::error("--all-paths requires --path");
+
+  if( this->contains("no-cache") && this->contains("cache-dir") )
+    throw po::error("provide either --no-cache or --cache-dir, not both");
+
+  if( this->contains("stats") && this->contains("stats-json") )
+    throw po::error("provide either --stats or --stats-json, not both");
 }
 
 bool ProgramOptions::contains(const char * key) const
@@ -59,11 +286,6 @@ bool ProgramOptions::contains(const char * key) const
   return this->vm_.count(key) && !this->vm_[key].defaulted();
 }
 
-std::string ProgramOptions::get(const char * key) const
-{
-  return this->vm_[key].as<std::string>();
-}
-
 void ProgramOptions::print(const char * program_name, std::ostream& out) const
 {
   out << program_name << " - List dependencies between BitBake recipes.\n\n"
@@ -73,7 +295,36 @@ void ProgramOptions::print(const char * program_name, std::ostream& out) const
          "      List all recipes\n\n  "
       << program_name
       << " [options] <task-depends.dot> <recipe_name>\n"
-         "      List dependencies of a specific recipe\n\n"
+         "      List dependencies of a specific recipe\n\n  "
+      << program_name
+      << " [options] --cycles <task-depends.dot>\n"
+         "      List dependency cycles\n\n  "
+      << program_name
+      << " [options] --export-dot [--reduce] <task-depends.dot>\n"
+         "      Write the recipe graph as DOT\n\n  "
+      << program_name
+      << " [options] --diff <old.dot> <task-depends.dot>\n"
+         "      List changed recipes and dependencies\n\n  "
+      << program_name
+      << " [options] <task-depends.dot> --merge <other.dot> [<recipe_name>]\n"
+         "      List recipes of several files with the files that contain them"
+         "\n\n  "
+      << program_name
+      << " [options] --schedule-profile <task-depends.dot>\n"
+         "      Show how well the tasks can be built in parallel\n\n  "
+      << program_name
+      << " [options] --buildstats <dir> <task-depends.dot>\n"
+         "      Show which recipes take the most time on the critical path"
+         "\n\n  "
+      << program_name
+      << " [options] --batch <queries> <task-depends.dot>\n"
+         "      Answer many queries, one per line of <queries>\n\n  "
+      << program_name
+      << " [options] --serve <socket> <task-depends.dot>\n"
+         "      Answer queries on a Unix domain socket\n\n  "
+      << program_name
+      << " [options] --connect <socket> [<recipe_name>]\n"
+         "      Query a running server\n\n"
       << this->desc_;
 }
 
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 #include <boost/program_options.hpp>
 
 
@@ -17,7 +18,11 @@ public:
 
   void store_and_validate_or_throw(int argc, const char * argv[]);
   bool contains(const char * key) const;
-  std::string get(const char * key) const;
+
+  template<typename T = std::string>
+  T get(const char * key) const
+  { return this->vm_[key].as<T>(); }
+
   void print(const char * program_name, std::ostream& out = std::cout) const;
 
 private:
@@ -0,0 +1,188 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/ReadGraph.h"
+#include "bbrd/Decompression.h"
+#include "bbrd/File.h"
+#include "bbrd/GraphCache.h"
+#include "bbrd/Scan.h"
+
+#include <filesystem>
+#include <optional>
+#include <system_error>
+#include <utility>
+
+
+namespace {
+
+
+/// Record the size of the input and what the parser made of it.
+void AddParseCounters(bbrd::Stats& stats,
+                      const std::string& input_file,
+                      const bbrd::Dependencies& dependencies)
+{
+  auto count = [&stats, &input_file](const char * name, double value){
+    stats.add_counter(name, input_file, value);
+  };
+
+  count("bytes read", static_cast<double>(dependencies.input_size()));
+  count("parsed dependencies",
+        static_cast<double>(dependencies.parsed_dependency_count()));
+  count("task deps across recipes",
+        static_cast<double>(dependencies.task_dependency_count()));
+  count("unique dependencies",
+        static_cast<double>(dependencies.end() - dependencies.begin()));
+  count("recipes", static_cast<double>(dependencies.distinct_recipe_count()));
+  count("recipe table load", dependencies.recipe_table_load());
+
+  // Lines are only counted for --stats. The input is not kept if it was read
+  // in chunks.
+  auto input = dependencies.input();
+  if( !input.empty() )
+    count("lines without dependencies",
+          static_cast<double>(bbrd::CountLinesWithoutArrow(input)));
+}
+
+
+/// Build the graph of dependencies, with a closure index if closure is set.
+bbrd::GraphImage BuildGraphImage(bbrd::Dependencies dependencies,
+                                 const bbrd::FileStamp& stamp,
+                                 bool closure,
+                                 unsigned thread_count,
+                                 const std::string& input_file,
+                                 bbrd::Stats * stats)
+{
+  auto image = [&]{
+    bbrd::Stats::Timer timer(stats, "build graph", input_file);
+    return bbrd::GraphImage::Build(dependencies, stamp);
+  }();
+
+  if( closure )
+  {
+    bbrd::Stats::Timer timer(stats, "closure", input_file);
+    image = image.with_closure(thread_count);
+  }
+
+  return image;
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+Dependencies ReadDependencies(const std::string& input_file,
+                              unsigned thread_count,
+                              bool with_tasks,
+                              Stats * stats)
+{
+  auto dependencies = [&]{
+    if( IsRegularFile(input_file) )
+    {
+      auto buffer = [&]{
+        Stats::Timer timer(stats, "read", input_file);
+        return ReadFileOrThrow(input_file);
+      }();
+      // Compressed files are decompressed while they are being parsed
+      if( DetectCompression(buffer.view()) == Compression::none )
+      {
+        Stats::Timer timer(stats, "parse", input_file);
+        return Dependencies(std::move(buffer), thread_count, with_tasks);
+      }
+    }
+
+    Stats::Timer timer(stats, "read and parse", input_file);
+    ChunkedReader reader(
+        input_file, ChunkedReader::default_chunk_size, thread_count);
+    return Dependencies(reader, with_tasks);
+  }();
+
+  if( stats )
+    AddParseCounters(*stats, input_file, dependencies);
+
+  return dependencies;
+}
+
+GraphImage ReadGraphImage(const std::string& input_file,
+                          const ReadGraphOptions& options,
+                          Stats * stats,
+                          const WarningHandler& warn)
+{
+  auto thread_count = options.thread_count;
+  if( !options.cache || !IsRegularFile(input_file) )
+    return BuildGraphImage(
+        ReadDependencies(input_file, thread_count, options.tasks, stats),
+        FileStamp(),
+        options.closure,
+        thread_count,
+        input_file,
+        stats);
+
+  // Stamp the file before reading it. If it changes in the meantime, the
+  // cache is considered stale on the next run.
+  auto stamp = ReadFileStampOrThrow(input_file);
+  auto cache_dir = options.cache_dir.empty()
+    ? DefaultGraphCacheDir(input_file)
+    : options.cache_dir;
+  auto cache_path = GraphCachePath(input_file, stamp, cache_dir);
+
+  auto image = [&]{
+    Stats::Timer timer(stats, "load cache", input_file);
+    return LoadGraphCache(cache_path, stamp);
+  }();
+  if( image && options.tasks && !image->has_tasks() )
+    image.reset();
+  if( image && stats )
+  {
+    stats->add_counter("cache bytes", input_file,
+                       static_cast<double>(image->bytes().size()));
+    stats->add_counter("recipes", input_file,
+                       static_cast<double>(image->recipe_count()));
+    stats->add_counter("unique dependencies", input_file,
+                       static_cast<double>(image->dependency_count()));
+  }
+  if( image && ( !options.closure || image->has_closure() ) )
+    return std::move(*image);
+
+  if( !image )
+    image = BuildGraphImage(
+        ReadDependencies(input_file, thread_count, options.tasks, stats),
+        stamp,
+        options.closure,
+        thread_count,
+        input_file,
+        stats);
+  else if( options.closure )
+  {
+    Stats::Timer timer(stats, "closure", input_file);
+    image = image->with_closure(thread_count);
+  }
+
+  try
+  {
+    Stats::Timer timer(stats, "write cache", input_file);
+    if( options.cache_dir.empty() && !cache_dir.empty() )
+    {
+      // If this fails, so does writing the cache
+      std::error_code error;
+      std::filesystem::create_directories(cache_dir, error);
+    }
+    WriteGraphCache(cache_path, *image);
+  }
+  catch( const FileError& e )
+  {
+    // Not being able to cache the graph does not affect the result. Only a
+    // directory that was asked for is worth a warning, otherwise it would
+    // be repeated on every query.
+    if( warn && !options.cache_dir.empty() )
+      warn(e.what());
+  }
+
+  return std::move(*image);
+}
+
+
+} // namespace bbrd
+
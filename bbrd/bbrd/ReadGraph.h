@@ -0,0 +1,61 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/Dependencies.h"
+#include "bbrd/GraphImage.h"
+#include "bbrd/Stats.h"
+
+#include <functional>
+#include <string>
+
+
+namespace bbrd {
+
+
+/// How ReadGraphImage reads a task-depends.dot.
+struct ReadGraphOptions
+{
+  /// Threads for parsing and the closure index. If 0, the number depends on
+  /// the number of cores and the size of the file.
+  unsigned thread_count = 0;
+  /// Add a transitive closure index, see GraphImage::with_closure
+  bool closure = false;
+  /// Keep the dependencies between tasks
+  bool tasks = false;
+  /// Read and write the cached graph
+  bool cache = true;
+  /// Directory of the cached graph, if empty see DefaultGraphCacheDir. A
+  /// cache that cannot be written is only reported if cache_dir is set.
+  std::string cache_dir = {};
+};
+
+
+/// Called with problems that do not affect the result, e.g. if the cache
+/// cannot be written.
+using WarningHandler = std::function<void(const std::string& message)>;
+
+
+/// Parse input_file ("-" for stdin). Regular files are memory mapped.
+/// Everything else and compressed files are parsed in chunks while they are
+/// being read. The phases and what the parser made of the input are recorded
+/// in stats, if any. Throws FileError if the file cannot be read.
+Dependencies ReadDependencies(const std::string& input_file,
+                              unsigned thread_count,
+                              bool with_tasks,
+                              Stats * stats = nullptr);
+
+
+/// Use the cached graph of input_file if it is a regular file and the cache
+/// is still valid. Otherwise parse the file and update the cache. A cached
+/// graph without the closure index or the tasks that options ask for is
+/// completed or rebuilt. The phases are recorded in stats, if any.
+GraphImage ReadGraphImage(const std::string& input_file,
+                          const ReadGraphOptions& options,
+                          Stats * stats = nullptr,
+                          const WarningHandler& warn = WarningHandler());
+
+
+} // namespace bbrd
+
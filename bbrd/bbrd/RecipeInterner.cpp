@@ -0,0 +1,132 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/RecipeInterner.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+
+namespace {
+
+
+/// Initial number of slots, must be a power of two.
+constexpr std::size_t initial_slot_count = 1 << 10;
+
+
+std::uint64_t HashName(std::string_view name) noexcept
+{
+  return static_cast<std::uint64_t>(std::hash<std::string_view>()(name));
+}
+
+
+std::uint32_t Fingerprint(std::uint64_t hash) noexcept
+{
+  return static_cast<std::uint32_t>(hash >> 32);
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+RecipeInterner::RecipeInterner(bool copy_names)
+: slots_(initial_slot_count, Slot{0, empty_id})
+, names_()
+, last_id_()
+, copy_names_(copy_names)
+, owned_names_()
+{
+}
+
+void RecipeInterner::reserve(std::size_t count)
+{
+  // Keep the load factor at or below 1/2
+  auto slot_count = this->slots_.size();
+  while( slot_count < count * 2 )
+    slot_count *= 2;
+
+  if( slot_count != this->slots_.size() )
+    this->rehash(slot_count);
+
+  this->names_.reserve(count);
+}
+
+RecipeInterner::Id RecipeInterner::get_or_create(std::string_view name)
+{
+  auto hash = HashName(name);
+  auto slot = this->slot_of(name, hash);
+  if( this->slots_[slot].id != empty_id )
+    return this->slots_[slot].id;
+
+  if( this->names_.size() >= empty_id )
+    throw std::out_of_range("recipe id does not fit in 32 bits");
+
+  if( this->copy_names_ )
+    name = this->owned_names_.emplace_back(name);
+
+  auto id = static_cast<Id>(this->names_.size());
+  this->slots_[slot] = Slot{Fingerprint(hash), id};
+  this->names_.push_back(name);
+
+  if( this->names_.size() * 2 > this->slots_.size() )
+    this->rehash(this->slots_.size() * 2);
+
+  return id;
+}
+
+std::optional<RecipeInterner::Id> RecipeInterner::find(
+    std::string_view name) const noexcept
+{
+  auto slot = this->slot_of(name, HashName(name));
+  if( this->slots_[slot].id == empty_id )
+    return {};
+
+  return this->slots_[slot].id;
+}
+
+std::size_t RecipeInterner::slot_of(std::string_view name,
+                                    std::uint64_t hash) const noexcept
+{
+  // Linear probing. The hash table is never full.
+  auto fingerprint = Fingerprint(hash);
+  auto mask = this->slots_.size() - 1;
+  auto slot = static_cast<std::size_t>(hash) & mask;
+  for(;;)
+  {
+    const auto& s = this->slots_[slot];
+    if( s.id == empty_id )
+      return slot;
+
+    if( s.fingerprint == fingerprint && this->names_[s.id] == name )
+      return slot;
+
+    slot = (slot + 1) & mask;
+  }
+}
+
+void RecipeInterner::rehash(std::size_t slot_count)
+{
+  this->slots_.assign(slot_count, Slot{0, empty_id});
+  auto mask = slot_count - 1;
+  for(Id id = 0; id < this->names_.size(); ++id)
+  {
+    auto hash = HashName(this->names_[id]);
+    auto slot = static_cast<std::size_t>(hash) & mask;
+    while( this->slots_[slot].id != empty_id )
+      slot = (slot + 1) & mask;
+
+    this->slots_[slot] = Slot{Fingerprint(hash), id};
+  }
+}
+
+
+} // namespace bbrd
+
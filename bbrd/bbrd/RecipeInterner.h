@@ -0,0 +1,101 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// Assigns consecutive ids to recipe names, in the order they are first seen.
+///
+/// Lookup is done with an open addressing hash table. Every slot stores the
+/// upper 32 bits of the name's hash next to its id, therefore names are only
+/// compared if these fingerprints match.
+class RecipeInterner
+{
+public:
+  /// Ids have 32 bits, which halves the size of every dependency compared
+  /// to std::size_t. Slots of the hash table hold 32 bit ids as well.
+  using Id = std::uint32_t;
+  using Names = std::vector<std::string_view>;
+
+  /// If copy_names is set, names are copied when they are first seen.
+  /// Otherwise names are stored as views and the caller has to keep the
+  /// underlying buffer alive.
+  explicit RecipeInterner(bool copy_names = false);
+
+  RecipeInterner(RecipeInterner&& other) = default;
+  RecipeInterner(const RecipeInterner& other) = delete;
+  RecipeInterner& operator=(RecipeInterner&& other) = default;
+  RecipeInterner& operator=(const RecipeInterner& other) = delete;
+
+  /// Make room for count names without growing the hash table.
+  void reserve(std::size_t count);
+
+  /// Returns the id of name, which is created if name was not seen before.
+  /// Throws std::out_of_range if there are more names than fit in 32 bits.
+  Id get_or_create(std::string_view name);
+
+  /// Same as get_or_create, but first compares name with the name of the
+  /// previous call to get_or_create_cached. Meant for names that come in
+  /// runs, such as the source recipe of consecutive dependencies.
+  Id get_or_create_cached(std::string_view name)
+  {
+    if( this->last_id_ && name == this->names_[*this->last_id_] )
+      return *this->last_id_;
+
+    this->last_id_ = this->get_or_create(name);
+    return *this->last_id_;
+  }
+
+  std::optional<Id> find(std::string_view name) const noexcept;
+
+  /// Names in the order of their ids.
+  const Names& names() const noexcept
+  { return this->names_; }
+
+  std::size_t size() const noexcept
+  { return this->names_.size(); }
+
+  /// The ratio of names to slots of the hash table.
+  double load_factor() const noexcept
+  {
+    return this->slots_.empty()
+      ? 0.0
+      : static_cast<double>(this->names_.size())
+        / static_cast<double>(this->slots_.size());
+  }
+
+private:
+  struct Slot
+  {
+    std::uint32_t fingerprint;
+    Id id;
+  };
+
+  static constexpr std::uint32_t empty_id = ~std::uint32_t(0);
+
+  /// Returns the slot containing name, or the empty slot where it belongs.
+  std::size_t slot_of(std::string_view name, std::uint64_t hash) const noexcept;
+  void rehash(std::size_t slot_count);
+
+  std::vector<Slot> slots_;
+  Names names_;
+  std::optional<Id> last_id_;
+  bool copy_names_;
+  /// Elements of a deque are never relocated, views into them stay valid.
+  std::deque<std::string> owned_names_;
+};
+
+
+} // namespace bbrd
+
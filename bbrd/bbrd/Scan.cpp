@@ -0,0 +1,188 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/Scan.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+// Vectorized scanning relies on GCC/Clang builtins
+#if !defined(_MSC_VER) && (defined(__AVX2__) || defined(__SSE2__))
+#define BBRD_SCAN_SIMD
+#include <immintrin.h>
+#endif
+
+
+namespace {
+
+
+std::size_t FindArrowScalar(const char * begin,
+                            std::size_t pos,
+                            std::size_t size) noexcept
+{
+  while( pos + 1 < size )
+  {
+    auto dash = static_cast<const char *>(
+      std::memchr(begin + pos, '-', size - pos - 1));
+    if( !dash )
+      break;
+
+    pos = static_cast<std::size_t>(dash - begin);
+    if( begin[pos + 1] == '>' )
+      return pos;
+
+    ++pos;
+  }
+
+  return std::string_view::npos;
+}
+
+
+#ifdef BBRD_SCAN_SIMD
+/// Returns a bitmask of the positions i in [p, p + width) where p[i] is '-'
+/// and p[i + 1] is '>'.
+inline unsigned ArrowMask(const char * p) noexcept
+{
+#if defined(__AVX2__)
+  auto dash = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)),
+      _mm256_set1_epi8('-'));
+  auto gt = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + 1)),
+      _mm256_set1_epi8('>'));
+  return static_cast<unsigned>(
+      _mm256_movemask_epi8(_mm256_and_si256(dash, gt)));
+#else
+  auto dash = _mm_cmpeq_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)),
+      _mm_set1_epi8('-'));
+  auto gt = _mm_cmpeq_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + 1)),
+      _mm_set1_epi8('>'));
+  return static_cast<unsigned>(_mm_movemask_epi8(_mm_and_si128(dash, gt)));
+#endif
+}
+
+/// Returns a bitmask of the positions i in [p, p + width) where p[i] is
+/// first and p[i + offset] is last.
+inline unsigned PairMask(const char * p,
+                         char first,
+                         char last,
+                         std::size_t offset) noexcept
+{
+#if defined(__AVX2__)
+  auto first_eq = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)),
+      _mm256_set1_epi8(first));
+  auto last_eq = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + offset)),
+      _mm256_set1_epi8(last));
+  return static_cast<unsigned>(
+      _mm256_movemask_epi8(_mm256_and_si256(first_eq, last_eq)));
+#else
+  auto first_eq = _mm_cmpeq_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)),
+      _mm_set1_epi8(first));
+  auto last_eq = _mm_cmpeq_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p + offset)),
+      _mm_set1_epi8(last));
+  return static_cast<unsigned>(
+      _mm_movemask_epi8(_mm_and_si128(first_eq, last_eq)));
+#endif
+}
+#endif
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+std::size_t FindArrow(std::string_view buffer, std::size_t pos) noexcept
+{
+  const char * begin = buffer.data();
+  std::size_t size = buffer.size();
+
+#ifdef BBRD_SCAN_SIMD
+#if defined(__AVX2__)
+  constexpr std::size_t width = 32;
+#else
+  constexpr std::size_t width = 16;
+#endif
+  // Each step reads width + 1 bytes
+  while( pos + width < size )
+  {
+    auto mask = ArrowMask(begin + pos);
+    if( mask )
+      return pos + static_cast<std::size_t>(__builtin_ctz(mask));
+
+    pos += width;
+  }
+#endif
+
+  return FindArrowScalar(begin, pos, size);
+}
+
+std::size_t FindString(std::string_view buffer,
+                       std::string_view needle,
+                       std::size_t pos) noexcept
+{
+  if( needle.size() < 2 )
+    return buffer.find(needle, pos);
+
+#ifdef BBRD_SCAN_SIMD
+#if defined(__AVX2__)
+  constexpr std::size_t width = 32;
+#else
+  constexpr std::size_t width = 16;
+#endif
+  const char * begin = buffer.data();
+  auto last = needle.size() - 1;
+  // Each step reads width bytes at pos and at pos + last
+  while( pos + last + width <= buffer.size() )
+  {
+    auto mask = PairMask(begin + pos, needle.front(), needle.back(), last);
+    while( mask )
+    {
+      auto candidate = pos + static_cast<std::size_t>(__builtin_ctz(mask));
+      if( std::memcmp(begin + candidate + 1, needle.data() + 1, last - 1) == 0 )
+        return candidate;
+      mask &= mask - 1;
+    }
+
+    pos += width;
+  }
+#endif
+
+  return buffer.find(needle, pos);
+}
+
+std::size_t CountLinesWithoutArrow(std::string_view buffer) noexcept
+{
+  if( buffer.empty() )
+    return 0;
+
+  auto lines = static_cast<std::size_t>(
+      std::count(buffer.begin(), buffer.end(), '\n'));
+  if( buffer.back() != '\n' )
+    lines++;
+
+  // Lines with several dependencies are counted once
+  std::size_t pos = 0;
+  while( ( pos = FindArrow(buffer, pos) ) != std::string_view::npos )
+  {
+    lines--;
+    pos = buffer.find('\n', pos);
+    if( pos == std::string_view::npos )
+      break;
+    pos++;
+  }
+
+  return lines;
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,32 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+
+namespace bbrd {
+
+
+/// Find the first occurrence of "->" in buffer at or after pos.
+/// Returns std::string_view::npos if there is none.
+/// Uses AVX2 or SSE2 if enabled at compile time, with a scalar fallback.
+std::size_t FindArrow(std::string_view buffer, std::size_t pos) noexcept;
+
+/// Find the first occurrence of needle in buffer at or after pos.
+/// Returns std::string_view::npos if there is none.
+/// Candidates are found by comparing the first and the last byte of needle
+/// with AVX2 or SSE2 if enabled at compile time, with a scalar fallback.
+std::size_t FindString(std::string_view buffer,
+                       std::string_view needle,
+                       std::size_t pos) noexcept;
+
+/// The number of lines of buffer without "->", i.e. without dependencies. A
+/// last line without a newline counts as well.
+std::size_t CountLinesWithoutArrow(std::string_view buffer) noexcept;
+
+
+} // namespace bbrd
+
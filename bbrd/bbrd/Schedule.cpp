@@ -0,0 +1,196 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/Schedule.h"
+#include "bbrd/CsrGraph.h"
+#include "bbrd/Workers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+
+using Vertex = bbrd::CsrGraph::Vertex;
+
+
+/// Levels with fewer vertices are not worth the overhead of threads.
+constexpr std::size_t min_vertices_per_thread = 2048;
+
+
+/// Remove the vertices of frontier[begin] to frontier[end] from the graph.
+/// Append every dependent vertex whose last dependency was removed to next.
+void Release(const bbrd::CsrGraph& reverse,
+             const std::vector<Vertex>& frontier,
+             std::size_t begin,
+             std::size_t end,
+             std::vector<std::atomic<std::uint32_t>>& pending,
+             std::vector<Vertex>& next)
+{
+  for(auto i = begin; i < end; ++i)
+    for(auto p = reverse.targets_begin(frontier[i]);
+        p != reverse.targets_end(frontier[i]);
+        ++p)
+      if( pending[*p].fetch_sub(1, std::memory_order_relaxed) == 1 )
+        next.push_back(*p);
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+Schedule Schedule::Compute(const CsrGraph& forward,
+                           const CsrGraph& reverse,
+                           unsigned thread_count)
+{
+  auto vertex_count = forward.vertex_count();
+  if( thread_count == 0 )
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+
+  // The number of dependencies of every vertex that are not yet levelized
+  std::vector<std::atomic<std::uint32_t>> pending(vertex_count);
+  std::vector<Vertex> frontier;
+  for(Vertex v = 0; v < vertex_count; ++v)
+  {
+    pending[v].store(static_cast<std::uint32_t>(out_degree(v, forward)),
+                     std::memory_order_relaxed);
+    if( pending[v].load(std::memory_order_relaxed) == 0 )
+      frontier.push_back(v);
+  }
+
+  Schedule schedule;
+  schedule.level_of.resize(vertex_count);
+  std::size_t visited = 0;
+  std::uint32_t level = 0;
+  for(; !frontier.empty(); ++level)
+  {
+    for(auto v : frontier)
+      schedule.level_of[v] = level;
+    visited += frontier.size();
+
+    auto threads = static_cast<unsigned>(std::min<std::size_t>(
+        thread_count, frontier.size() / min_vertices_per_thread + 1));
+    std::vector<std::vector<Vertex>> next(threads);
+    if( threads < 2 )
+    {
+      Release(reverse, frontier, 0, frontier.size(), pending, next[0]);
+    }
+    else
+    {
+      auto chunk = ( frontier.size() + threads - 1 ) / threads;
+      RunWorkers(threads, [&](std::size_t i){
+        Release(reverse,
+                frontier,
+                std::min(frontier.size(), i * chunk),
+                std::min(frontier.size(), ( i + 1 ) * chunk),
+                pending,
+                next[i]);
+      });
+    }
+
+    frontier.clear();
+    for(const auto& part : next)
+      frontier.insert(frontier.end(), part.begin(), part.end());
+  }
+
+  if( visited != vertex_count )
+    throw std::runtime_error("cannot schedule a graph with a cycle");
+
+  // Bucket the vertices by level. Iterating in id order keeps every level
+  // sorted, independent of the order in which threads found its vertices.
+  schedule.level_offsets.assign(level + 1, 0);
+  for(auto l : schedule.level_of)
+    schedule.level_offsets[l + 1]++;
+  for(std::size_t l = 0; l < level; ++l)
+    schedule.level_offsets[l + 1] += schedule.level_offsets[l];
+  schedule.order.resize(vertex_count);
+  std::vector<Offset> position(schedule.level_offsets.begin(),
+                               schedule.level_offsets.end() - 1);
+  for(Vertex v = 0; v < vertex_count; ++v)
+    schedule.order[position[schedule.level_of[v]]++] = v;
+
+  if( level == 0 )
+    return schedule;
+
+  // Walk down from the first vertex of the last level. Every vertex of level
+  // n + 1 has a dependency in level n.
+  auto v = schedule.order[schedule.level_offsets[level - 1]];
+  schedule.critical_path.push_back(v);
+  while( schedule.level_of[v] > 0 )
+  {
+    auto below = schedule.level_of[v] - 1;
+    v = *std::find_if(forward.targets_begin(v),
+                      forward.targets_end(v),
+                      [&schedule, below](Vertex d){
+                        return schedule.level_of[d] == below;
+                      });
+    schedule.critical_path.push_back(v);
+  }
+  std::reverse(schedule.critical_path.begin(), schedule.critical_path.end());
+
+  return schedule;
+}
+
+CriticalPath CriticalPath::Compute(const Schedule& schedule,
+                                   const CsrGraph& forward,
+                                   const CsrGraph& reverse,
+                                   const std::vector<double>& duration)
+{
+  auto vertex_count = forward.vertex_count();
+  CriticalPath critical;
+  critical.finish.resize(vertex_count);
+  critical.slack.resize(vertex_count);
+  if( vertex_count == 0 )
+    return critical;
+
+  // The dependency that finishes last, which is the previous vertex on the
+  // longest chain to every vertex
+  std::vector<Vertex> latest_dependency(vertex_count, CsrGraph::null_vertex());
+  auto last = schedule.order.front();
+  for(auto v : schedule.order)
+  {
+    double start = 0;
+    for(auto d = forward.targets_begin(v); d != forward.targets_end(v); ++d)
+      if( critical.finish[*d] > start ||
+          latest_dependency[v] == CsrGraph::null_vertex() )
+      {
+        start = critical.finish[*d];
+        latest_dependency[v] = *d;
+      }
+
+    critical.finish[v] = start + duration[v];
+    if( critical.finish[v] > critical.finish[last] )
+      last = v;
+  }
+  critical.length = critical.finish[last];
+
+  // The latest time every vertex may finish, bounded by the start of the
+  // vertices depending on it
+  std::vector<double> latest(vertex_count, critical.length);
+  for(auto it = schedule.order.rbegin(); it != schedule.order.rend(); ++it)
+  {
+    auto v = *it;
+    for(auto p = reverse.targets_begin(v); p != reverse.targets_end(v); ++p)
+      latest[v] = std::min(latest[v], latest[*p] - duration[*p]);
+    critical.slack[v] = std::max(0.0, latest[v] - critical.finish[v]);
+  }
+
+  for(auto v = last; v != CsrGraph::null_vertex(); v = latest_dependency[v])
+    critical.path.push_back(v);
+  std::reverse(critical.path.begin(), critical.path.end());
+
+  return critical;
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,87 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/CsrGraph.h"
+#include "bbrd/PathSearch.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// The levels of an acyclic graph, i.e. the order in which its vertices can
+/// be built with unlimited parallelism: Level 0 holds the vertices without
+/// dependencies, level n + 1 the vertices whose last dependency is in level n.
+/// The number of levels is the length of a critical path, the width of a
+/// level is the number of vertices that can be built at the same time.
+struct Schedule
+{
+  using Vertex = CsrGraph::Vertex;
+  using Offset = CsrGraph::Offset;
+
+  /// Levelize forward, which holds the edges from vertices to their
+  /// dependencies. reverse must contain the edges of forward, reversed.
+  ///
+  /// Uses Kahn's algorithm, which is linear in the number of vertices and
+  /// edges. Large levels are processed by thread_count threads. If
+  /// thread_count is 0, it is the number of cores. Throws std::runtime_error
+  /// if the graph has a cycle.
+  static Schedule Compute(const CsrGraph& forward,
+                          const CsrGraph& reverse,
+                          unsigned thread_count = 0);
+
+  std::size_t level_count() const noexcept
+  { return this->level_offsets.size() - 1; }
+
+  std::size_t level_width(std::size_t level) const noexcept
+  {
+    return static_cast<std::size_t>(
+        this->level_offsets[level + 1] - this->level_offsets[level]);
+  }
+
+  /// The level of every vertex.
+  std::vector<std::uint32_t> level_of = {};
+  /// The vertices of level l are stored in
+  /// order[level_offsets[l]] to order[level_offsets[l + 1]], in ascending
+  /// order.
+  std::vector<Offset> level_offsets = {0};
+  std::vector<Vertex> order = {};
+  /// A longest chain of dependencies, with one vertex per level, starting
+  /// at level 0.
+  Path critical_path = {};
+};
+
+
+/// The longest chain of dependencies of an acyclic graph, weighted by the
+/// duration of its vertices, i.e. the shortest possible time to build all
+/// vertices with unlimited parallelism.
+struct CriticalPath
+{
+  /// duration holds the duration of every vertex of forward. schedule must
+  /// be the Schedule of forward. Computes the earliest finish times in a
+  /// single pass over the vertices in the order of schedule, and the slack
+  /// in a second pass in reverse order.
+  static CriticalPath Compute(const Schedule& schedule,
+                              const CsrGraph& forward,
+                              const CsrGraph& reverse,
+                              const std::vector<double>& duration);
+
+  /// The time to build all vertices, i.e. the duration of path.
+  double length = 0;
+  /// The earliest time every vertex can be finished.
+  std::vector<double> finish = {};
+  /// How much every vertex can be delayed without delaying the whole
+  /// build. 0 for the vertices on path.
+  std::vector<double> slack = {};
+  /// The vertices of a longest chain, starting with the first one to build.
+  Path path = {};
+};
+
+
+} // namespace bbrd
+
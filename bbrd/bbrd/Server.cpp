@@ -0,0 +1,596 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/Server.h"
+#include "bbrd/BatchQuery.h"
+#include "bbrd/DependencyGraph.h"
+#include "bbrd/ErrorOutput.h"
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+// Unix domain sockets are not available on Windows
+#ifndef _WIN32
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#endif
+
+
+#ifndef _WIN32
+namespace {
+
+
+/// Connections that are served at the same time. Further clients wait in
+/// the backlog of the listen socket.
+constexpr std::size_t max_connections = 64;
+
+
+/// How long to wait before accepting again after running out of file
+/// descriptors or threads.
+constexpr int back_off_ms = 100;
+
+
+std::string ErrnoMessage(const std::string& what)
+{
+  return what + ": " + std::generic_category().message(errno);
+}
+
+
+/// Returns a socket address for path. Throws ServerError if path is too long.
+sockaddr_un SocketAddress(const std::string& path)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if( path.size() >= sizeof(address.sun_path) )
+    throw bbrd::ServerError("socket path too long: " + path);
+
+  std::memcpy(address.sun_path, path.data(), path.size());
+  return address;
+}
+
+
+/// Connect to the socket at path. Returns -1 on failure.
+int ConnectSocket(const std::string& path)
+{
+  auto address = SocketAddress(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if( fd == -1 )
+    return -1;
+
+  if( connect(fd,
+              reinterpret_cast<const sockaddr *>(&address),
+              sizeof(address)) == -1 )
+  {
+    auto error = errno;
+    close(fd);
+    errno = error;
+    return -1;
+  }
+
+  return fd;
+}
+
+
+/// Write all of data to fd. Returns false if the peer went away.
+bool SendAll(int fd, std::string_view data)
+{
+  while( !data.empty() )
+  {
+    auto sent = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if( sent == -1 && errno == EINTR )
+      continue;
+    if( sent <= 0 )
+      return false;
+    data.remove_prefix(static_cast<std::size_t>(sent));
+  }
+
+  return true;
+}
+
+
+/// Reads lines and fixed-size blocks from a socket.
+class SocketReader
+{
+public:
+  explicit SocketReader(int fd)
+  : fd_(fd)
+  , buffer_()
+  {}
+
+  /// Read up to the next newline, which is not included in line. Returns
+  /// false at the end of the stream.
+  bool read_line(std::string& line)
+  {
+    for(;;)
+    {
+      auto newline = this->buffer_.find('\n');
+      if( newline != std::string::npos )
+      {
+        line.assign(this->buffer_, 0, newline);
+        this->buffer_.erase(0, newline + 1);
+        return true;
+      }
+
+      if( !this->fill() )
+        return false;
+    }
+  }
+
+  /// Read exactly size bytes. Returns false at the end of the stream.
+  bool read_block(std::size_t size, std::string& block)
+  {
+    while( this->buffer_.size() < size )
+      if( !this->fill() )
+        return false;
+
+    block.assign(this->buffer_, 0, size);
+    this->buffer_.erase(0, size);
+    return true;
+  }
+
+private:
+  bool fill()
+  {
+    char chunk[1 << 16];
+    for(;;)
+    {
+      auto bytes_read = recv(this->fd_, chunk, sizeof(chunk), 0);
+      if( bytes_read == -1 && errno == EINTR )
+        continue;
+      if( bytes_read <= 0 )
+        return false;
+
+      this->buffer_.append(chunk, static_cast<std::size_t>(bytes_read));
+      return true;
+    }
+  }
+
+  int fd_;
+  std::string buffer_;
+};
+
+
+/// Closes the socket on destruction.
+class Socket
+{
+public:
+  explicit Socket(int fd) noexcept
+  : fd_(fd)
+  {}
+
+  ~Socket()
+  {
+    if( this->fd_ >= 0 )
+      close(this->fd_);
+  }
+
+  Socket(const Socket&) = delete;
+  Socket& operator=(const Socket&) = delete;
+
+  int get() const noexcept
+  { return this->fd_; }
+
+private:
+  int fd_;
+};
+
+
+} // namespace
+#endif
+
+
+namespace bbrd {
+
+
+ServerError::ServerError(const std::string& msg) noexcept
+: std::runtime_error(msg)  // noexcept
+{
+}
+
+
+std::shared_ptr<const DependencyGraph> GraphServer::graph() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->graph_;
+}
+
+unsigned GraphServer::reload_count() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->reload_count_;
+}
+
+void GraphServer::reload() noexcept
+{
+  try
+  {
+    auto graph = std::make_shared<const DependencyGraph>(this->load_());
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->graph_ = std::move(graph);
+    this->reload_count_++;
+  }
+  catch( const std::exception& e )
+  {
+    // Keep answering queries with the previous graph
+    this->errout_.print("Warning", std::string("cannot reload: ") + e.what());
+  }
+}
+
+#ifndef _WIN32
+
+GraphServer::GraphServer(std::string socket_path,
+                         std::string watched_file,
+                         Loader load,
+                         const ErrorOutput& errout)
+: socket_path_(std::move(socket_path))
+, watched_file_(std::move(watched_file))
+, load_(std::move(load))
+, errout_(errout)
+, listen_fd_(-1)
+, stop_pipe_{-1, -1}
+, mutex_()
+, graph_()
+, reload_count_(0)
+, connections_()
+, idle_()
+, watch_thread_()
+{
+  // Refuse to take over the socket of a running server. A socket without a
+  // server is a leftover and is replaced.
+  int existing = ConnectSocket(this->socket_path_);
+  if( existing != -1 )
+  {
+    close(existing);
+    throw ServerError("server already running on " + this->socket_path_);
+  }
+  unlink(this->socket_path_.c_str());
+
+  this->graph_ = std::make_shared<const DependencyGraph>(this->load_());
+
+  try
+  {
+    if( pipe2(this->stop_pipe_, O_CLOEXEC) == -1 )
+      throw ServerError(ErrnoMessage("cannot create pipe"));
+
+    this->listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if( this->listen_fd_ == -1 )
+      throw ServerError(ErrnoMessage("cannot create socket"));
+
+    auto address = SocketAddress(this->socket_path_);
+    if( bind(this->listen_fd_,
+             reinterpret_cast<const sockaddr *>(&address),
+             sizeof(address)) == -1 ||
+        listen(this->listen_fd_, SOMAXCONN) == -1 )
+      throw ServerError(
+        ErrnoMessage("cannot listen on " + this->socket_path_));
+  }
+  catch( ... )
+  {
+    this->close_fds();
+    throw;
+  }
+
+  this->watch_thread_ = std::thread(&GraphServer::watch_loop, this);
+}
+
+GraphServer::~GraphServer()
+{
+  this->stop();
+
+  if( this->watch_thread_.joinable() )
+    this->watch_thread_.join();
+
+  {
+    std::unique_lock<std::mutex> lock(this->mutex_);
+    for(auto fd : this->connections_)
+      shutdown(fd, SHUT_RDWR);
+    this->idle_.wait(lock, [this]{ return this->connections_.empty(); });
+  }
+
+  this->close_fds();
+}
+
+void GraphServer::run()
+{
+  bool backing_off = false;
+  for(;;)
+  {
+    bool full = false;
+    {
+      std::lock_guard<std::mutex> lock(this->mutex_);
+      full = this->connections_.size() >= max_connections;
+    }
+
+    // A pending connection keeps the listen socket readable. Without a free
+    // slot, thread or file descriptor, only wait for stop for a while
+    // instead of spinning.
+    bool accepting = !full && !backing_off;
+    backing_off = false;
+    pollfd fds[2] = {
+      {this->stop_pipe_[0], POLLIN, 0},
+      {this->listen_fd_, POLLIN, 0},
+    };
+    if( poll(fds, accepting ? 2 : 1, accepting ? -1 : back_off_ms) == -1 )
+    {
+      if( errno == EINTR )
+        continue;
+      throw ServerError(ErrnoMessage("cannot poll"));
+    }
+
+    if( fds[0].revents )
+      return;
+
+    if( !accepting || !fds[1].revents )
+      continue;
+
+    int fd = accept4(this->listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if( fd == -1 )
+    {
+      backing_off = ( errno == EMFILE || errno == ENFILE ||
+                      errno == ENOBUFS || errno == ENOMEM );
+      continue;
+    }
+
+    // Connection threads remove themselves from connections_ when they are
+    // done. The destructor waits for that.
+    std::lock_guard<std::mutex> lock(this->mutex_);
+    this->connections_.insert(fd);
+    try
+    {
+      std::thread(&GraphServer::serve, this, fd).detach();
+    }
+    catch( const std::exception& e )
+    {
+      this->connections_.erase(fd);
+      close(fd);
+      backing_off = true;
+      this->errout_.print("Warning",
+                          std::string("cannot serve connection: ") + e.what());
+    }
+  }
+}
+
+void GraphServer::stop() noexcept
+{
+  if( this->stop_pipe_[1] != -1 )
+  {
+    char c = 0;
+    // The pipe is only read by poll, a failed write means it is full, which
+    // wakes up the loops as well
+    auto ignored = write(this->stop_pipe_[1], &c, 1);
+    (void)ignored;
+  }
+}
+
+void GraphServer::close_fds() noexcept
+{
+  if( this->listen_fd_ != -1 )
+  {
+    close(this->listen_fd_);
+    unlink(this->socket_path_.c_str());
+  }
+
+  for(auto fd : this->stop_pipe_)
+    if( fd != -1 )
+      close(fd);
+}
+
+void GraphServer::watch_loop() noexcept
+{
+#ifdef __linux__
+  int fd = inotify_init1(IN_CLOEXEC);
+  if( fd == -1 )
+  {
+    this->errout_.print("Warning", ErrnoMessage("cannot watch file"));
+    return;
+  }
+
+  // Watch the directory: task-depends.dot is usually replaced, not modified
+  // in place, which would end a watch on the file itself.
+  auto slash = this->watched_file_.rfind('/');
+  auto dir = ( slash == std::string::npos )
+    ? std::string(".")
+    : this->watched_file_.substr(0, slash + 1);
+  auto name = ( slash == std::string::npos )
+    ? this->watched_file_
+    : this->watched_file_.substr(slash + 1);
+
+  if( inotify_add_watch(fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) == -1 )
+  {
+    this->errout_.print("Warning", ErrnoMessage("cannot watch " + dir));
+    close(fd);
+    return;
+  }
+
+  alignas(inotify_event) char buffer[4096];
+  for(;;)
+  {
+    pollfd fds[2] = {
+      {fd, POLLIN, 0},
+      {this->stop_pipe_[0], POLLIN, 0},
+    };
+    if( poll(fds, 2, -1) == -1 && errno != EINTR )
+      break;
+
+    if( fds[1].revents )
+      break;
+
+    if( !fds[0].revents )
+      continue;
+
+    auto bytes_read = read(fd, buffer, sizeof(buffer));
+    if( bytes_read <= 0 )
+      continue;
+
+    bool changed = false;
+    for(auto p = buffer; p < buffer + bytes_read; )
+    {
+      inotify_event event;
+      std::memcpy(&event, p, sizeof(event));
+      if( event.len && name == p + sizeof(event) )
+        changed = true;
+      p += sizeof(event) + event.len;
+    }
+
+    if( changed )
+      this->reload();
+  }
+
+  close(fd);
+#else
+  this->errout_.print("Warning", "cannot watch file: not supported");
+#endif
+}
+
+void GraphServer::serve(int fd) noexcept
+{
+  try
+  {
+    SocketReader reader(fd);
+    std::string line;
+    while( reader.read_line(line) )
+    {
+      // Every query uses the graph that is current when it arrives
+      auto graph = this->graph();
+      std::ostringstream out;
+      std::string reply;
+      try
+      {
+        if( auto query = ParseQuery(line) )
+          RunQuery(*graph, *query, out);
+        else
+          graph->list(out);
+
+        auto answer = out.str();
+        reply = "ok " + std::to_string(answer.size()) + "\n" + answer;
+      }
+      catch( const std::exception& e )
+      {
+        // Messages must not span lines
+        std::string message = e.what();
+        for(auto& c : message)
+          if( c == '\n' )
+            c = ' ';
+        reply = "error " + message + "\n";
+      }
+
+      if( !SendAll(fd, reply) )
+        break;
+    }
+  }
+  catch( const std::exception& e )
+  {
+    this->errout_.print("Warning", e.what());
+  }
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->connections_.erase(fd);
+  close(fd);
+  this->idle_.notify_all();
+}
+
+
+void QueryServer(const std::string& socket_path,
+                 const std::string& query,
+                 std::ostream& out)
+{
+  Socket socket(ConnectSocket(socket_path));
+  if( socket.get() == -1 )
+    throw ServerError(ErrnoMessage("cannot connect to " + socket_path));
+
+  auto fd = socket.get();
+  if( !SendAll(fd, query + "\n") )
+    throw ServerError("connection to " + socket_path + " lost");
+
+  SocketReader reader(fd);
+  std::string header;
+  if( !reader.read_line(header) )
+    throw ServerError("connection to " + socket_path + " lost");
+
+  if( header.compare(0, 6, "error ") == 0 )
+    throw ServerError(header.substr(6));
+
+  if( header.compare(0, 3, "ok ") != 0 )
+    throw ServerError("invalid reply from " + socket_path);
+
+  std::string answer;
+  if( !reader.read_block(std::stoul(header.substr(3)), answer) )
+    throw ServerError("connection to " + socket_path + " lost");
+
+  out << answer;
+}
+
+#else
+
+GraphServer::GraphServer(std::string socket_path,
+                         std::string watched_file,
+                         Loader load,
+                         const ErrorOutput& errout)
+: socket_path_(std::move(socket_path))
+, watched_file_(std::move(watched_file))
+, load_(std::move(load))
+, errout_(errout)
+, listen_fd_(-1)
+, stop_pipe_{-1, -1}
+, mutex_()
+, graph_()
+, reload_count_(0)
+, connections_()
+, idle_()
+, watch_thread_()
+{
+  throw ServerError("serving queries is not supported on Windows");
+}
+
+GraphServer::~GraphServer()
+{
+}
+
+void GraphServer::run()
+{
+}
+
+void GraphServer::stop() noexcept
+{
+}
+
+void GraphServer::close_fds() noexcept
+{
+}
+
+void GraphServer::watch_loop() noexcept
+{
+}
+
+void GraphServer::serve(int) noexcept
+{
+}
+
+void QueryServer(const std::string&, const std::string&, std::ostream&)
+{
+  throw ServerError("serving queries is not supported on Windows");
+}
+
+#endif
+
+
+} // namespace bbrd
+
@@ -0,0 +1,109 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/DependencyGraph.h"
+#include "bbrd/ErrorOutput.h"
+
+#include <condition_variable>
+#include <functional>
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+
+namespace bbrd {
+
+
+/// Thrown on socket errors, and by QueryServer if the server reports an
+/// error.
+class ServerError : public std::runtime_error
+{
+public:
+  explicit ServerError(const std::string& msg) noexcept;
+};
+
+
+/// Keeps a DependencyGraph in memory and answers queries over a Unix domain
+/// socket.
+///
+/// Protocol: The client sends one query per line, in the same format as
+/// --batch. An empty line lists all recipes. For every query the server
+/// replies with either "ok <n>\n" followed by exactly n bytes of output, or
+/// "error <message>\n". A connection may be used for any number of queries.
+/// Up to 64 connections are served at the same time, further clients wait
+/// until one is closed.
+///
+/// The file the graph was loaded from is watched with inotify. If it is
+/// replaced or written to, the graph is reloaded in the background and
+/// swapped in once it is complete. Queries that are already running keep
+/// using the previous graph.
+class GraphServer
+{
+public:
+  using Loader = std::function<DependencyGraph()>;
+
+  /// Load the graph and listen on socket_path. Throws ServerError if the
+  /// socket cannot be created or if another server is listening on it.
+  GraphServer(std::string socket_path,
+              std::string watched_file,
+              Loader load,
+              const ErrorOutput& errout);
+  ~GraphServer();
+
+  GraphServer(GraphServer&&) = delete;
+  GraphServer(const GraphServer&) = delete;
+  GraphServer& operator=(GraphServer&&) = delete;
+  GraphServer& operator=(const GraphServer&) = delete;
+
+  /// Accept connections until stop is called.
+  void run();
+
+  /// Make run return. May be called from any thread.
+  void stop() noexcept;
+
+  /// The current graph.
+  std::shared_ptr<const DependencyGraph> graph() const;
+
+  /// The number of times the graph was reloaded successfully.
+  unsigned reload_count() const;
+
+private:
+  void close_fds() noexcept;
+  void watch_loop() noexcept;
+  void reload() noexcept;
+  void serve(int fd) noexcept;
+
+  std::string socket_path_;
+  std::string watched_file_;
+  Loader load_;
+  const ErrorOutput& errout_;
+  int listen_fd_;
+  /// Writing to stop_pipe_[1] wakes up the accept and watch loops.
+  int stop_pipe_[2];
+  mutable std::mutex mutex_;
+  std::shared_ptr<const DependencyGraph> graph_;
+  unsigned reload_count_;
+  /// Open connections, which are shut down on destruction.
+  std::set<int> connections_;
+  /// Notified when a connection is closed.
+  std::condition_variable idle_;
+  std::thread watch_thread_;
+};
+
+
+/// Send query (see GraphServer) to the server listening on socket_path and
+/// write its answer to out. Throws ServerError if the server cannot be
+/// reached or if it reports an error.
+void QueryServer(const std::string& socket_path,
+                 const std::string& query,
+                 std::ostream& out);
+
+
+} // namespace bbrd
+
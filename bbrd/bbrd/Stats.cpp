@@ -0,0 +1,214 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/Stats.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+#include <ios>
+#include <iterator>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+
+namespace {
+
+
+constexpr int value_precision = 12;
+
+
+/// Write s as a JSON string.
+void PrintJsonString(std::ostream& out, const std::string& s)
+{
+  out << '"';
+  for(char c : s)
+    if( c == '"' || c == '\\' )
+    {
+      out << '\\' << c;
+    }
+    else if( static_cast<unsigned char>(c) < 0x20 )
+    {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      out << escaped;
+    }
+    else
+    {
+      out << c;
+    }
+  out << '"';
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+Stats::Stats()
+: start_(Clock::now())
+, mutex_()
+, phases_()
+, counters_()
+, threads_()
+{
+}
+
+void Stats::add_phase(const char * name,
+                      std::string input,
+                      Clock::time_point begin,
+                      std::clock_t cpu_begin)
+{
+  auto end = Clock::now();
+  auto cpu_end = std::clock();
+  using Micros = std::chrono::duration<double, std::micro>;
+
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  auto thread = std::find(this->threads_.begin(),
+                          this->threads_.end(),
+                          std::this_thread::get_id());
+  if( thread == this->threads_.end() )
+    thread = this->threads_.insert(thread, std::this_thread::get_id());
+
+  this->phases_.push_back(Phase{
+      name,
+      std::move(input),
+      Micros(begin - this->start_).count(),
+      Micros(end - begin).count(),
+      static_cast<double>(cpu_end - cpu_begin) * 1e6 / CLOCKS_PER_SEC,
+      static_cast<std::size_t>(
+          std::distance(this->threads_.begin(), thread))});
+}
+
+void Stats::add_counter(std::string name, std::string input, double value)
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  this->counters_.push_back(Counter{std::move(name), std::move(input), value});
+}
+
+std::vector<Stats::Phase> Stats::phases() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->phases_;
+}
+
+std::vector<Stats::Counter> Stats::counters() const
+{
+  std::lock_guard<std::mutex> lock(this->mutex_);
+  return this->counters_;
+}
+
+std::size_t Stats::PeakRss() noexcept
+{
+#ifndef _WIN32
+  rusage usage{};
+  if( getrusage(RUSAGE_SELF, &usage) != 0 || usage.ru_maxrss < 0 )
+    return 0;
+
+  auto rss = static_cast<std::size_t>(usage.ru_maxrss);
+#ifdef __linux__
+  // Linux reports kilobytes, macOS bytes
+  rss *= 1024;
+#endif
+  return rss;
+#else
+  return 0;
+#endif
+}
+
+void Stats::print(std::ostream& out) const
+{
+  auto flags = out.flags();
+  auto precision = out.precision();
+
+  out << std::left << std::setw(24) << "phase" << std::right
+      << std::setw(12) << "wall ms" << std::setw(12) << "cpu ms"
+      << "  input\n" << std::fixed << std::setprecision(3);
+  for(const auto& phase : this->phases())
+    out << std::left << std::setw(24) << phase.name << std::right
+        << std::setw(12) << phase.wall_us / 1000
+        << std::setw(12) << phase.cpu_us / 1000
+        << ( phase.input.empty() ? "" : "  " ) << phase.input << "\n";
+
+  out << "\n" << std::left << std::setw(24) << "counter" << std::right
+      << std::setw(24) << "value" << "  input\n"
+      << std::defaultfloat << std::setprecision(value_precision);
+  for(const auto& counter : this->counters())
+    out << std::left << std::setw(24) << counter.name << std::right
+        << std::setw(24) << counter.value
+        << ( counter.input.empty() ? "" : "  " ) << counter.input << "\n";
+  out << std::left << std::setw(24) << "peak rss bytes" << std::right
+      << std::setw(24) << Stats::PeakRss() << "\n";
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+void Stats::print_json(std::ostream& out) const
+{
+  auto precision = out.precision(value_precision);
+
+  out << "{\"phases\":[";
+  bool first = true;
+  for(const auto& phase : this->phases())
+  {
+    out << ( first ? "" : "," ) << "{\"name\":";
+    PrintJsonString(out, phase.name);
+    out << ",\"input\":";
+    PrintJsonString(out, phase.input);
+    out << ",\"wall_ms\":" << phase.wall_us / 1000
+        << ",\"cpu_ms\":" << phase.cpu_us / 1000 << "}";
+    first = false;
+  }
+
+  out << "],\"counters\":[";
+  first = true;
+  for(const auto& counter : this->counters())
+  {
+    out << ( first ? "" : "," ) << "{\"name\":";
+    PrintJsonString(out, counter.name);
+    out << ",\"input\":";
+    PrintJsonString(out, counter.input);
+    out << ",\"value\":" << counter.value << "}";
+    first = false;
+  }
+
+  out << "],\"peak_rss_bytes\":" << Stats::PeakRss() << "}\n";
+  out.precision(precision);
+}
+
+void Stats::write_trace(std::ostream& out) const
+{
+  auto flags = out.flags();
+  auto precision = out.precision(3);
+  out << std::fixed;
+
+  // Complete events ("X") with a begin and a duration in microseconds
+  out << "{\"traceEvents\":[";
+  bool first = true;
+  for(const auto& phase : this->phases())
+  {
+    out << ( first ? "" : "," ) << "\n{\"name\":";
+    PrintJsonString(out, phase.name);
+    out << ",\"cat\":\"bb-depends-dot\",\"ph\":\"X\""
+        << ",\"ts\":" << phase.begin_us
+        << ",\"dur\":" << phase.wall_us
+        << ",\"pid\":1,\"tid\":" << phase.thread
+        << ",\"args\":{\"input\":";
+    PrintJsonString(out, phase.input);
+    out << ",\"cpu_ms\":" << phase.cpu_us / 1000 << "}}";
+    first = false;
+  }
+  out << "\n]}\n";
+
+  out.flags(flags);
+  out.precision(precision);
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,125 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <ctime>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// Timing of the phases of a run (reading, parsing, building the graph,
+/// answering the query) and counters such as the number of recipes, printed
+/// by --stats. Phases may be recorded by several threads at once.
+class Stats
+{
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Phase
+  {
+    std::string name;
+    /// The file the phase worked on, if any
+    std::string input;
+    /// Microseconds since the Stats were created
+    double begin_us;
+    double wall_us;
+    /// CPU time of the whole process, including helper threads
+    double cpu_us;
+    /// Small number of the thread that recorded the phase
+    std::size_t thread;
+  };
+
+  struct Counter
+  {
+    std::string name;
+    std::string input;
+    double value;
+  };
+
+  /// Measures a phase from construction to destruction. Does nothing if
+  /// stats is null, therefore runs without --stats only pay for a branch.
+  class Timer
+  {
+  public:
+    Timer(Stats * stats, const char * name, const std::string& input = "")
+    : stats_(stats)
+    , name_(name)
+    , input_(stats ? input : std::string())
+    , begin_()
+    , cpu_begin_(0)
+    {
+      if( this->stats_ )
+      {
+        this->begin_ = Clock::now();
+        this->cpu_begin_ = std::clock();
+      }
+    }
+
+    ~Timer()
+    {
+      if( this->stats_ )
+        this->stats_->add_phase(this->name_, std::move(this->input_),
+                                this->begin_, this->cpu_begin_);
+    }
+
+    Timer(Timer&&) = delete;
+    Timer(const Timer&) = delete;
+    Timer& operator=(Timer&&) = delete;
+    Timer& operator=(const Timer&) = delete;
+
+  private:
+    Stats * stats_;
+    const char * name_;
+    std::string input_;
+    Clock::time_point begin_;
+    std::clock_t cpu_begin_;
+  };
+
+  Stats();
+
+  /// Record a phase that started at begin and ends now.
+  void add_phase(const char * name,
+                 std::string input,
+                 Clock::time_point begin,
+                 std::clock_t cpu_begin);
+
+  void add_counter(std::string name, std::string input, double value);
+
+  /// Phases and counters in the order they were recorded.
+  std::vector<Phase> phases() const;
+  std::vector<Counter> counters() const;
+
+  /// Peak resident set size of the process in bytes, 0 if unknown.
+  static std::size_t PeakRss() noexcept;
+
+  /// A table of phases and counters, for humans.
+  void print(std::ostream& out) const;
+
+  /// The same as a JSON object.
+  void print_json(std::ostream& out) const;
+
+  /// The phases in the Chrome trace event format, which can be viewed in
+  /// chrome://tracing or https://ui.perfetto.dev.
+  void write_trace(std::ostream& out) const;
+
+private:
+  Clock::time_point start_;
+  mutable std::mutex mutex_;
+  std::vector<Phase> phases_;
+  std::vector<Counter> counters_;
+  std::vector<std::thread::id> threads_;
+};
+
+
+} // namespace bbrd
+
@@ -0,0 +1,53 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/TaskDependencies.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+
+namespace bbrd {
+
+
+TaskDependencies::Node TaskDependencies::MakeNode(Id recipe, Id task)
+{
+  if( task >> task_bits )
+    throw std::out_of_range("too many distinct tasks");
+
+  if( recipe >> (32 - task_bits) )
+    throw std::out_of_range("too many recipes for the task graph");
+
+  return static_cast<Node>((recipe << task_bits) | task);
+}
+
+TaskDependencies::TaskDependencies(bool copy_names)
+: tasks_(copy_names)
+, dependencies_()
+{
+}
+
+void TaskDependencies::merge(const TaskDependencies& other,
+                             const std::vector<Id>& recipe_ids)
+{
+  std::vector<Id> task_ids;
+  task_ids.reserve(other.task_names().size());
+  for(auto name : other.task_names())
+    task_ids.push_back(this->tasks_.get_or_create(name));
+
+  auto global = [&recipe_ids, &task_ids](Node node){
+    return MakeNode(recipe_ids[RecipeOf(node)], task_ids[TaskOf(node)]);
+  };
+
+  this->dependencies_.reserve(
+      this->dependencies_.size() + other.dependencies().size());
+  for(auto dependency : other.dependencies())
+    this->dependencies_.push_back(MakeDependency(global(To(dependency)),
+                                                 global(From(dependency))));
+}
+
+
+} // namespace bbrd
+
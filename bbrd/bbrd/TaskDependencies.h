@@ -0,0 +1,84 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/RecipeInterner.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// Dependencies between tasks, e.g. between curl:do_compile and
+/// openssl:do_populate_sysroot.
+///
+/// Task names (do_compile, ...) are a small vocabulary, which is interned
+/// separately from recipe names. A task of a recipe is a node, which packs
+/// the recipe id and the task id into 32 bits. A dependency packs both nodes
+/// into 64 bits. Dependencies are stored as they are added, duplicates
+/// included.
+class TaskDependencies
+{
+public:
+  using Id = RecipeInterner::Id;
+  using Node = std::uint32_t;
+  using DependencyVector = std::vector<std::uint64_t>;
+
+  /// The number of bits of a node that hold the task id.
+  static constexpr unsigned task_bits = 12;
+
+  /// Throws std::out_of_range if recipe or task do not fit into a node.
+  static Node MakeNode(Id recipe, Id task);
+
+  static Id RecipeOf(Node node) noexcept
+  { return node >> task_bits; }
+
+  static Id TaskOf(Node node) noexcept
+  { return node & ((Node(1) << task_bits) - 1); }
+
+  static std::uint64_t MakeDependency(Node to, Node from) noexcept
+  { return (std::uint64_t(to) << 32) | from; }
+
+  static Node To(std::uint64_t dependency) noexcept
+  { return static_cast<Node>(dependency >> 32); }
+
+  static Node From(std::uint64_t dependency) noexcept
+  { return static_cast<Node>(dependency); }
+
+  /// If copy_names is set, task names are copied. Otherwise the caller has to
+  /// keep the underlying buffer alive.
+  explicit TaskDependencies(bool copy_names = false);
+
+  /// Add a dependency of task to_task of recipe to on task from_task of
+  /// recipe from.
+  void add(Id to, std::string_view to_task, Id from, std::string_view from_task)
+  {
+    this->dependencies_.push_back(MakeDependency(
+        MakeNode(to, this->tasks_.get_or_create_cached(to_task)),
+        MakeNode(from, this->tasks_.get_or_create(from_task))));
+  }
+
+  /// Add the dependencies of other, whose recipe ids are mapped to
+  /// recipe_ids[id].
+  void merge(const TaskDependencies& other, const std::vector<Id>& recipe_ids);
+
+  /// Task names in the order of their ids.
+  const RecipeInterner::Names& task_names() const noexcept
+  { return this->tasks_.names(); }
+
+  const DependencyVector& dependencies() const noexcept
+  { return this->dependencies_; }
+
+private:
+  RecipeInterner tasks_;
+  DependencyVector dependencies_;
+};
+
+
+} // namespace bbrd
+
@@ -0,0 +1,154 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "bbrd/TransitiveReduction.h"
+#include "bbrd/ClosureIndex.h"
+#include "bbrd/Condensation.h"
+#include "bbrd/CsrGraph.h"
+#include "bbrd/Workers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <limits>
+#include <thread>
+#include <vector>
+
+
+namespace {
+
+
+using Component = bbrd::Condensation::Component;
+using Edge = bbrd::CsrGraph::Edge;
+using Word = bbrd::ClosureIndex::Word;
+
+
+/// Graphs with fewer components are not worth the overhead of threads.
+constexpr std::size_t min_components_per_thread = 256;
+
+/// Components are handed out to threads in blocks of this size.
+constexpr std::size_t block_size = 64;
+
+
+/// State of a thread that reduces the dependencies of components.
+struct Reducer
+{
+  Reducer(const bbrd::CsrGraph& graph,
+          const bbrd::Condensation& graph_condensation,
+          const bbrd::ClosureIndex& graph_closure)
+  : forward(graph)
+  , condensation(graph_condensation)
+  , closure(graph_closure)
+  , reachable(graph_closure.words_per_row())
+  , successors()
+  , kept(graph_condensation.component_count(),
+         std::numeric_limits<Component>::max())
+  , edges()
+  {}
+
+  /// Append the reduced dependencies of the recipes of component c to edges.
+  void reduce(Component c)
+  {
+    const auto& dag = this->condensation.forward();
+    this->successors.assign(dag.targets_begin(c), dag.targets_end(c));
+    // Components are numbered in reverse topological order: A successor
+    // can only be reached through successors with a higher number
+    std::sort(this->successors.begin(), this->successors.end(),
+              std::greater<Component>());
+
+    std::fill(this->reachable.begin(), this->reachable.end(), 0);
+    for(auto d : this->successors)
+    {
+      auto representative = *this->condensation.members_begin(d);
+      if( !bbrd::ClosureIndex::Test(this->reachable.data(), representative) )
+        this->kept[d] = c;
+
+      auto row = this->closure.component_row(d);
+      for(std::size_t i = 0; i < this->reachable.size(); ++i)
+        this->reachable[i] |= row[i];
+    }
+
+    // Keep the first dependency between the recipes of two components. Once
+    // it is kept, the target component is unmarked.
+    for(auto u = this->condensation.members_begin(c);
+        u != this->condensation.members_end(c);
+        ++u)
+      for(auto v = this->forward.targets_begin(*u);
+          v != this->forward.targets_end(*u);
+          ++v)
+      {
+        auto d = this->condensation.component_of(*v);
+        if( d == c )
+        {
+          this->edges.push_back(Edge{*u, *v});
+        }
+        else if( this->kept[d] == c )
+        {
+          this->edges.push_back(Edge{*u, *v});
+          this->kept[d] = std::numeric_limits<Component>::max();
+        }
+      }
+  }
+
+  const bbrd::CsrGraph& forward;
+  const bbrd::Condensation& condensation;
+  const bbrd::ClosureIndex& closure;
+  /// The OR of the closure rows of the successors visited so far
+  std::vector<Word> reachable;
+  std::vector<Component> successors;
+  /// kept[d] == c if the dependency from c to d is not redundant
+  std::vector<Component> kept;
+  std::vector<Edge> edges;
+};
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+std::vector<CsrGraph::Edge> TransitiveReduction(
+    const CsrGraph& forward,
+    const Condensation& condensation,
+    const ClosureIndex& closure,
+    unsigned thread_count)
+{
+  auto component_count = condensation.component_count();
+  if( thread_count == 0 )
+    thread_count = std::max(std::thread::hardware_concurrency(), 1u);
+  thread_count = static_cast<unsigned>(std::min<std::size_t>(
+      thread_count, component_count / min_components_per_thread + 1));
+
+  std::vector<Reducer> reducers(
+      thread_count, Reducer(forward, condensation, closure));
+  std::atomic<std::size_t> next_block(0);
+  auto worker = [&reducers, &next_block, component_count](std::size_t i){
+    for(;;)
+    {
+      auto begin = next_block++ * block_size;
+      if( begin >= component_count )
+        return;
+
+      auto end = std::min(begin + block_size, component_count);
+      for(auto c = begin; c < end; ++c)
+        reducers[i].reduce(static_cast<Component>(c));
+    }
+  };
+
+  RunWorkers(thread_count, worker);
+
+  std::vector<Edge> edges;
+  for(const auto& reducer : reducers)
+    edges.insert(edges.end(), reducer.edges.begin(), reducer.edges.end());
+  std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b){
+    return a.source != b.source ? a.source < b.source : a.target < b.target;
+  });
+
+  return edges;
+}
+
+
+} // namespace bbrd
+
@@ -0,0 +1,36 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include "bbrd/ClosureIndex.h"
+#include "bbrd/Condensation.h"
+#include "bbrd/CsrGraph.h"
+
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// The dependencies of forward that are not implied by other dependencies,
+/// sorted by source and target.
+///
+/// A dependency between two strongly connected components is dropped if its
+/// target is reachable through another dependency of its source. Of the
+/// remaining dependencies between two components, one dependency between
+/// their recipes is kept. Dependencies within a component are all kept.
+///
+/// Successors of a component are visited in topological order while
+/// collecting the OR of their closure rows, so a successor is redundant if
+/// its bit is already set. Components are processed by thread_count threads.
+/// If thread_count is 0, it is the number of cores.
+std::vector<CsrGraph::Edge> TransitiveReduction(
+    const CsrGraph& forward,
+    const Condensation& condensation,
+    const ClosureIndex& closure,
+    unsigned thread_count = 0);
+
+
+} // namespace bbrd
+
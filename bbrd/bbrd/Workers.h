@@ -0,0 +1,44 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+
+namespace bbrd {
+
+
+/// Call worker(i) for every i below count, worker(0) on the calling thread
+/// and every other on a thread of its own, and wait until all have returned.
+/// Every worker must return on its own, also if not all of them run: If a
+/// thread cannot be started or worker(0) throws, the threads that were
+/// started are joined before the exception is rethrown.
+template<typename Worker>
+void RunWorkers(std::size_t count, Worker&& worker)
+{
+  std::vector<std::thread> threads;
+  if( count > 1 )
+    threads.reserve(count - 1);
+
+  try
+  {
+    for(std::size_t i = 1; i < count; ++i)
+      threads.emplace_back(worker, i);
+    worker(std::size_t(0));
+  }
+  catch( ... )
+  {
+    for(auto& thread : threads)
+      thread.join();
+    throw;
+  }
+
+  for(auto& thread : threads)
+    thread.join();
+}
+
+
+} // namespace bbrd
@@ -0,0 +1,123 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+// A C interface to libbbrd, e.g. for ctypes or cffi: Load the graph of a
+// task-depends.dot once and query it many times. Recipes are identified by
+// ids below bbrd_recipe_count(), which do not change while the graph is
+// open.
+//
+// Functions that can fail return -1 (or NULL) and keep a message for
+// bbrd_last_error() in the calling thread. An open graph may be queried by
+// several threads at once.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+typedef struct bbrd_graph bbrd_graph;
+
+typedef uint32_t bbrd_id;
+
+/// A string that is not null-terminated.
+typedef struct bbrd_string
+{
+  const char * data;
+  size_t size;
+} bbrd_string;
+
+/// A sequence of recipe ids.
+typedef struct bbrd_ids
+{
+  const bbrd_id * ids;
+  size_t count;
+} bbrd_ids;
+
+/// Flags of bbrd_graph_open.
+enum
+{
+  /// Neither read nor write the cached graph
+  BBRD_NO_CACHE = 1,
+  /// Index the transitive closure, which speeds up bbrd_transitive_recipes
+  /// and bbrd_depends_on
+  BBRD_CLOSURE = 2
+};
+
+
+/// The version of the library.
+void bbrd_version(int * major, int * minor);
+
+/// The message of the last error in the calling thread, or an empty string.
+const char * bbrd_last_error(void);
+
+/// Load the graph of a task-depends.dot (optionally compressed), using and
+/// updating the cache the same way bb-depends-dot does. cache_dir may be
+/// NULL: The cache is stored next to the file, or in $XDG_CACHE_HOME/bbrd
+/// (default ~/.cache/bbrd) if the directory of the file is read-only. If
+/// thread_count is 0, it is chosen depending on the number of cores.
+/// Returns NULL on failure.
+bbrd_graph * bbrd_graph_open(const char * path,
+                             const char * cache_dir,
+                             unsigned flags,
+                             unsigned thread_count);
+
+/// Release the graph and everything that points into it. graph may be NULL.
+void bbrd_graph_close(bbrd_graph * graph);
+
+/// An upper bound on the ids of recipes. Not every id below it is a recipe:
+/// A graph loaded from a cache that keeps the dependencies between tasks
+/// also has ids for recipes without dependencies on other recipes, which
+/// the functions taking an id reject.
+size_t bbrd_recipe_count(const bbrd_graph * graph);
+
+/// The number of distinct dependencies between recipes.
+size_t bbrd_dependency_count(const bbrd_graph * graph);
+
+/// Store the id of the recipe called name (size bytes) in id. Returns -1 if
+/// there is no such recipe.
+int bbrd_find_recipe(const bbrd_graph * graph,
+                     const char * name,
+                     size_t size,
+                     bbrd_id * id);
+
+/// The name of a recipe, which points into the graph. Returns -1 if there is
+/// no such recipe.
+int bbrd_recipe_name(const bbrd_graph * graph,
+                     bbrd_id recipe,
+                     bbrd_string * name);
+
+/// The recipes that recipe directly depends on, or that directly depend on
+/// recipe if reverse is non-zero. The ids point into the graph and must not
+/// be released. Returns -1 if there is no such recipe.
+int bbrd_adjacent_recipes(const bbrd_graph * graph,
+                          bbrd_id recipe,
+                          int reverse,
+                          bbrd_ids * adjacent);
+
+/// The recipes that recipe transitively depends on, or that transitively
+/// depend on recipe if reverse is non-zero. The ids must be released with
+/// bbrd_ids_free. Returns -1 if there is no such recipe.
+int bbrd_transitive_recipes(const bbrd_graph * graph,
+                            bbrd_id recipe,
+                            int reverse,
+                            bbrd_ids * transitive);
+
+/// Release the ids of bbrd_transitive_recipes.
+void bbrd_ids_free(bbrd_ids ids);
+
+/// Returns 1 if recipe transitively depends on dependency, 0 if it does not
+/// and -1 if either recipe does not exist.
+int bbrd_depends_on(const bbrd_graph * graph,
+                    bbrd_id recipe,
+                    bbrd_id dependency);
+
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
@@ -1,16 +1,447 @@
 // Author: Thomas Trapp - https://thomastrapp.com/
 // License: MIT
 
+#include "bbrd/BatchQuery.h"
+#include "bbrd/Buildstats.h"
+#include "bbrd/Decompression.h"
 #include "bbrd/Dependencies.h"
 #include "bbrd/DependencyGraph.h"
 #include "bbrd/ErrorOutput.h"
 #include "bbrd/File.h"
+#include "bbrd/GraphCache.h"
+#include "bbrd/GraphDiff.h"
+#include "bbrd/GraphImage.h"
+#include "bbrd/MergedGraph.h"
 #include "bbrd/ProgramOptions.h"
+#include "bbrd/ReadGraph.h"
+#include "bbrd/Server.h"
+#include "bbrd/Stats.h"
 #include "bbrd/Version.h"
 
+#include <algorithm>
+#include <atomic>
+#include <csignal>
 #include <cstdlib>
+#include <fstream>
+#include <future>
 #include <ios>
 #include <iostream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace {
+
+
+/// Read the graph of input_file with the options of the command line. With
+/// --closure (or --diff -t, --reduce), the graph gets a closure index. With
+/// --tasks (or --schedule-profile, --buildstats), it keeps the tasks.
+bbrd::GraphImage ReadGraphImage(const bbrd::ProgramOptions& po,
+                                const std::string& input_file,
+                                unsigned thread_count,
+                                const bbrd::ErrorOutput& errout,
+                                bbrd::Stats * stats)
+{
+  bbrd::ReadGraphOptions options;
+  options.thread_count = thread_count;
+  // A transitive diff compares the closures of both graphs, the transitive
+  // reduction is computed from the closure
+  options.closure = po.contains("closure") ||
+                    po.contains("reduce") ||
+                    ( po.contains("diff") && po.contains("transitive") );
+  options.tasks = po.contains("tasks") ||
+                  po.contains("schedule-profile") ||
+                  po.contains("buildstats");
+  options.cache = !po.contains("no-cache");
+  if( po.contains("cache-dir") )
+    options.cache_dir = po.get("cache-dir");
+
+  return bbrd::ReadGraphImage(
+      input_file,
+      options,
+      stats,
+      [&errout](const std::string& warning){
+        errout.print("Warning", warning);
+      });
+}
+
+/// Same as ReadGraphImage, with the number of threads of --jobs.
+bbrd::DependencyGraph ReadDependencyGraph(const bbrd::ProgramOptions& po,
+                                          const std::string& input_file,
+                                          const bbrd::ErrorOutput& errout,
+                                          bbrd::Stats * stats)
+{
+  auto thread_count = po.contains("jobs") ? po.get<unsigned>("jobs") : 0;
+  return bbrd::DependencyGraph(
+      ReadGraphImage(po, input_file, thread_count, errout, stats));
+}
+
+
+/// Merge the graphs of task-depends.dot and the files of --merge, and list
+/// all recipes or the dependencies of the recipe, each with the files that
+/// contain them. With --source, only the dependencies of these files are
+/// followed.
+void ListMergedRecipes(const bbrd::ProgramOptions& po,
+                       const bbrd::ErrorOutput& errout,
+                       bbrd::Stats * stats)
+{
+  auto files = po.get<std::vector<std::string>>("merge");
+  files.insert(files.begin(), po.get("task-depends-dot"));
+
+  // Files are read at the same time, each by a share of the threads
+  auto thread_count = po.contains("jobs")
+    ? std::max(po.get<unsigned>("jobs"), 1u)
+    : std::max(std::thread::hardware_concurrency(), 1u);
+  auto file_thread_count = std::max(
+      thread_count / static_cast<unsigned>(
+          std::min<std::size_t>(files.size(), thread_count)),
+      1u);
+
+  auto graph = [&]{
+    bbrd::Stats::Timer timer(stats, "merge");
+    return bbrd::MergedGraph::Merge(
+        files,
+        [&](std::size_t source){
+          return ReadGraphImage(
+              po, files[source], file_thread_count, errout, stats);
+        },
+        thread_count);
+  }();
+
+  if( stats )
+  {
+    stats->add_counter("merged recipes", "",
+                       static_cast<double>(graph.recipe_count()));
+    stats->add_counter("merged dependencies", "",
+                       static_cast<double>(graph.dependency_count()));
+    stats->add_counter("source sets", "",
+                       static_cast<double>(graph.source_set_count()));
+  }
+
+  std::vector<std::size_t> sources;
+  if( po.contains("source") )
+    for(const auto& file : po.get<std::vector<std::string>>("source"))
+    {
+      auto source = graph.find_source(file);
+      if( !source )
+        throw boost::program_options::error(
+            "--source '" + file + "' is neither task-depends.dot nor a file"
+            " of --merge");
+      sources.push_back(*source);
+    }
+  auto filter = graph.make_source_set(sources);
+
+  bbrd::Stats::Timer timer(stats, "query");
+  if( po.contains("recipe") )
+    graph.list_recipe_depends(
+        po.get("recipe"),
+        po.contains("rdepends"),
+        po.contains("transitive"),
+        filter,
+        std::cout);
+  else
+    graph.list(filter, std::cout);
+}
+
+
+/// Answer a query for the direct dependencies of a recipe (-d or -r without
+/// -t) with the cached graph, or, if there is none, by parsing only the lines
+/// of task-depends.dot that mention the recipe. The graph is neither built
+/// nor cached. Returns false if the query needs the graph or if the input
+/// cannot be scanned, i.e. it is not an uncompressed regular file.
+bool ListAdjacentRecipes(const bbrd::ProgramOptions& po, bbrd::Stats * stats)
+{
+  auto input_file = po.get("task-depends-dot");
+  auto recipe = po.get("recipe");
+  bool reverse = po.contains("rdepends");
+  if( po.contains("transitive") ||
+      po.contains("path") ||
+      po.contains("depends-on") ||
+      po.contains("tasks") ||
+      po.contains("closure") ||
+      recipe.find(':') != std::string::npos ||
+      !bbrd::IsRegularFile(input_file) )
+    return false;
+
+  if( !po.contains("no-cache") )
+  {
+    auto stamp = bbrd::ReadFileStampOrThrow(input_file);
+    auto image = [&]{
+      bbrd::Stats::Timer timer(stats, "load cache", input_file);
+      return bbrd::LoadGraphCache(
+          bbrd::GraphCachePath(
+              input_file,
+              stamp,
+              po.contains("cache-dir")
+                ? po.get("cache-dir")
+                : bbrd::DefaultGraphCacheDir(input_file)),
+          stamp);
+    }();
+
+    if( image )
+    {
+      bbrd::Stats::Timer timer(stats, "query");
+      bbrd::DependencyGraph(std::move(*image))
+        .list_adjacent_recipes(recipe, reverse, std::cout);
+      return true;
+    }
+  }
+
+  auto buffer = [&]{
+    bbrd::Stats::Timer timer(stats, "read", input_file);
+    return bbrd::ReadFileOrThrow(input_file);
+  }();
+  if( bbrd::DetectCompression(buffer.view()) != bbrd::Compression::none )
+    return false;
+
+  bbrd::Stats::Timer timer(stats, "scan", input_file);
+  auto adjacent = bbrd::ScanAdjacentRecipes(buffer.view(), recipe, reverse);
+  if( !adjacent )
+    throw std::runtime_error("recipe not found: " + recipe);
+
+  for(auto name : *adjacent)
+    std::cout << name << "\n";
+
+  if( stats )
+    stats->add_counter("bytes read", input_file,
+                       static_cast<double>(buffer.size()));
+
+  return true;
+}
+
+
+/// The server that is stopped on SIGINT and SIGTERM.
+std::atomic<bbrd::GraphServer *> running_server{nullptr};
+static_assert(std::atomic<bbrd::GraphServer *>::is_always_lock_free,
+              "running_server is read in a signal handler");
+
+
+extern "C" void StopServer(int)
+{
+  // GraphServer::stop only writes to a pipe, which is async-signal-safe
+  if( auto server = running_server.load() )
+    server->stop();
+}
+
+
+/// Stops server on SIGINT and SIGTERM until destruction, also if the server
+/// throws. Must be destroyed before server.
+class StopServerOnSignal
+{
+public:
+  explicit StopServerOnSignal(bbrd::GraphServer& server) noexcept
+  {
+    running_server = &server;
+    std::signal(SIGINT, StopServer);
+    std::signal(SIGTERM, StopServer);
+  }
+
+  ~StopServerOnSignal()
+  {
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    running_server = nullptr;
+  }
+
+  StopServerOnSignal(StopServerOnSignal&&) = delete;
+  StopServerOnSignal(const StopServerOnSignal&) = delete;
+  StopServerOnSignal& operator=(StopServerOnSignal&&) = delete;
+  StopServerOnSignal& operator=(const StopServerOnSignal&) = delete;
+};
+
+
+/// Build the query that is sent to a server from the command line. An empty
+/// query lists all recipes.
+std::string ServerQuery(const bbrd::ProgramOptions& po)
+{
+  if( !po.contains("recipe") )
+    return "";
+
+  std::string query = po.contains("rdepends") ? "-r " : "-d ";
+  if( po.contains("transitive") )
+    query += "-t ";
+
+  return query + po.get("recipe");
+}
+
+
+/// Answer the query of the command line. The phases are recorded in stats,
+/// if any.
+int Run(const bbrd::ProgramOptions& po,
+        const bbrd::ErrorOutput& errout,
+        bbrd::Stats * stats)
+{
+  if( po.contains("connect") )
+  {
+    bbrd::Stats::Timer timer(stats, "query");
+    // The output is exactly the same as without a server
+    bbrd::QueryServer(po.get("connect"), ServerQuery(po), std::cout);
+    return EXIT_SUCCESS;
+  }
+
+  if( po.contains("serve") )
+  {
+    bbrd::GraphServer server(
+        po.get("serve"),
+        po.get("task-depends-dot"),
+        [&po, &errout, stats](){
+          return ReadDependencyGraph(
+              po, po.get("task-depends-dot"), errout, stats);
+        },
+        errout);
+    StopServerOnSignal stop_on_signal(server);
+    server.run();
+    return EXIT_SUCCESS;
+  }
+
+  if( po.contains("diff") )
+  {
+    // Both files are read at the same time
+    auto reading_old = std::async(std::launch::async, [&po, &errout, stats](){
+      return ReadDependencyGraph(po, po.get("diff"), errout, stats);
+    });
+    auto new_graph = ReadDependencyGraph(
+        po, po.get("task-depends-dot"), errout, stats);
+    auto old_graph = reading_old.get();
+    bbrd::Stats::Timer timer(stats, "diff");
+    auto diff = bbrd::GraphDiff::Compute(
+        old_graph.image(),
+        new_graph.image(),
+        po.contains("transitive"));
+    diff.print(std::cout);
+    return EXIT_SUCCESS;
+  }
+
+  if( po.contains("merge") )
+  {
+    ListMergedRecipes(po, errout, stats);
+    return EXIT_SUCCESS;
+  }
+
+  if( po.contains("recipe") && ListAdjacentRecipes(po, stats) )
+    return EXIT_SUCCESS;
+
+  auto graph = ReadDependencyGraph(
+      po, po.get("task-depends-dot"), errout, stats);
+  auto thread_count = po.contains("jobs") ? po.get<unsigned>("jobs") : 0;
+  bbrd::Stats::Timer timer(stats, "query");
+
+  if( po.contains("batch") )
+  {
+    auto batch_file = po.get("batch");
+    std::size_t failed = 0;
+    if( batch_file == "-" )
+    {
+      failed = bbrd::RunBatch(graph, std::cin, std::cout, thread_count);
+    }
+    else
+    {
+      std::ifstream batch(batch_file);
+      if( !batch )
+        throw bbrd::FileError("cannot access '" + batch_file + "'");
+      failed = bbrd::RunBatch(graph, batch, std::cout, thread_count);
+    }
+
+    if( failed )
+      return EXIT_FAILURE;
+  }
+  else if( po.contains("cycles") )
+  {
+    graph.list_cycles(std::cout);
+  }
+  else if( po.contains("export-dot") )
+  {
+    graph.export_dot(po.contains("reduce"), thread_count, std::cout);
+  }
+  else if( po.contains("schedule-profile") )
+  {
+    graph.print_schedule_profile(
+        po.contains("build-order"),
+        thread_count,
+        std::cout);
+  }
+  else if( po.contains("buildstats") )
+  {
+    auto buildstats = bbrd::Buildstats::Read(
+        po.get("buildstats"), thread_count);
+    auto durations = buildstats.match(graph.image());
+    // Durations that cannot be assigned to a task make the result
+    // incomplete
+    for(const auto& error : buildstats.errors)
+      errout.print("Warning", error);
+    for(const auto& unmatched : durations.unmatched)
+      errout.print("Warning", unmatched);
+    if( durations.matched == 0 )
+      throw bbrd::FileError(
+          "no task of '" + po.get("buildstats") + "' is part of the graph");
+
+    graph.print_critical_path(durations.seconds, thread_count, std::cout);
+  }
+  else if( po.contains("recipe") )
+  {
+    bool reverse = po.contains("rdepends");
+    std::string recipe = po.get("recipe");
+
+    if( po.contains("path") )
+    {
+      auto limit = po.contains("all-paths")
+        ? po.get<std::size_t>("all-paths") : 1;
+      if( !graph.list_paths(recipe, po.get("path"), limit, std::cout) )
+      {
+        errout.print("Error", "no dependency path from " + recipe + " to " +
+                              po.get("path"));
+        return EXIT_FAILURE;
+      }
+    }
+    else if( po.contains("depends-on") )
+      std::cout << ( graph.depends_on(recipe, po.get("depends-on"))
+                     ? "yes\n" : "no\n" );
+    else if( po.contains("transitive") )
+      graph.list_recipe_depends(
+          recipe,
+          reverse,
+          std::cout);
+    else
+      graph.list_adjacent_recipes(
+          recipe,
+          reverse,
+          std::cout);
+  }
+  else
+  {
+    graph.list(std::cout);
+  }
+
+  return EXIT_SUCCESS;
+}
+
+
+/// Print the stats to stderr with --stats or --stats-json, and write a trace
+/// with --stats-trace.
+void PrintStats(const bbrd::ProgramOptions& po, const bbrd::Stats& stats)
+{
+  if( po.contains("stats") )
+    stats.print(std::cerr);
+  else if( po.contains("stats-json") )
+    stats.print_json(std::cerr);
+
+  if( po.contains("stats-trace") )
+  {
+    auto trace_file = po.get("stats-trace");
+    std::ofstream trace(trace_file);
+    if( trace )
+      stats.write_trace(trace);
+    if( !trace )
+      throw bbrd::FileError("cannot write '" + trace_file + "'");
+  }
+}
+
+
+} // namespace
 
 
 int main(int argc, const char * argv[])
@@ -35,31 +466,17 @@ int main(int argc, const char * argv[])
       return EXIT_SUCCESS;
     }
 
-    auto input_file = po.get("task-depends-dot");
-    bbrd::DependencyGraph graph(
-        bbrd::Dependencies(
-          bbrd::ReadFileOrThrow(input_file)));
+    std::optional<bbrd::Stats> stats;
+    if( po.contains("stats") ||
+        po.contains("stats-json") ||
+        po.contains("stats-trace") )
+      stats.emplace();
 
-    if( po.contains("recipe") )
-    {
-      bool reverse = po.contains("rdepends");
-      std::string recipe = po.get("recipe");
-
-      if( po.contains("transitive") )
-        graph.list_recipe_depends(
-            recipe,
-            reverse,
-            std::cout);
-      else
-        graph.list_adjacent_recipes(
-            recipe,
-            reverse,
-            std::cout);
-    }
-    else
-    {
-      graph.list(std::cout);
-    }
+    auto status = Run(po, errout, stats ? &*stats : nullptr);
+    if( stats )
+      PrintStats(po, *stats);
+
+    return status;
   }
   catch( const bbrd::FileError& e )
   {
@@ -0,0 +1,134 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "DotGenerator.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+namespace {
+
+
+constexpr std::size_t flush_size = 1 << 20;
+
+constexpr std::array<const char *, 12> standard_tasks = {
+  "do_fetch",
+  "do_unpack",
+  "do_patch",
+  "do_prepare_recipe_sysroot",
+  "do_configure",
+  "do_compile",
+  "do_install",
+  "do_populate_sysroot",
+  "do_package",
+  "do_packagedata",
+  "do_package_write_rpm",
+  "do_build",
+};
+
+constexpr std::array<const char *, 6> name_prefixes = {
+  "lib",
+  "python3-",
+  "perl-",
+  "gstreamer1.0-plugins-",
+  "kernel-module-",
+  "",
+};
+
+
+std::string TaskName(std::size_t task)
+{
+  if( task < standard_tasks.size() )
+    return standard_tasks[task];
+
+  return "do_task_" + std::to_string(task);
+}
+
+
+/// Names of varying length, e.g. "python3-pkg42". Every fifth recipe is a
+/// native variant.
+std::string RecipeName(std::size_t recipe)
+{
+  // Recipe names must not contain "."
+  std::string prefix = name_prefixes[recipe % name_prefixes.size()];
+  std::replace(prefix.begin(), prefix.end(), '.', '-');
+  return prefix + "pkg" + std::to_string(recipe)
+       + ( recipe % 5 == 0 ? "-native" : "" );
+}
+
+
+} // namespace
+
+
+namespace bbrd {
+
+
+void GenerateDot(const DotGeneratorOptions& options, std::ostream& out)
+{
+  std::mt19937_64 random(options.seed);
+  auto tasks = std::max<std::size_t>(options.tasks_per_recipe, 1);
+  std::vector<std::string> task_names;
+  for(std::size_t t = 0; t < tasks; ++t)
+    task_names.push_back(TaskName(t));
+
+  // Other recipes are needed by do_prepare_recipe_sysroot and do_build
+  auto sysroot_task = std::min<std::size_t>(3, tasks - 1);
+  auto provided_task = std::min<std::size_t>(7, tasks - 1);
+
+  std::string buffer = "digraph depends {\n";
+  std::vector<std::size_t> dependencies;
+  for(std::size_t r = 0; r < options.recipes; ++r)
+  {
+    auto recipe = RecipeName(r);
+    auto path = "/build/layers/meta/recipes-" + recipe + "/" + recipe
+              + "_1.0.bb";
+    if( path.size() < options.label_length )
+      path.insert(1, std::string(options.label_length - path.size(), 'x'));
+
+    dependencies.clear();
+    for(std::size_t i = 0; r > 0 && i < options.fan_out; ++i)
+      dependencies.push_back(random() % r);
+
+    for(std::size_t t = 0; t < tasks; ++t)
+    {
+      auto node = "\"" + recipe + "." + task_names[t] + "\"";
+      buffer += node + " [label=\"" + recipe + " " + task_names[t]
+              + "\\n:1.0-r0\\n" + path + "\"]\n";
+      if( t > 0 )
+        buffer += node + " -> \"" + recipe + "." + task_names[t - 1] + "\"\n";
+
+      if( t == sysroot_task || t == tasks - 1 )
+        for(auto d : dependencies)
+          buffer += node + " -> \"" + RecipeName(d) + "."
+                  + task_names[t == sysroot_task ? provided_task : t]
+                  + "\"\n";
+    }
+
+    if( buffer.size() > flush_size )
+    {
+      out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+      buffer.clear();
+    }
+  }
+
+  buffer += "}\n";
+  out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+}
+
+std::string GenerateDot(const DotGeneratorOptions& options)
+{
+  std::ostringstream out;
+  GenerateDot(options, out);
+  return out.str();
+}
+
+
+} // namespace bbrd
+
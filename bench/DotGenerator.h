@@ -0,0 +1,43 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+
+namespace bbrd {
+
+
+struct DotGeneratorOptions
+{
+  std::size_t recipes = 1000;
+  /// do_fetch, do_unpack, ... up to do_build. More tasks are appended as
+  /// do_task_<n>.
+  std::size_t tasks_per_recipe = 12;
+  /// The number of recipes every recipe depends on.
+  std::size_t fan_out = 8;
+  /// The approximate length of the label of every task.
+  std::size_t label_length = 120;
+  std::uint64_t seed = 1;
+};
+
+
+/// Write a task-depends.dot in the format of `bitbake -g`: A node with a
+/// label for every task, followed by its dependencies. The tasks of a
+/// recipe depend on each other in a chain. A recipe depends on fan_out
+/// random recipes that were generated before it, through two task
+/// dependencies each, therefore the task graph is acyclic.
+///
+/// Output is written in large blocks, so it may be several GB.
+void GenerateDot(const DotGeneratorOptions& options, std::ostream& out);
+
+/// Same as above, in memory.
+std::string GenerateDot(const DotGeneratorOptions& options);
+
+
+} // namespace bbrd
+
@@ -0,0 +1,325 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "DotGenerator.h"
+
+#include <bbrd/Dependencies.h>
+#include <bbrd/DependencyGraph.h>
+#include <bbrd/File.h>
+#include <bbrd/GraphImage.h>
+#include <bbrd/RecipeInterner.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include <unistd.h>
+
+
+namespace {
+
+
+/// The number of calls to operator new, across all threads.
+std::atomic<std::size_t> allocations(0);
+
+
+} // namespace
+
+
+void * operator new(std::size_t size)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if( auto ptr = std::malloc(size ? size : 1) )
+    return ptr;
+
+  throw std::bad_alloc();
+}
+
+void operator delete(void * ptr) noexcept
+{
+  std::free(ptr);
+}
+
+void operator delete(void * ptr, std::size_t) noexcept
+{
+  std::free(ptr);
+}
+
+
+namespace {
+
+
+/// Discards everything, so that output benchmarks measure formatting only.
+class NullBuffer : public std::streambuf
+{
+protected:
+  int overflow(int c) override
+  { return c; }
+
+  std::streamsize xsputn(const char *, std::streamsize count) override
+  { return count; }
+};
+
+
+/// A task-depends.dot and what the phases of the pipeline need of it.
+struct Input
+{
+  std::string name;
+  /// A file with the contents of dot, for reading
+  std::string path;
+  bool remove_path;
+  std::string dot;
+  std::size_t dependency_count;
+  /// The recipe names of every dependency, in the order of the parser
+  std::vector<std::string_view> recipe_names;
+};
+
+
+Input MakeInput(std::string name, std::string path, bool remove_path)
+{
+  auto buffer = bbrd::ReadFileOrThrow(path);
+  Input input{std::move(name),
+              std::move(path),
+              remove_path,
+              std::string(buffer.view()),
+              0,
+              {}};
+
+  // A dependency is a line "recipe.task" -> "recipe.task"
+  std::string_view dot(input.dot);
+  for(auto arrow = dot.find("\" -> \"");
+      arrow != std::string_view::npos;
+      arrow = dot.find("\" -> \"", arrow + 1))
+  {
+    input.dependency_count++;
+    auto line = dot.rfind('\n', arrow) + 1;
+    auto to = dot.substr(line + 1, arrow - line - 1);
+    auto from = dot.substr(arrow + 6, dot.find('"', arrow + 6) - arrow - 6);
+    input.recipe_names.push_back(to.substr(0, to.find('.')));
+    input.recipe_names.push_back(from.substr(0, from.find('.')));
+  }
+
+  return input;
+}
+
+
+/// Report throughput in bytes and dependencies, and the allocations of
+/// every iteration.
+void SetCounters(benchmark::State& state,
+                 const Input& input,
+                 std::size_t allocations_before)
+{
+  auto allocated = allocations.load() - allocations_before;
+  state.SetBytesProcessed(
+      state.iterations() * static_cast<std::int64_t>(input.dot.size()));
+  state.counters["edges"] = benchmark::Counter(
+      static_cast<double>(input.dependency_count),
+      benchmark::Counter::kIsIterationInvariantRate);
+  state.counters["allocs"] = benchmark::Counter(
+      static_cast<double>(allocated),
+      benchmark::Counter::kAvgIterations);
+}
+
+
+void Read(benchmark::State& state, const Input * input)
+{
+  auto before = allocations.load();
+  for(auto _ : state)
+  {
+    auto buffer = bbrd::ReadFileOrThrow(input->path);
+    // Mapped pages are only read on access
+    std::size_t sum = 0;
+    for(std::size_t i = 0; i < buffer.size(); i += 4096)
+      sum += static_cast<unsigned char>(buffer.data()[i]);
+    benchmark::DoNotOptimize(sum);
+  }
+  SetCounters(state, *input, before);
+}
+
+void Parse(benchmark::State& state, const Input * input, unsigned threads)
+{
+  auto before = allocations.load();
+  for(auto _ : state)
+  {
+    // Like bb-depends-dot: The parser reads the mapped file
+    bbrd::Dependencies dependencies(
+        bbrd::ReadFileOrThrow(input->path), threads);
+    benchmark::DoNotOptimize(dependencies.distinct_recipe_count());
+  }
+  SetCounters(state, *input, before);
+}
+
+void Intern(benchmark::State& state, const Input * input)
+{
+  auto before = allocations.load();
+  for(auto _ : state)
+  {
+    bbrd::RecipeInterner interner;
+    // Like the parser: Consecutive dependencies often share a source
+    for(std::size_t i = 0; i < input->recipe_names.size(); i += 2)
+    {
+      benchmark::DoNotOptimize(
+          interner.get_or_create_cached(input->recipe_names[i]));
+      benchmark::DoNotOptimize(
+          interner.get_or_create(input->recipe_names[i + 1]));
+    }
+  }
+  SetCounters(state, *input, before);
+  state.SetItemsProcessed(
+      state.iterations()
+      * static_cast<std::int64_t>(input->recipe_names.size()));
+}
+
+void BuildGraph(benchmark::State& state, const Input * input)
+{
+  bbrd::Dependencies dependencies(input->dot, 1);
+  auto before = allocations.load();
+  for(auto _ : state)
+  {
+    auto image = bbrd::GraphImage::Build(dependencies);
+    benchmark::DoNotOptimize(image.recipe_count());
+  }
+  SetCounters(state, *input, before);
+}
+
+void Transitive(benchmark::State& state, const Input * input, bool reverse)
+{
+  bbrd::DependencyGraph graph{bbrd::Dependencies(input->dot, 1)};
+  // The last recipe depends on the most recipes, the first one is needed
+  // by the most recipes
+  auto recipe = graph.image().recipe_name(
+      reverse ? 0 : graph.image().recipe_count() - 1);
+  NullBuffer null;
+  std::ostream out(&null);
+  auto before = allocations.load();
+  for(auto _ : state)
+    graph.list_recipe_depends(recipe, reverse, out);
+  SetCounters(state, *input, before);
+}
+
+void Output(benchmark::State& state, const Input * input, bool dot)
+{
+  bbrd::DependencyGraph graph{bbrd::Dependencies(input->dot, 1)};
+  NullBuffer null;
+  std::ostream out(&null);
+  auto before = allocations.load();
+  for(auto _ : state)
+    if( dot )
+      graph.export_dot(false, 1, out);
+    else
+      graph.list(out);
+  SetCounters(state, *input, before);
+}
+
+
+void RegisterPhases(const Input& input)
+{
+  auto name = [&input](const char * phase){
+    return std::string(phase) + "/" + input.name;
+  };
+
+  benchmark::RegisterBenchmark(name("read").c_str(), Read, &input);
+  benchmark::RegisterBenchmark(name("parse").c_str(), Parse, &input, 1u);
+  benchmark::RegisterBenchmark(
+      name("parse_parallel").c_str(), Parse, &input, 0u)->UseRealTime();
+  benchmark::RegisterBenchmark(name("intern").c_str(), Intern, &input);
+  benchmark::RegisterBenchmark(
+      name("graph_build").c_str(), BuildGraph, &input);
+  benchmark::RegisterBenchmark(
+      name("bfs_depends").c_str(), Transitive, &input, false);
+  benchmark::RegisterBenchmark(
+      name("bfs_rdepends").c_str(), Transitive, &input, true);
+  benchmark::RegisterBenchmark(name("output_list").c_str(), Output, &input,
+                               false);
+  benchmark::RegisterBenchmark(name("output_dot").c_str(), Output, &input,
+                               true);
+}
+
+
+void PrintUsage(const char * program_name)
+{
+  std::cerr << "Usage: " << program_name
+            << " [--recipes=<n>...] [--input=<task-depends.dot>...]"
+               " [benchmark options]\n"
+               "  Without --recipes and --input, graphs with 1000 and"
+               " 10000 recipes are generated.\n";
+}
+
+
+} // namespace
+
+
+int main(int argc, char * argv[])
+{
+  benchmark::Initialize(&argc, argv);
+
+  std::vector<std::size_t> recipe_counts;
+  std::vector<std::string> files;
+  for(int i = 1; i < argc; ++i)
+  {
+    std::string_view arg(argv[i]);
+    if( arg.substr(0, 10) == "--recipes=" )
+      recipe_counts.push_back(std::stoul(std::string(arg.substr(10))));
+    else if( arg.substr(0, 8) == "--input=" )
+      files.emplace_back(arg.substr(8));
+    else
+    {
+      PrintUsage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if( recipe_counts.empty() && files.empty() )
+    recipe_counts = {1000, 10000};
+
+  // Registered benchmarks keep pointers to their input
+  std::vector<std::unique_ptr<Input>> inputs;
+  try
+  {
+    for(auto count : recipe_counts)
+    {
+      bbrd::DotGeneratorOptions options;
+      options.recipes = count;
+      auto path = ( std::filesystem::temp_directory_path()
+                  / ( "bb-depends-dot-bench-" + std::to_string(getpid())
+                    + "-" + std::to_string(count) + ".dot" ) ).string();
+      bbrd::WriteFileOrThrow(path, bbrd::GenerateDot(options));
+      inputs.push_back(std::make_unique<Input>(MakeInput(
+          "generated-" + std::to_string(count), path, true)));
+    }
+
+    for(const auto& file : files)
+      inputs.push_back(std::make_unique<Input>(MakeInput(file, file, false)));
+  }
+  catch( const std::exception& e )
+  {
+    std::cerr << argv[0] << ": Error: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  for(const auto& input : inputs)
+    RegisterPhases(*input);
+
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+
+  for(const auto& input : inputs)
+    if( input->remove_path )
+      std::remove(input->path.c_str());
+
+  return EXIT_SUCCESS;
+}
+
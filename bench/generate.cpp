@@ -0,0 +1,80 @@
+// Author: Thomas Trapp - https://thomastrapp.com/
+// License: MIT
+
+#include "DotGenerator.h"
+
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <ios>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <boost/program_options.hpp>
+
+
+int main(int argc, const char * argv[])
+{
+  namespace po = boost::program_options;
+  std::ios::sync_with_stdio(false);
+
+  bbrd::DotGeneratorOptions options;
+  po::options_description desc("Options");
+  desc.add_options()
+    ("recipes", po::value(&options.recipes)
+      ->default_value(options.recipes)->value_name("<n>"),
+      "Number of recipes")
+    ("tasks", po::value(&options.tasks_per_recipe)
+      ->default_value(options.tasks_per_recipe)->value_name("<n>"),
+      "Number of tasks of every recipe")
+    ("fan-out", po::value(&options.fan_out)
+      ->default_value(options.fan_out)->value_name("<n>"),
+      "Number of recipes every recipe depends on")
+    ("label-length", po::value(&options.label_length)
+      ->default_value(options.label_length)->value_name("<n>"),
+      "Approximate length of the label of every task")
+    ("seed", po::value(&options.seed)
+      ->default_value(options.seed)->value_name("<n>"),
+      "Seed of the random dependencies")
+    ("output,o", po::value<std::string>()->value_name("<file>"),
+      "Write to file instead of stdout")
+    ("help,h", "Print this help message")
+  ;
+
+  try
+  {
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    po::notify(vm);
+
+    if( vm.count("help") )
+    {
+      std::cout << argv[0] << " - Generate a task-depends.dot like"
+                << " `bitbake -g`.\n\n" << desc;
+      return EXIT_SUCCESS;
+    }
+
+    if( vm.count("output") )
+    {
+      std::ofstream out(vm["output"].as<std::string>(), std::ios::binary);
+      if( !out )
+        throw std::runtime_error(
+            "cannot open '" + vm["output"].as<std::string>() + "'");
+      bbrd::GenerateDot(options, out);
+      if( !out.flush() )
+        throw std::runtime_error("write failed");
+    }
+    else
+    {
+      bbrd::GenerateDot(options, std::cout);
+    }
+  }
+  catch( const std::exception& e )
+  {
+    std::cerr << argv[0] << ": Error: " << e.what() << "\n";
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,18 @@
+# Link a target with the compression libraries that are available. Inputs
+# compressed with a missing library are rejected at runtime.
+
+function(enable_compression target)
+  find_package(ZLIB)
+  if(ZLIB_FOUND)
+    target_compile_definitions(${target} PRIVATE BBRD_WITH_ZLIB)
+    target_link_libraries(${target} ZLIB::ZLIB)
+  endif()
+
+  find_path(ZSTD_INCLUDE_DIR zstd.h)
+  find_library(ZSTD_LIBRARY zstd)
+  if(ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY)
+    target_compile_definitions(${target} PRIVATE BBRD_WITH_ZSTD)
+    target_include_directories(${target} PRIVATE "${ZSTD_INCLUDE_DIR}")
+    target_link_libraries(${target} "${ZSTD_LIBRARY}")
+  endif()
+endfunction()
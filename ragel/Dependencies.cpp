@@ -4,13 +4,19 @@
 // License: MIT
 
 #include "bbrd/Dependencies.h"
+#include "bbrd/Scan.h"
 
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <future>
 #include <iterator>
-#include <stdexcept>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
 
 
 namespace bbrd {
@@ -24,7 +30,7 @@ namespace ragel {
 #pragma GCC diagnostic ignored "-Wunused-const-variable"
 #endif
   
-#line 28 "Dependencies.cpp"
+#line 34 "Dependencies.cpp"
 static const char _dot_actions[] = {
 	0, 1, 0, 1, 1, 1, 2, 1, 
 	3, 1, 6, 2, 4, 5
@@ -97,20 +103,19 @@ static const int dot_en_consume_line = 12;
 static const int dot_en_main = 13;
 
 
-#line 28 "Dependencies.cpp.rl"
+#line 34 "Dependencies.cpp.rl"
 
 #ifndef _MSC_VER
 #pragma GCC diagnostic pop
 #endif
 
 
-} // namespace ragel
-
-
-void Dependencies::extract_from_dot(const std::string& buffer)
+/// Run the dot machine over buffer and call push(to, to_task, from,
+/// from_task) for every dependency between two tasks. The task of a node
+/// without a task suffix is empty. The arguments are views into buffer.
+template<typename PushDependency>
+void ExtractFromDot(std::string_view buffer, PushDependency push)
 {
-  using namespace ragel;
-
   const char * p = buffer.data();
   const char * pe = buffer.data() + buffer.size();
   const char * eof = pe;
@@ -119,6 +124,7 @@ void Dependencies::extract_from_dot(const std::string& buffer)
   const char * recipe_name_begin = nullptr;
   std::string_view recipe_name;
   std::array<std::string_view, 2> stack;
+  std::array<std::string_view, 2> tasks;
 
   auto recipe_name_start = [&p, &recipe_name_begin](){
     recipe_name_begin = p;
@@ -138,13 +144,22 @@ void Dependencies::extract_from_dot(const std::string& buffer)
     );
   };
 
-  auto push_recipe = [&stack, &recipe_name](std::size_t i){
+  auto push_recipe = [&p, &stack, &tasks, &recipe_name](std::size_t i){
     stack.at(i) = recipe_name;
+
+    // The node ends with the quote before p. The task suffix starts with a
+    // dot after the recipe name.
+    auto recipe_end = recipe_name.data() + recipe_name.size();
+    auto node_end = p - 1;
+    tasks.at(i) = ( recipe_end < node_end && *recipe_end == '.' )
+      ? std::string_view(
+          recipe_end + 1,
+          static_cast<std::string_view::size_type>(node_end - recipe_end - 1))
+      : std::string_view();
   };
 
-  auto push_dependency = [&stack, this](){
-    if( stack.at(0).compare(stack.at(1)) != 0 )
-      this->add_dependency(stack.at(0), stack.at(1));
+  auto push_dependency = [&stack, &tasks, &push](){
+    push(stack.at(0), tasks.at(0), stack.at(1), tasks.at(1));
   };
 
 #ifndef _MSC_VER
@@ -155,12 +170,12 @@ void Dependencies::extract_from_dot(const std::string& buffer)
 #pragma GCC diagnostic ignored "-Wunreachable-code-break"
 #endif
   
-#line 159 "Dependencies.cpp"
+#line 174 "Dependencies.cpp"
 	{
 	cs = dot_start;
 	}
 
-#line 164 "Dependencies.cpp"
+#line 179 "Dependencies.cpp"
 	{
 	int _klen;
 	unsigned int _trans;
@@ -262,7 +277,7 @@ _match:
 #line 39 "dot-machine.rl"
 	{ p--; {cs = 12;goto _again;} }
 	break;
-#line 266 "Dependencies.cpp"
+#line 281 "Dependencies.cpp"
 		}
 	}
 
@@ -292,7 +307,7 @@ _again:
 		goto _test_eof;
 goto _again;} }
 	break;
-#line 296 "Dependencies.cpp"
+#line 311 "Dependencies.cpp"
 		}
 	}
 	}
@@ -300,36 +315,360 @@ goto _again;} }
 	_out: {}
 	}
 
-#line 89 "Dependencies.cpp.rl"
+#line 104 "Dependencies.cpp.rl"
 
 #ifndef _MSC_VER
 #pragma GCC diagnostic pop
 #endif
 }
 
-void Dependencies::add_dependency(std::string_view to, std::string_view from)
+
+} // namespace ragel
+
+
+namespace {
+
+
+/// Run the dot machine over the lines of buffer that may contain a dependency.
+/// A dependency must be on a single line containing "->", all other lines
+/// (e.g. node declarations with long labels) are skipped without stepping
+/// through the machine. Since the machine is back in its initial state at
+/// the start of every line, this yields the same dependencies as running the
+/// machine over the whole buffer.
+template<typename PushDependency>
+void ExtractFromEdgeLines(std::string_view buffer, PushDependency push)
+{
+  // Consecutive candidate lines are passed to the machine as a single run
+  std::size_t run_begin = 0;
+  std::size_t run_end = 0;
+  std::size_t pos = 0;
+  for(;;)
+  {
+    auto arrow = FindArrow(buffer, pos);
+    if( arrow == std::string_view::npos )
+      break;
+
+    // pos is always at the start of a line
+    auto line_begin = buffer.rfind('\n', arrow);
+    line_begin = ( line_begin == std::string_view::npos || line_begin < pos )
+      ? pos
+      : line_begin + 1;
+
+    auto line_end = buffer.find('\n', arrow);
+    line_end = ( line_end == std::string_view::npos )
+      ? buffer.size()
+      : line_end + 1;
+
+    if( line_begin != run_end )
+    {
+      ragel::ExtractFromDot(
+          buffer.substr(run_begin, run_end - run_begin), push);
+      run_begin = line_begin;
+    }
+
+    run_end = line_end;
+    pos = line_end;
+  }
+
+  ragel::ExtractFromDot(buffer.substr(run_begin, run_end - run_begin), push);
+}
+
+
+/// Add a dependency of the task to_task of recipe to on the task from_task of
+/// recipe from. Dependencies between tasks of the same recipe are only kept
+/// in tasks, if any. parsed_count counts all dependencies between tasks.
+void AddDependency(RecipeInterner& recipes,
+                   DependencySet& dependencies,
+                   std::optional<TaskDependencies>& tasks,
+                   std::size_t& parsed_count,
+                   std::string_view to,
+                   std::string_view to_task,
+                   std::string_view from,
+                   std::string_view from_task)
+{
+  parsed_count++;
+
+  // Ids are assigned in the order recipes are first seen. Dependencies come
+  // in runs from the same recipe, which is checked first.
+  if( to == from )
+  {
+    if( tasks )
+    {
+      auto id = recipes.get_or_create_cached(to);
+      tasks->add(id, to_task, id, from_task);
+    }
+    return;
+  }
+
+  auto to_id = recipes.get_or_create_cached(to);
+  auto from_id = recipes.get_or_create(from);
+  dependencies.add(to_id, from_id);
+  if( tasks )
+    tasks->add(to_id, to_task, from_id, from_task);
+}
+
+
+/// Inputs smaller than this are not worth the overhead of starting a thread.
+constexpr std::size_t min_bytes_per_thread = 4 << 20;
+
+
+/// Rough estimate of the bytes of input per distinct recipe, used to size the
+/// hash table of recipe names up front. Most bytes of task-depends.dot are
+/// labels and task dependencies within the same recipe.
+constexpr std::size_t bytes_per_recipe_estimate = 64 << 10;
+
+
+/// The dependencies of a part of the input. Ids are local to the part.
+class PartialDependencies
+{
+public:
+  PartialDependencies(std::size_t size, bool with_tasks)
+  : recipes_()
+  , dependencies_()
+  , tasks_()
+  , parsed_count_(0)
+  {
+    this->recipes_.reserve(size / bytes_per_recipe_estimate);
+    if( with_tasks )
+      this->tasks_.emplace();
+  }
+
+  void add_dependency(std::string_view to,
+                      std::string_view to_task,
+                      std::string_view from,
+                      std::string_view from_task)
+  {
+    AddDependency(this->recipes_, this->dependencies_, this->tasks_,
+                  this->parsed_count_, to, to_task, from, from_task);
+  }
+
+  /// Local recipe names in the order they were first seen.
+  const RecipeInterner::Names& names() const noexcept
+  { return this->recipes_.names(); }
+
+  const DependencySet& dependencies() const noexcept
+  { return this->dependencies_; }
+
+  const std::optional<TaskDependencies>& tasks() const noexcept
+  { return this->tasks_; }
+
+  std::size_t parsed_count() const noexcept
+  { return this->parsed_count_; }
+
+private:
+  RecipeInterner recipes_;
+  DependencySet dependencies_;
+  std::optional<TaskDependencies> tasks_;
+  std::size_t parsed_count_;
+};
+
+
+PartialDependencies ExtractPartialDependencies(std::string_view lines,
+                                               bool with_tasks)
+{
+  PartialDependencies partial(lines.size(), with_tasks);
+  ExtractFromEdgeLines(lines, [&partial](auto... nodes){
+    partial.add_dependency(nodes...);
+  });
+  return partial;
+}
+
+
+/// Split buffer into at most count parts of roughly equal size. Every part
+/// but the last ends with a newline.
+std::vector<std::string_view> SplitLines(std::string_view buffer,
+                                         std::size_t count)
+{
+  std::vector<std::string_view> parts;
+  auto part_size = buffer.size() / std::max<std::size_t>(count, 1);
+  while( parts.size() + 1 < count && buffer.size() > part_size )
+  {
+    auto newline = buffer.find('\n', part_size);
+    if( newline == std::string_view::npos )
+      break;
+
+    parts.push_back(buffer.substr(0, newline + 1));
+    buffer.remove_prefix(newline + 1);
+  }
+
+  if( !buffer.empty() || parts.empty() )
+    parts.push_back(buffer);
+
+  return parts;
+}
+
+
+} // namespace
+
+
+void Dependencies::extract_from_dot(std::string_view buffer)
 {
-  this->dependencies_.push_back({
-    this->get_or_create_id(to),
-    this->get_or_create_id(from)
+  ExtractFromEdgeLines(buffer, [this](auto... nodes){
+    this->add_dependency(nodes...);
   });
 }
 
-Dependencies::Id Dependencies::get_or_create_id(std::string_view recipe)
+void Dependencies::extract_from_dot_parallel(std::string_view buffer,
+                                             unsigned thread_count)
+{
+  this->recipes_.reserve(buffer.size() / bytes_per_recipe_estimate);
+
+  if( thread_count == 0 )
+    thread_count = static_cast<unsigned>(
+      std::min<std::size_t>(
+        std::max(std::thread::hardware_concurrency(), 1u),
+        buffer.size() / min_bytes_per_thread + 1));
+
+  auto parts = SplitLines(buffer, thread_count);
+  if( parts.size() < 2 )
+  {
+    this->extract_from_dot(buffer);
+    return;
+  }
+
+  // Every part is parsed on its own thread into local ids. The first part is
+  // parsed on the calling thread.
+  bool with_tasks = this->tasks_.has_value();
+  std::vector<std::future<PartialDependencies>> futures;
+  for(auto part = parts.begin() + 1; part != parts.end(); ++part)
+    futures.push_back(std::async(
+        std::launch::async, ExtractPartialDependencies, *part, with_tasks));
+
+  auto first = ExtractPartialDependencies(parts.front(), with_tasks);
+  this->merge(first.names(), first.dependencies(), first.tasks());
+  this->parsed_count_ += first.parsed_count();
+  for(auto& future : futures)
+  {
+    auto partial = future.get();
+    this->merge(partial.names(), partial.dependencies(), partial.tasks());
+    this->parsed_count_ += partial.parsed_count();
+  }
+}
+
+void Dependencies::merge(const RecipesById& names,
+                         const DependencySet& dependencies,
+                         const std::optional<TaskDependencies>& tasks)
 {
-  auto it = this->recipes_by_string_.find(recipe);
-  if( it == this->recipes_by_string_.end() )
+  // Merging the parts in input order and interning the local names in the
+  // order they were first seen assigns the same ids as a sequential parse.
+  std::vector<Id> global_ids;
+  global_ids.reserve(names.size());
+  for(auto name : names)
+    global_ids.push_back(this->recipes_.get_or_create(name));
+
+  auto multiplicity = dependencies.multiplicities().begin();
+  for(const auto& [to, from] : dependencies.dependencies())
+    this->dependencies_.add(global_ids[to], global_ids[from], *multiplicity++);
+
+  if( this->tasks_ && tasks )
+    this->tasks_->merge(*tasks, global_ids);
+}
+
+void Dependencies::extract_from_chunks(ChunkedReader& reader)
+{
+  // Lines may be split between chunks. The unfinished last line of a chunk is
+  // carried over and completed with the beginning of the next chunk. At the
+  // start of a line the dot machine is always back in its initial state,
+  // therefore the unfinished line is all the state that has to be carried
+  // over.
+  std::string carry;
+  std::string_view chunk;
+  while( reader.next(chunk) )
   {
-    auto ret = this->recipes_by_string_.insert({recipe, this->next_id_});
-    if( !ret.second )
-      throw std::runtime_error("map insert failed");
+    this->input_size_ += chunk.size();
+    auto last_newline = chunk.rfind('\n');
+    if( last_newline == std::string_view::npos )
+    {
+      carry.append(chunk);
+      continue;
+    }
+
+    std::size_t lines_begin = 0;
+    if( !carry.empty() )
+    {
+      lines_begin = chunk.find('\n') + 1;
+      carry.append(chunk.substr(0, lines_begin));
+      this->extract_from_dot(carry);
+      carry.clear();
+    }
+
+    auto lines_end = last_newline + 1;
+    this->extract_from_dot(chunk.substr(lines_begin, lines_end - lines_begin));
+    carry.assign(chunk.substr(lines_end));
+  }
+
+  this->extract_from_dot(carry);
+}
+
+std::optional<std::vector<std::string_view>> ScanAdjacentRecipes(
+    std::string_view buffer,
+    std::string_view recipe,
+    bool reverse)
+{
+  bool found = false;
+  std::vector<std::string_view> adjacent;
+  std::unordered_set<std::string_view> seen;
+  auto push = [&](std::string_view to,
+                  std::string_view,
+                  std::string_view from,
+                  std::string_view){
+    // Like AddDependency, dependencies within a recipe are ignored
+    if( to == from || ( to != recipe && from != recipe ) )
+      return;
+
+    found = true;
+    if( ( reverse ? from : to ) != recipe )
+      return;
+
+    auto other = reverse ? to : from;
+    if( seen.insert(other).second )
+      adjacent.push_back(other);
+  };
 
-    this->recipes_by_id_.push_back(recipe);
-    this->next_id_++;
-    return (ret.first)->second;
+  // Every node of recipe starts with a quote and the name
+  std::string needle = "\"" + std::string(recipe);
+  std::size_t pos = 0;
+  for(;;)
+  {
+    pos = FindString(buffer, needle, pos);
+    if( pos == std::string_view::npos )
+      break;
+
+    // The node must be "recipe" or "recipe.task", not "recipe-native"
+    auto name_end = pos + needle.size();
+    if( name_end < buffer.size() &&
+        buffer[name_end] != '.' &&
+        buffer[name_end] != '"' )
+    {
+      pos = name_end;
+      continue;
+    }
+
+    auto line_begin = buffer.rfind('\n', pos);
+    line_begin = ( line_begin == std::string_view::npos ) ? 0 : line_begin + 1;
+    auto line_end = buffer.find('\n', pos);
+    line_end = ( line_end == std::string_view::npos )
+      ? buffer.size()
+      : line_end + 1;
+
+    ragel::ExtractFromDot(
+        buffer.substr(line_begin, line_end - line_begin), push);
+    pos = line_end;
   }
 
-  return it->second;
+  if( !found )
+    return std::nullopt;
+
+  return adjacent;
+}
+
+void Dependencies::add_dependency(std::string_view to,
+                                  std::string_view to_task,
+                                  std::string_view from,
+                                  std::string_view from_task)
+{
+  AddDependency(this->recipes_, this->dependencies_, this->tasks_,
+                this->parsed_count_, to, to_task, from, from_task);
 }
 
 
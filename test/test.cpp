@@ -4,21 +4,59 @@
 #define CATCH_CONFIG_MAIN
 #define CATCH_CONFIG_FAST_COMPILE
 
+#include <bbrd/BatchQuery.h>
+#include <bbrd/Buildstats.h>
+#include <bbrd/bbrd.h>
+#include <bbrd/ClosureIndex.h>
+#include <bbrd/Condensation.h>
+#include <bbrd/Decompression.h>
 #include <bbrd/Dependencies.h>
 #include <bbrd/DependencyGraph.h>
+#include <bbrd/ErrorOutput.h>
+#include <bbrd/File.h>
+#include <bbrd/GraphCache.h>
+#include <bbrd/GraphDiff.h>
+#include <bbrd/GraphImage.h>
+#include <bbrd/MergedGraph.h>
+#include <bbrd/PathSearch.h>
+#include <bbrd/ReadGraph.h>
+#include <bbrd/RecipeInterner.h>
+#include <bbrd/Scan.h>
+#include <bbrd/Schedule.h>
+#include <bbrd/Server.h>
+#include <bbrd/Stats.h>
+#include <bbrd/Workers.h>
 
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
 #include <functional>
 #include <iterator>
 #include <sstream>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
 
 #include <catch2/catch.hpp>
 
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef BBRD_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BBRD_WITH_ZSTD
+#include <zstd.h>
+#endif
+
 
 namespace {
 
@@ -137,6 +175,87 @@ digraph depends {
   } // namespace simple_dot
 
 
+  /// A new file in the temporary directory, which is removed on destruction.
+  class TempFile
+  {
+  public:
+    explicit TempFile(std::string_view contents = "")
+    : path_((std::filesystem::temp_directory_path() / "bbrd-test-XXXXXX")
+                .string())
+    {
+      int fd = ::mkstemp(this->path_.data());
+      if( fd == -1 )
+        throw std::system_error(errno, std::generic_category(), "mkstemp");
+      ::close(fd);
+      this->write(contents);
+    }
+
+    ~TempFile()
+    {
+      std::remove(this->path_.c_str());
+    }
+
+    TempFile(TempFile&&) = delete;
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(TempFile&&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    const std::string& path() const noexcept
+    {
+      return this->path_;
+    }
+
+    /// Replace the contents of the file.
+    void write(std::string_view contents) const
+    {
+      std::ofstream file(this->path_, std::ios::out | std::ios::binary);
+      file << contents;
+    }
+
+    void append(std::string_view contents) const
+    {
+      std::ofstream file(this->path_,
+                         std::ios::out | std::ios::binary | std::ios::app);
+      file << contents;
+    }
+
+  private:
+    std::string path_;
+  };
+
+  /// A new directory in the temporary directory, which is removed with its
+  /// contents on destruction.
+  class TempDirectory
+  {
+  public:
+    TempDirectory()
+    : path_((std::filesystem::temp_directory_path() / "bbrd-test-XXXXXX")
+                .string())
+    {
+      if( !::mkdtemp(this->path_.data()) )
+        throw std::system_error(errno, std::generic_category(), "mkdtemp");
+    }
+
+    ~TempDirectory()
+    {
+      std::error_code ignored;
+      std::filesystem::remove_all(this->path_, ignored);
+    }
+
+    TempDirectory(TempDirectory&&) = delete;
+    TempDirectory(const TempDirectory&) = delete;
+    TempDirectory& operator=(TempDirectory&&) = delete;
+    TempDirectory& operator=(const TempDirectory&) = delete;
+
+    std::filesystem::path path() const
+    {
+      return this->path_;
+    }
+
+  private:
+    std::string path_;
+  };
+
   template<typename F>
   std::vector<std::string> run_and_extract(
       F func, const std::string& recipe, bool reverse)
@@ -264,3 +383,1478 @@ TEST_CASE("dependency-graph-test-data")
   }
 }
 
+TEST_CASE("read-file")
+{
+  REQUIRE_THROWS_AS( bbrd::ReadFileOrThrow("/nonexistent/task-depends.dot"),
+                     bbrd::FileError );
+
+  TempFile file(simple_dot::buffer);
+  const auto& path = file.path();
+
+  {
+    auto buffer = bbrd::ReadFileOrThrow(path);
+    REQUIRE( buffer.is_mapped() );
+    REQUIRE( buffer.view() == simple_dot::buffer );
+
+    // Recipe names are views into the mapping
+    bbrd::Dependencies deps(std::move(buffer));
+    REQUIRE( deps.distinct_recipe_count() ==
+             simple_dot::distinct_recipes.size() );
+    REQUIRE( deps.get_recipe_name(0) == "boost" );
+  }
+
+  file.write("");
+  auto empty = bbrd::ReadFileOrThrow(path);
+  REQUIRE( !empty.is_mapped() );
+  REQUIRE( empty.size() == 0 );
+}
+
+TEST_CASE("dependencies-from-chunks")
+{
+  TempFile file(simple_dot::buffer);
+
+  bbrd::Dependencies expected(simple_dot::buffer);
+
+  // Chunk sizes smaller than a line and chunks that end within a name
+  for( auto chunk_size : std::vector<std::size_t>{1, 2, 7, 13, 64, 1 << 20} )
+  {
+    INFO("Chunk size " << chunk_size)
+    bbrd::ChunkedReader reader(file.path(), chunk_size);
+    bbrd::Dependencies deps(reader);
+
+    REQUIRE( deps.distinct_recipe_count() ==
+             expected.distinct_recipe_count() );
+    REQUIRE( std::equal(deps.begin(), deps.end(),
+                        expected.begin(), expected.end()) );
+    for( bbrd::Dependencies::Id i = 0; i < deps.distinct_recipe_count(); ++i )
+      REQUIRE( deps.get_recipe_name(i) == expected.get_recipe_name(i) );
+  }
+}
+
+/// Read all chunks of the file at path.
+std::string ReadChunks(const std::string& path,
+                       std::size_t chunk_size,
+                       unsigned thread_count = 1)
+{
+  bbrd::ChunkedReader reader(path, chunk_size, thread_count);
+  std::string contents;
+  std::string_view chunk;
+  while( reader.next(chunk) )
+    contents.append(chunk);
+  return contents;
+}
+
+#ifdef BBRD_WITH_ZLIB
+/// Compress contents as a single gzip member.
+std::string Gzip(std::string_view contents)
+{
+  z_stream stream{};
+  // 15: largest window, 16: write a gzip header
+  REQUIRE( deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16,
+                        8, Z_DEFAULT_STRATEGY) == Z_OK );
+  std::string compressed(deflateBound(&stream, contents.size()), '\0');
+  stream.next_in = reinterpret_cast<Bytef *>(
+      const_cast<char *>(contents.data()));
+  stream.avail_in = static_cast<uInt>(contents.size());
+  stream.next_out = reinterpret_cast<Bytef *>(&compressed[0]);
+  stream.avail_out = static_cast<uInt>(compressed.size());
+  REQUIRE( deflate(&stream, Z_FINISH) == Z_STREAM_END );
+  compressed.resize(stream.total_out);
+  deflateEnd(&stream);
+  return compressed;
+}
+#endif
+
+#ifdef BBRD_WITH_ZSTD
+/// Compress contents as a single zstd frame.
+std::string Zstd(std::string_view contents)
+{
+  std::string compressed(ZSTD_compressBound(contents.size()), '\0');
+  auto size = ZSTD_compress(&compressed[0], compressed.size(),
+                            contents.data(), contents.size(), 3);
+  REQUIRE( !ZSTD_isError(size) );
+  compressed.resize(size);
+  return compressed;
+}
+#endif
+
+TEST_CASE("compressed-input")
+{
+  REQUIRE( bbrd::DetectCompression("\x1f\x8b\x08") ==
+           bbrd::Compression::gzip );
+  REQUIRE( bbrd::DetectCompression("\x28\xb5\x2f\xfd") ==
+           bbrd::Compression::zstd );
+  REQUIRE( bbrd::DetectCompression("digraph") == bbrd::Compression::none );
+  REQUIRE( bbrd::DetectCompression("\x1f") == bbrd::Compression::none );
+  REQUIRE( bbrd::DetectCompression("") == bbrd::Compression::none );
+
+  TempFile file;
+  const auto& path = file.path();
+  auto write = [&file](std::string_view contents){ file.write(contents); };
+
+  // Files shorter than the magic bytes are not compressed
+  write("\x1f");
+  REQUIRE( ReadChunks(path, 1) == "\x1f" );
+
+  std::string dot(simple_dot::buffer);
+  auto half = dot.find('\n', dot.size() / 2) + 1;
+  std::vector<std::string> compressed;
+#ifdef BBRD_WITH_ZLIB
+  // Two members, e.g. from `cat a.gz b.gz`
+  compressed.push_back(Gzip(dot.substr(0, half)) + Gzip(dot.substr(half)));
+#endif
+#ifdef BBRD_WITH_ZSTD
+  // Several frames, e.g. from `zstd -T0`
+  compressed.push_back(Zstd(dot.substr(0, 100))
+                     + Zstd(dot.substr(100, half - 100))
+                     + Zstd(dot.substr(half)));
+#endif
+
+  bbrd::Dependencies expected(simple_dot::buffer);
+  for(const auto& archive : compressed)
+  {
+    write(archive);
+    for(unsigned thread_count : {1u, 4u})
+      for(auto chunk_size : std::vector<std::size_t>{1, 7, 4096, 1 << 20})
+      {
+        INFO("Thread count " << thread_count << ", chunk size " << chunk_size)
+        REQUIRE( ReadChunks(path, chunk_size, thread_count) == dot );
+      }
+
+    bbrd::ChunkedReader reader(path);
+    bbrd::Dependencies deps(reader);
+    REQUIRE( std::equal(deps.begin(), deps.end(),
+                        expected.begin(), expected.end()) );
+
+    // A truncated archive is an error, not a shorter file
+    write(archive.substr(0, archive.size() - 5));
+    for(unsigned thread_count : {1u, 4u})
+      REQUIRE_THROWS_AS( ReadChunks(path, 4096, thread_count),
+                         bbrd::FileError );
+
+    write(archive.substr(0, bbrd::compression_magic_size)
+          + std::string(64, 'x'));
+    REQUIRE_THROWS_AS( ReadChunks(path, 4096), bbrd::FileError );
+  }
+}
+
+TEST_CASE("dependencies-parallel")
+{
+  bbrd::Dependencies expected(simple_dot::buffer, 1);
+
+  for( unsigned thread_count = 2; thread_count < 16; ++thread_count )
+  {
+    INFO("Thread count " << thread_count)
+    bbrd::Dependencies deps(simple_dot::buffer, thread_count);
+
+    // Ids are assigned in the same order as in a sequential parse
+    REQUIRE( deps.distinct_recipe_count() ==
+             expected.distinct_recipe_count() );
+    REQUIRE( std::equal(deps.begin(), deps.end(),
+                        expected.begin(), expected.end()) );
+    for( bbrd::Dependencies::Id i = 0; i < deps.distinct_recipe_count(); ++i )
+      REQUIRE( deps.get_recipe_name(i) == expected.get_recipe_name(i) );
+  }
+}
+
+TEST_CASE("find-arrow")
+{
+  REQUIRE( bbrd::FindArrow("", 0) == std::string_view::npos );
+  REQUIRE( bbrd::FindArrow("-", 0) == std::string_view::npos );
+  REQUIRE( bbrd::FindArrow("->", 0) == 0 );
+  REQUIRE( bbrd::FindArrow("->", 1) == std::string_view::npos );
+  REQUIRE( bbrd::FindArrow("- > >- -->", 0) == 8 );
+
+  // Arrows at every position relative to the vector width
+  for( std::size_t size = 2; size < 100; ++size )
+    for( std::size_t at = 0; at + 2 <= size; ++at )
+    {
+      std::string buffer(size, '-');
+      buffer.replace(at, 2, "->");
+      INFO("Size " << size << ", arrow at " << at)
+      REQUIRE( bbrd::FindArrow(buffer, 0) == at );
+      REQUIRE( bbrd::FindArrow(buffer, at) == at );
+      REQUIRE( bbrd::FindArrow(buffer, at + 1) == std::string_view::npos );
+    }
+}
+
+TEST_CASE("count-lines-without-arrow")
+{
+  REQUIRE( bbrd::CountLinesWithoutArrow("") == 0 );
+  REQUIRE( bbrd::CountLinesWithoutArrow("\n") == 1 );
+  REQUIRE( bbrd::CountLinesWithoutArrow("a") == 1 );
+  REQUIRE( bbrd::CountLinesWithoutArrow("a -> b") == 0 );
+  // Several dependencies on one line
+  REQUIRE( bbrd::CountLinesWithoutArrow("digraph {\n"
+                                        "a -> b -> c\n"
+                                        "d -> e; f -> g\n"
+                                        "}\n") == 2 );
+}
+
+TEST_CASE("find-string")
+{
+  REQUIRE( bbrd::FindString("", "\"a", 0) == std::string_view::npos );
+  REQUIRE( bbrd::FindString("\"", "\"a", 0) == std::string_view::npos );
+  REQUIRE( bbrd::FindString("\"a", "\"a", 0) == 0 );
+  REQUIRE( bbrd::FindString("\"b \"a", "\"a", 0) == 3 );
+
+  for( std::size_t size = 4; size < 100; ++size )
+    for( std::size_t at = 0; at + 4 <= size; ++at )
+    {
+      std::string buffer(size, '"');
+      buffer.replace(at, 4, "\"ab\"");
+      INFO("Size " << size << ", needle at " << at)
+      REQUIRE( bbrd::FindString(buffer, "\"ab\"", 0) == at );
+      REQUIRE( bbrd::FindString(buffer, "\"ab\"", at) == at );
+      REQUIRE( bbrd::FindString(buffer, "\"ab\"", at + 1)
+                 == std::string_view::npos );
+    }
+}
+
+TEST_CASE("scan-adjacent-recipes")
+{
+  auto graph = bbrd::DependencyGraph(bbrd::Dependencies(simple_dot::buffer));
+  for( bool reverse : {false, true} )
+    for( auto recipe : {"boost", "libc", "image", "htmlext", "libhext",
+                        "ragel", "boost-regex", "boost-program-options"} )
+    {
+      INFO("Recipe " << recipe << ", reverse " << reverse)
+      std::stringstream expected;
+      graph.list_adjacent_recipes(recipe, reverse, expected);
+      std::string scanned;
+      auto adjacent = bbrd::ScanAdjacentRecipes(
+          simple_dot::buffer, recipe, reverse);
+      REQUIRE( adjacent );
+      for( auto name : *adjacent )
+        scanned.append(name).append("\n");
+      REQUIRE( scanned == expected.str() );
+    }
+
+  REQUIRE_FALSE( bbrd::ScanAdjacentRecipes(simple_dot::buffer, "boo", false) );
+
+  // Labels, prefixes of other recipes and dependencies within a recipe
+  const char * dot = R"dot(
+"curl.do_fetch" [label="curl do_fetch\n:8.0-r0\n/curl.bb"]
+"curl-native.do_compile" -> "zlib-native.do_populate_sysroot"
+"curl.do_compile" -> "curl.do_configure"
+"curl.do_compile" -> "openssl.do_populate_sysroot"
+"curl.do_install" -> "openssl.do_populate_sysroot"
+"self.do_compile" -> "self.do_configure"
+)dot";
+  using V = std::vector<std::string_view>;
+  REQUIRE( bbrd::ScanAdjacentRecipes(dot, "curl", false) == V{"openssl"} );
+  REQUIRE( bbrd::ScanAdjacentRecipes(dot, "curl", true) == V{} );
+  REQUIRE( bbrd::ScanAdjacentRecipes(dot, "openssl", true) == V{"curl"} );
+  REQUIRE( bbrd::ScanAdjacentRecipes(dot, "curl-native", false)
+             == V{"zlib-native"} );
+  REQUIRE_FALSE( bbrd::ScanAdjacentRecipes(dot, "self", false) );
+  REQUIRE_FALSE( bbrd::ScanAdjacentRecipes(dot, "cur", false) );
+}
+
+TEST_CASE("dependencies-skip-lines")
+{
+  bbrd::Dependencies deps(
+    "\"a.do_x\" [label=\"a do_x\\n:1.0-r0\\n/a.bb\"]\n"
+    "\"b.do_x\" [label=\"-> b\"]\n"
+    "  \"a.do_x\" -> \"b.do_x\"\n"
+    "\"b.do_x\" -> \"c.do_x\"\n"
+    "\"c.do_x\" [label=\"c\"]\n"
+    "\"c.do_x\" -> \"d\"", 1);
+
+  REQUIRE( deps.distinct_recipe_count() == 4 );
+  std::vector<std::pair<std::string_view, std::string_view>> dependencies;
+  for( auto [to, from] : deps )
+    dependencies.push_back({deps.get_recipe_name(to),
+                            deps.get_recipe_name(from)});
+
+  using P = std::pair<std::string_view, std::string_view>;
+  REQUIRE( dependencies == std::vector<P>{{"a", "b"}, {"b", "c"}, {"c", "d"}} );
+}
+
+TEST_CASE("dependencies-unique")
+{
+  bbrd::Dependencies deps(R"dot(
+"a.do_compile" -> "b.do_populate_sysroot"
+"a.do_configure" -> "b.do_populate_sysroot"
+"a.do_compile" -> "a.do_configure"
+"b.do_compile" -> "a.do_populate_sysroot"
+"a.do_build" -> "b.do_build"
+)dot", 1);
+
+  auto dependency_count =
+      static_cast<std::size_t>(
+        std::distance(deps.begin(), deps.end())
+      );
+  REQUIRE( dependency_count == 2 );
+  REQUIRE( deps.task_dependency_count() == 4 );
+  REQUIRE( deps.multiplicities() == std::vector<std::uint32_t>{3, 1} );
+
+  // Multiplicities are summed up when merging parts parsed in parallel
+  for( unsigned thread_count = 2; thread_count < 6; ++thread_count )
+  {
+    INFO("Thread count " << thread_count)
+    bbrd::Dependencies parallel_deps(R"dot(
+"a.do_compile" -> "b.do_populate_sysroot"
+"a.do_configure" -> "b.do_populate_sysroot"
+"a.do_compile" -> "a.do_configure"
+"b.do_compile" -> "a.do_populate_sysroot"
+"a.do_build" -> "b.do_build"
+)dot", thread_count);
+    REQUIRE( std::equal(deps.begin(), deps.end(),
+                        parallel_deps.begin(), parallel_deps.end()) );
+    REQUIRE( parallel_deps.multiplicities() == deps.multiplicities() );
+  }
+}
+
+
+TEST_CASE("recipe-interner")
+{
+  bbrd::RecipeInterner interner;
+  REQUIRE( interner.size() == 0 );
+  REQUIRE( !interner.find("a").has_value() );
+  REQUIRE( interner.get_or_create("a") == 0 );
+  REQUIRE( interner.get_or_create_cached("b") == 1 );
+  REQUIRE( interner.get_or_create_cached("b") == 1 );
+  REQUIRE( interner.get_or_create_cached("a") == 0 );
+  REQUIRE( interner.get_or_create("") == 2 );
+  REQUIRE( interner.find("") == 2 );
+
+  // Growing the hash table keeps all ids
+  std::vector<std::string> names;
+  for( std::size_t i = 0; i < 5000; ++i )
+    names.push_back("recipe-" + std::to_string(i));
+  for( const auto& name : names )
+    interner.get_or_create(name);
+
+  REQUIRE( interner.size() == names.size() + 3 );
+  for( std::size_t i = 0; i < names.size(); ++i )
+  {
+    REQUIRE( interner.find(names[i]) == i + 3 );
+    REQUIRE( interner.names()[i + 3] == names[i] );
+  }
+
+  // Copied names do not refer to the original
+  bbrd::RecipeInterner copying(true);
+  std::string name = "curl";
+  copying.get_or_create(name);
+  name = "wget";
+  REQUIRE( copying.names().front() == "curl" );
+  REQUIRE( copying.find("curl") == 0 );
+  REQUIRE( !copying.find("wget").has_value() );
+}
+
+TEST_CASE("graph-image")
+{
+  bbrd::Dependencies deps(simple_dot::buffer);
+  auto image = bbrd::GraphImage::Build(deps);
+  REQUIRE( image.recipe_count() == deps.distinct_recipe_count() );
+  REQUIRE( image.dependency_count() ==
+           static_cast<std::size_t>(std::distance(deps.begin(), deps.end())) );
+  REQUIRE_THROWS_AS( image.recipe_name(image.recipe_count()),
+                     std::out_of_range );
+  REQUIRE( !image.find("nope").has_value() );
+
+  // A copy of the raw image is equivalent to the original
+  bbrd::GraphImage copy(bbrd::FileBuffer(std::string(image.bytes())));
+  for( auto recipe : simple_dot::distinct_recipes )
+  {
+    auto id = deps.get_recipe_id(recipe);
+    REQUIRE( image.find(recipe) == id );
+    REQUIRE( copy.find(recipe) == id );
+    REQUIRE( copy.recipe_name(*id) == recipe );
+  }
+
+  // Out edges of a vertex are in the order the dependencies were parsed
+  auto htmlext = *copy.find("htmlext");
+  auto forward = copy.forward();
+  std::vector<std::string_view> names;
+  for( auto it = forward.targets_begin(htmlext);
+       it != forward.targets_end(htmlext);
+       ++it )
+    names.push_back(copy.recipe_name(*it));
+  REQUIRE( names ==
+           std::vector<std::string_view>{"libhext", "boost-program-options"} );
+
+  REQUIRE_THROWS_AS( bbrd::GraphImage(bbrd::FileBuffer("")),
+                     bbrd::GraphImageError );
+  std::string truncated(image.bytes().substr(0, image.bytes().size() - 1));
+  REQUIRE_THROWS_AS( bbrd::GraphImage(bbrd::FileBuffer(truncated)),
+                     bbrd::GraphImageError );
+
+  // Ids out of range are rejected
+  std::string corrupt(image.bytes());
+  auto first_target = static_cast<std::size_t>(
+      reinterpret_cast<const char *>(image.forward().targets_begin(0))
+      - image.bytes().data());
+  std::fill_n(corrupt.begin() + static_cast<std::ptrdiff_t>(first_target),
+              sizeof(bbrd::GraphImage::Id),
+              '\xff');
+  REQUIRE_THROWS_AS( bbrd::GraphImage(bbrd::FileBuffer(corrupt)),
+                     bbrd::GraphImageError );
+
+  bbrd::GraphImage empty = bbrd::GraphImage::Build(bbrd::Dependencies(""));
+  REQUIRE( empty.recipe_count() == 0 );
+  REQUIRE( !empty.find("").has_value() );
+}
+
+TEST_CASE("condensation")
+{
+  const char * dot = R"dot(
+"a" -> "b"
+"b" -> "c"
+"c" -> "a"
+"c" -> "d"
+"d" -> "e"
+"e" -> "d"
+"f" -> "a"
+)dot";
+  bbrd::Dependencies deps(dot);
+  auto image = bbrd::GraphImage::Build(deps);
+  const auto& condensation = image.condensation();
+  REQUIRE( condensation.component_count() == 3 );
+
+  auto component = [&](const char * recipe){
+    return condensation.component_of(*image.find(recipe));
+  };
+  REQUIRE( component("a") == component("b") );
+  REQUIRE( component("a") == component("c") );
+  REQUIRE( component("d") == component("e") );
+  REQUIRE( condensation.member_count(component("a")) == 3 );
+  REQUIRE( condensation.member_count(component("f")) == 1 );
+
+  // Successors have smaller numbers
+  REQUIRE( component("d") < component("a") );
+  REQUIRE( component("a") < component("f") );
+  auto forward = condensation.forward();
+  REQUIRE( out_degree(component("a"), forward) == 1 );
+  REQUIRE( out_degree(component("d"), forward) == 0 );
+  auto reverse = condensation.reverse();
+  REQUIRE( *reverse.targets_begin(component("d")) == component("a") );
+
+  // The image is validated with its condensation
+  bbrd::GraphImage copy(bbrd::FileBuffer(std::string(image.bytes())));
+  REQUIRE( copy.condensation().component_count() == 3 );
+
+  bbrd::DependencyGraph graph(std::move(image));
+  std::stringstream cycles;
+  graph.list_cycles(cycles);
+  REQUIRE( cycles.str() == "d e\na b c\n" );
+
+  std::vector<std::string> dependencies;
+  std::stringstream out;
+  graph.list_recipe_depends("b", false, out);
+  for(std::string line; std::getline(out, line);)
+    dependencies.push_back(line);
+  std::sort(dependencies.begin(), dependencies.end());
+  REQUIRE( dependencies == std::vector<std::string>{"a", "c", "d", "e"} );
+
+  std::stringstream acyclic;
+  bbrd::DependencyGraph(bbrd::Dependencies(simple_dot::buffer))
+    .list_cycles(acyclic);
+  REQUIRE( acyclic.str().empty() );
+}
+
+TEST_CASE("closure-index")
+{
+  std::string cyclic = R"dot(
+"a" -> "b"
+"b" -> "c"
+"c" -> "a"
+"c" -> "d"
+"f" -> "a"
+)dot";
+  // Enough components to build the closure in parallel
+  for(int i = 0; i < 2000; ++i)
+    cyclic += "\"n" + std::to_string(i) + "\" -> \"n"
+            + std::to_string(i / 2) + "\"\n";
+
+  for( auto dot : {std::string(simple_dot::buffer), cyclic} )
+  {
+    auto plain = bbrd::DependencyGraph(bbrd::Dependencies(dot));
+    bbrd::DependencyGraph indexed(plain.image().with_closure(4));
+    REQUIRE( !plain.image().has_closure() );
+    REQUIRE( indexed.image().has_closure() );
+
+    // The closure survives a round trip through the raw image
+    bbrd::DependencyGraph copy(bbrd::GraphImage(bbrd::FileBuffer(
+        std::string(indexed.image().bytes()))));
+    REQUIRE( copy.image().has_closure() );
+
+    for(std::size_t id = 0; id < plain.image().recipe_count(); ++id)
+    {
+      auto recipe = std::string(plain.image().recipe_name(id));
+      INFO("recipe " << recipe)
+      for( bool reverse : {false, true} )
+      {
+        // The order does not depend on the index
+        auto list = [reverse, &recipe](const bbrd::DependencyGraph& graph){
+          std::stringstream out;
+          graph.list_recipe_depends(recipe, reverse, out);
+          return out.str();
+        };
+        auto expected = list(plain);
+        REQUIRE( list(indexed) == expected );
+        REQUIRE( list(copy) == expected );
+      }
+    }
+  }
+
+  auto plain = bbrd::DependencyGraph(bbrd::Dependencies(cyclic));
+  bbrd::DependencyGraph indexed(plain.image().with_closure(1));
+  for( const auto * graph : {&plain, &indexed} )
+  {
+    REQUIRE( graph->depends_on("a", "d") );
+    REQUIRE( graph->depends_on("c", "b") );
+    REQUIRE( graph->depends_on("f", "d") );
+    REQUIRE( graph->depends_on("n1999", "n0") );
+    REQUIRE( !graph->depends_on("a", "a") );
+    REQUIRE( !graph->depends_on("d", "a") );
+    REQUIRE( !graph->depends_on("a", "f") );
+    REQUIRE( !graph->depends_on("n0", "n1999") );
+    REQUIRE_THROWS( graph->depends_on("a", "nope") );
+  }
+}
+
+TEST_CASE("path-search")
+{
+  auto graph = bbrd::DependencyGraph(bbrd::Dependencies(simple_dot::buffer));
+  auto paths = [&graph](const char * from, const char * to, std::size_t k){
+    std::stringstream out;
+    auto count = graph.list_paths(from, to, k, out);
+    REQUIRE( count == static_cast<std::size_t>(
+                 std::count(std::istreambuf_iterator<char>(out.rdbuf()),
+                            std::istreambuf_iterator<char>(),
+                            '\n')) );
+    return out.str();
+  };
+
+  REQUIRE( paths("image", "htmlext", 1) == "image -> htmlext\n" );
+  REQUIRE( paths("htmlext", "boost", 1) ==
+           "htmlext -> boost-program-options -> boost\n" );
+  REQUIRE( paths("image", "libc", 5) ==
+           "image -> htmlext -> boost-program-options -> boost -> libc\n" );
+  REQUIRE( paths("libc", "image", 5).empty() );
+  REQUIRE( paths("image", "image", 5).empty() );
+  REQUIRE( paths("image", "libc", 0).empty() );
+  REQUIRE_THROWS( paths("image", "nope", 1) );
+
+  // Two shortest paths of the same length
+  bbrd::DependencyGraph diamond(bbrd::Dependencies(R"dot(
+"a" -> "b"
+"a" -> "c"
+"b" -> "d"
+"c" -> "d"
+"d" -> "e"
+"a" -> "x"
+"x" -> "y"
+"y" -> "z"
+"z" -> "e"
+)dot"));
+  std::stringstream out;
+  REQUIRE( diamond.list_paths("a", "e", 10, out) == 2 );
+  REQUIRE( out.str() == "a -> b -> d -> e\na -> c -> d -> e\n" );
+  std::stringstream limited;
+  REQUIRE( diamond.list_paths("a", "e", 1, limited) == 1 );
+
+  // The bidirectional search finds paths as short as a plain search
+  std::string tree;
+  for(int i = 1; i < 3000; ++i)
+    tree += "\"n" + std::to_string(i) + "\" -> \"n"
+          + std::to_string(i / 3) + "\"\n";
+  tree += "\"n0\" -> \"n2999\"\n";
+  auto image = bbrd::GraphImage::Build(bbrd::Dependencies(tree));
+  auto from = *image.find("n2998");
+  for(auto to : {*image.find("n0"), *image.find("n2999"), *image.find("n4")})
+  {
+    std::vector<std::uint32_t> distance(image.recipe_count(), 0);
+    std::vector<bbrd::CsrGraph::Vertex> queue(1, from);
+    std::vector<bool> seen(image.recipe_count(), false);
+    seen[from] = true;
+    for(std::size_t i = 0; i < queue.size(); ++i)
+      for(auto w = image.forward().targets_begin(queue[i]);
+          w != image.forward().targets_end(queue[i]);
+          ++w)
+        if( !seen[*w] )
+        {
+          seen[*w] = true;
+          distance[*w] = distance[queue[i]] + 1;
+          queue.push_back(*w);
+        }
+
+    auto path = bbrd::ShortestPath(image.forward(), image.reverse(), from, to);
+    REQUIRE( path.size() == distance[to] + 1 );
+    REQUIRE( path.front() == from );
+    REQUIRE( path.back() == to );
+    for(std::size_t i = 0; i + 1 < path.size(); ++i)
+    {
+      auto targets = image.forward();
+      REQUIRE( std::find(targets.targets_begin(path[i]),
+                         targets.targets_end(path[i]),
+                         path[i + 1]) != targets.targets_end(path[i]) );
+    }
+  }
+}
+
+TEST_CASE("task-graph")
+{
+  std::string dot = R"dot(
+digraph depends {
+"curl.do_compile" [label="curl do_compile\n:7.0-r0\n/path/curl.bb"]
+"curl.do_compile" -> "curl.do_configure"
+"curl.do_configure" -> "openssl.do_populate_sysroot"
+"curl.do_configure" -> "zlib.do_populate_sysroot"
+"openssl.do_populate_sysroot" -> "openssl.do_install"
+"openssl.do_install" -> "openssl.do_compile"
+"openssl.do_compile" -> "zlib.do_populate_sysroot"
+"openssl.do_compile" -> "zlib.do_populate_sysroot"
+"lonely.do_build" -> "lonely.do_compile"
+}
+)dot";
+  auto lines = [](auto query){
+    std::stringstream out;
+    query(out);
+    std::vector<std::string> result;
+    for(std::string line; std::getline(out, line);)
+      result.push_back(line);
+    std::sort(result.begin(), result.end());
+    return result;
+  };
+  using Lines = std::vector<std::string>;
+
+  bbrd::DependencyGraph recipes_only{bbrd::Dependencies(dot)};
+  bbrd::DependencyGraph graph{bbrd::Dependencies(dot, 1, true)};
+  REQUIRE( !recipes_only.image().has_tasks() );
+  REQUIRE( graph.image().has_tasks() );
+  REQUIRE( graph.image().task_count() == 8 );
+
+  // Recipes are the same with and without tasks
+  auto list = [&lines](const bbrd::DependencyGraph& g){
+    return lines([&g](auto& out){ g.list(out); });
+  };
+  REQUIRE( list(graph) == Lines{"curl", "openssl", "zlib"} );
+  REQUIRE( list(graph) == list(recipes_only) );
+
+  auto adjacent = [&](const char * selector, bool reverse){
+    return lines([&](auto& out){
+      graph.list_adjacent_recipes(selector, reverse, out);
+    });
+  };
+  auto transitive = [&](const char * selector, bool reverse){
+    return lines([&](auto& out){
+      graph.list_recipe_depends(selector, reverse, out);
+    });
+  };
+  REQUIRE( adjacent("curl:do_configure", false) ==
+           Lines{"openssl:do_populate_sysroot", "zlib:do_populate_sysroot"} );
+  REQUIRE( adjacent("zlib:do_populate_sysroot", true) ==
+           Lines{"curl:do_configure", "openssl:do_compile"} );
+  REQUIRE( adjacent("lonely:do_build", false) == Lines{"lonely:do_compile"} );
+  REQUIRE( transitive("curl:do_compile", false) ==
+           Lines{"curl:do_configure",
+                 "openssl:do_compile",
+                 "openssl:do_install",
+                 "openssl:do_populate_sysroot",
+                 "zlib:do_populate_sysroot"} );
+  REQUIRE( transitive("openssl:do_install", true) ==
+           Lines{"curl:do_compile",
+                 "curl:do_configure",
+                 "openssl:do_populate_sysroot"} );
+  REQUIRE( transitive("curl", false) == Lines{"openssl", "zlib"} );
+  // The tasks of lonely only depend on each other
+  REQUIRE_THROWS( transitive("lonely", false) );
+  std::stringstream none;
+  REQUIRE_THROWS( recipes_only.list_recipe_depends("lonely", false, none) );
+  REQUIRE( !graph.find("lonely") );
+
+  REQUIRE( graph.depends_on("curl:do_compile", "openssl:do_compile") );
+  REQUIRE( !graph.depends_on("openssl:do_compile", "curl:do_compile") );
+  REQUIRE_THROWS( graph.depends_on("curl:do_compile", "curl:nope") );
+  REQUIRE_THROWS( graph.depends_on("curl:do_compile", "nope:do_compile") );
+  REQUIRE_THROWS( recipes_only.depends_on("curl:do_compile", "zlib:x") );
+
+  std::stringstream path;
+  REQUIRE( graph.list_paths("curl:do_compile", "openssl:do_install", 5, path)
+           == 1 );
+  REQUIRE( path.str() == "curl:do_compile -> curl:do_configure"
+                         " -> openssl:do_populate_sysroot"
+                         " -> openssl:do_install\n" );
+
+  // The task dependencies behind every step of a chain of recipes
+  std::stringstream recipe_path;
+  REQUIRE( graph.list_paths("curl", "zlib", 5, recipe_path) == 1 );
+  REQUIRE( recipe_path.str() == "curl -> zlib\n"
+           "  curl:do_configure -> zlib:do_populate_sysroot\n" );
+
+  // Parsing in parts yields the same image, which survives a round trip
+  std::string big;
+  for(int i = 0; i < 500; ++i)
+    big += "\"r" + std::to_string(i) + ".do_compile\" -> \"r"
+         + std::to_string(i / 2) + ".do_task" + std::to_string(i % 7)
+         + "\"\n";
+  auto sequential = bbrd::GraphImage::Build(bbrd::Dependencies(big, 1, true));
+  auto parallel = bbrd::GraphImage::Build(bbrd::Dependencies(big, 4, true));
+  REQUIRE( sequential.bytes() == parallel.bytes() );
+  bbrd::GraphImage copy(bbrd::FileBuffer(std::string(parallel.bytes())));
+  REQUIRE( copy.task_count() == parallel.task_count() );
+  auto task = copy.find_task(*copy.find("r3"), "do_task6");
+  REQUIRE( task.has_value() );
+  REQUIRE( copy.task_name(*task) == "do_task6" );
+  REQUIRE( copy.recipe_name(copy.task_recipe(*task)) == "r3" );
+}
+
+TEST_CASE("schedule")
+{
+  bbrd::DependencyGraph graph{bbrd::Dependencies(R"dot(
+"curl.do_compile" -> "curl.do_configure"
+"curl.do_configure" -> "openssl.do_populate_sysroot"
+"curl.do_configure" -> "zlib.do_populate_sysroot"
+"openssl.do_populate_sysroot" -> "openssl.do_compile"
+"openssl.do_compile" -> "zlib.do_populate_sysroot"
+"curl.do_build" -> "curl.do_compile"
+)dot", 1, true)};
+  const auto& image = graph.image();
+  auto schedule = bbrd::Schedule::Compute(image.task_forward(),
+                                          image.task_reverse());
+  auto task = [&image](const char * recipe, const char * name){
+    return *image.find_task(*image.find(recipe), name);
+  };
+
+  REQUIRE( schedule.level_count() == 6 );
+  REQUIRE( schedule.level_of[task("zlib", "do_populate_sysroot")] == 0 );
+  REQUIRE( schedule.level_of[task("openssl", "do_compile")] == 1 );
+  REQUIRE( schedule.level_of[task("curl", "do_configure")] == 3 );
+  REQUIRE( schedule.level_of[task("curl", "do_build")] == 5 );
+  for(std::size_t l = 0; l < schedule.level_count(); ++l)
+    REQUIRE( schedule.level_width(l) == 1 );
+  REQUIRE( schedule.critical_path == bbrd::Path{
+      task("zlib", "do_populate_sysroot"),
+      task("openssl", "do_compile"),
+      task("openssl", "do_populate_sysroot"),
+      task("curl", "do_configure"),
+      task("curl", "do_compile"),
+      task("curl", "do_build")} );
+
+  std::stringstream profile;
+  graph.print_schedule_profile(true, 1, profile);
+  auto text = profile.str();
+  REQUIRE( text.find("levels: 6\n") != std::string::npos );
+  REQUIRE( text.find("critical path recipes: zlib openssl curl\n")
+           != std::string::npos );
+  REQUIRE( text.find("  5 curl:do_build\n") != std::string::npos );
+
+  // Wide levels are processed by several threads, with the same result
+  std::string dot;
+  for(int i = 0; i < 20000; ++i)
+    dot += "\"r" + std::to_string(i) + ".do_compile\" -> \"r"
+         + std::to_string(i % 3000) + ".do_fetch\"\n"
+         + "\"r" + std::to_string(i) + ".do_build\" -> \"r"
+         + std::to_string(i) + ".do_compile\"\n";
+  auto wide = bbrd::GraphImage::Build(bbrd::Dependencies(dot, 1, true));
+  auto sequential = bbrd::Schedule::Compute(
+      wide.task_forward(), wide.task_reverse(), 1);
+  auto parallel = bbrd::Schedule::Compute(
+      wide.task_forward(), wide.task_reverse(), 4);
+  REQUIRE( sequential.level_count() == 3 );
+  REQUIRE( sequential.level_width(0) == 3000 );
+  REQUIRE( sequential.level_of == parallel.level_of );
+  REQUIRE( sequential.order == parallel.order );
+  REQUIRE( sequential.critical_path == parallel.critical_path );
+
+  bbrd::DependencyGraph cyclic{bbrd::Dependencies(R"dot(
+"a.do_compile" -> "b.do_compile"
+"b.do_compile" -> "a.do_compile"
+)dot", 1, true)};
+  std::stringstream ignored;
+  REQUIRE_THROWS( cyclic.print_schedule_profile(false, 1, ignored) );
+  bbrd::DependencyGraph recipes_only{bbrd::Dependencies(R"dot(
+"a.do_compile" -> "b.do_compile"
+)dot")};
+  REQUIRE_THROWS( recipes_only.print_schedule_profile(false, 1, ignored) );
+}
+
+TEST_CASE("run-workers")
+{
+  for( std::size_t count : {0u, 1u, 2u, 8u} )
+  {
+    INFO("Count " << count)
+    std::vector<std::atomic<int>> calls(std::max<std::size_t>(count, 1));
+    bbrd::RunWorkers(count, [&calls](std::size_t i){ calls[i]++; });
+    for( const auto& c : calls )
+      REQUIRE( c == 1 );
+  }
+
+  // The started threads are joined before an exception of worker(0) leaves
+  std::vector<std::atomic<int>> calls(4);
+  REQUIRE_THROWS_AS(
+      bbrd::RunWorkers(calls.size(), [&calls](std::size_t i){
+        if( i == 0 )
+          throw std::runtime_error("worker 0");
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        calls[i]++;
+      }),
+      std::runtime_error);
+  for( std::size_t i = 1; i < calls.size(); ++i )
+    REQUIRE( calls[i] == 1 );
+}
+
+TEST_CASE("buildstats")
+{
+  namespace fs = std::filesystem;
+  TempDirectory directory;
+  auto root = directory.path();
+  auto write = [&root](const char * file, const char * contents){
+    fs::create_directories((root / file).parent_path());
+    std::ofstream(root / file) << contents;
+  };
+  // The later build wins
+  write("1/zlib-1.2-r0/do_compile", "Elapsed time: 99.00 seconds\n");
+  write("2/zlib-1.2-r0/do_compile",
+        "Event: TaskStarted\nStarted: 1.00\nElapsed time: 5.00 seconds\n"
+        "Ended: 6.00\nStatus: PASSED\n");
+  write("2/zlib-1.2-r0/do_populate_sysroot", "Elapsed time: 1.00 seconds\n");
+  write("2/openssl-3.0-r0/do_compile", "Elapsed time: 10.00 seconds\n");
+  write("2/curl-7.1-r0/do_compile", "Elapsed time: 2.00 seconds\n");
+  write("2/curl-7.1-r0/do_install", "Event: TaskStarted\nStarted: 1.00\n");
+  write("2/gcc-cross-i686-12.2.0-r0/do_compile",
+        "Elapsed time: 3.00 seconds\n");
+  write("2/gcc-12.2.0-r0/do_compile", "Elapsed time: 1.00 seconds\n");
+  write("2/gcc-12.2.0-r0/do_fetch", "Elapsed time: 1.00 seconds\n");
+  write("2/nope-1.0-r0/do_compile", "Elapsed time: 1.00 seconds\n");
+  write("2/build_stats", "Host Info: Linux\n");
+
+  auto stats = bbrd::Buildstats::Read(root.string(), 4, 2);
+  REQUIRE( stats.tasks.size() == 9 );
+  REQUIRE( stats.errors.size() == 1 );
+  REQUIRE( stats.errors[0].find("curl-7.1-r0/do_install: ")
+           != std::string::npos );
+
+  bbrd::DependencyGraph graph{bbrd::Dependencies(R"dot(
+"openssl.do_compile" -> "zlib.do_populate_sysroot"
+"curl.do_compile" -> "zlib.do_populate_sysroot"
+"zlib.do_populate_sysroot" -> "zlib.do_compile"
+"gcc-cross-i686.do_compile" -> "gcc.do_compile"
+)dot", 1, true)};
+  const auto& image = graph.image();
+  auto durations = stats.match(image);
+  REQUIRE( durations.matched == 6 );
+  REQUIRE( durations.unmatched.size() == 2 );
+  REQUIRE( durations.unmatched[0].find("gcc-12.2.0-r0/do_fetch: task")
+           != std::string::npos );
+  REQUIRE( durations.unmatched[1].find("nope-1.0-r0/do_compile: recipe")
+           != std::string::npos );
+  auto task = [&image](const char * recipe, const char * name){
+    return *image.find_task(*image.find(recipe), name);
+  };
+  REQUIRE( durations.seconds[task("zlib", "do_compile")] == Approx(5) );
+  REQUIRE( durations.seconds[task("gcc-cross-i686", "do_compile")]
+           == Approx(3) );
+
+  auto schedule = bbrd::Schedule::Compute(image.task_forward(),
+                                          image.task_reverse());
+  auto critical = bbrd::CriticalPath::Compute(
+      schedule, image.task_forward(), image.task_reverse(), durations.seconds);
+  REQUIRE( critical.length == Approx(16) );
+  REQUIRE( critical.path == bbrd::Path{task("zlib", "do_compile"),
+                                       task("zlib", "do_populate_sysroot"),
+                                       task("openssl", "do_compile")} );
+  REQUIRE( critical.slack[task("curl", "do_compile")] == Approx(8) );
+  REQUIRE( critical.slack[task("gcc", "do_compile")] == Approx(12) );
+
+  std::stringstream out;
+  graph.print_critical_path(durations.seconds, 1, out);
+  REQUIRE( out.str() ==
+           "critical path: 16.00 seconds, 3 tasks\n"
+           "  start duration task\n"
+           "  0.00 5.00 zlib:do_compile\n"
+           "  5.00 1.00 zlib:do_populate_sysroot\n"
+           "  6.00 10.00 openssl:do_compile\n"
+           "recipes:\n"
+           "  slack total recipe\n"
+           "  0.00 10.00 openssl\n"
+           "  0.00 6.00 zlib\n"
+           "  8.00 2.00 curl\n"
+           "  12.00 3.00 gcc-cross-i686\n"
+           "  12.00 1.00 gcc\n" );
+
+  REQUIRE_THROWS_AS( bbrd::Buildstats::Read((root / "missing").string()),
+                     bbrd::FileError );
+}
+
+TEST_CASE("graph-diff")
+{
+  auto old_image = bbrd::GraphImage::Build(bbrd::Dependencies(R"dot(
+"image" -> "curl"
+"curl" -> "openssl"
+"curl" -> "zlib"
+"openssl" -> "libc"
+"zlib" -> "libc"
+"gone" -> "libc"
+)dot")).with_closure(1);
+  // The same recipes in a different order, i.e. with different ids
+  auto new_image = bbrd::GraphImage::Build(bbrd::Dependencies(R"dot(
+"fresh" -> "libc"
+"zlib" -> "libc"
+"curl" -> "zlib"
+"image" -> "curl"
+"curl" -> "fresh"
+"openssl" -> "libc"
+)dot")).with_closure(1);
+
+  auto same = bbrd::GraphDiff::Compute(old_image, old_image, true);
+  REQUIRE( same.empty() );
+
+  auto diff = bbrd::GraphDiff::Compute(old_image, new_image);
+  REQUIRE( diff.added_recipes == std::vector<std::string_view>{"fresh"} );
+  REQUIRE( diff.removed_recipes == std::vector<std::string_view>{"gone"} );
+  REQUIRE( diff.added_transitive.empty() );
+
+  std::stringstream out;
+  diff.print(out);
+  REQUIRE( out.str() == "- gone\n"
+                        "+ fresh\n"
+                        "- curl -> openssl\n"
+                        "- gone -> libc\n"
+                        "+ curl -> fresh\n"
+                        "+ fresh -> libc\n" );
+
+  auto transitive = bbrd::GraphDiff::Compute(old_image, new_image, true);
+  std::stringstream transitive_out;
+  transitive.print(transitive_out);
+  REQUIRE( transitive_out.str() == out.str() +
+           "- curl ->* openssl\n"
+           "- image ->* openssl\n"
+           "+ curl ->* fresh\n"
+           "+ image ->* fresh\n" );
+
+  // Recipes whose tasks only depend on each other are not part of the diff,
+  // whether or not the images contain tasks
+  std::string lonely = "\"a.do_build\" -> \"b.do_build\"\n";
+  std::string with_lonely = lonely + "\"z.do_build\" -> \"z.do_compile\"\n";
+  for( bool tasks : {false, true} )
+  {
+    INFO("Tasks " << tasks)
+    auto without = bbrd::GraphImage::Build(
+        bbrd::Dependencies(lonely, 1, tasks));
+    auto with = bbrd::GraphImage::Build(
+        bbrd::Dependencies(with_lonely, 1, tasks));
+    REQUIRE( bbrd::GraphDiff::Compute(without, with).empty() );
+    REQUIRE( bbrd::GraphDiff::Compute(with, without).empty() );
+  }
+
+  auto without_closure = bbrd::GraphImage::Build(
+      bbrd::Dependencies(simple_dot::buffer));
+  REQUIRE_THROWS( bbrd::GraphDiff::Compute(without_closure, new_image, true) );
+}
+
+TEST_CASE("merged-graph")
+{
+  std::vector<std::string> dots = {
+    "\"a.do_x\" -> \"b.do_x\"\n\"b.do_x\" -> \"c.do_x\"\n"
+    "\"p.do_x\" -> \"q.do_x\"\n",
+    "\"a.do_x\" -> \"b.do_x\"\n\"b.do_x\" -> \"d.do_x\"\n"
+    "\"q.do_x\" -> \"r.do_x\"\n",
+    "\"x.do_x\" -> \"c.do_x\"\n\"x.do_x\" -> \"x.do_y\"\n",
+  };
+
+  auto graph = bbrd::MergedGraph::Merge(
+      {"A", "B", "C"},
+      [&dots](std::size_t source){
+        return bbrd::GraphImage::Build(bbrd::Dependencies(dots[source], 1));
+      },
+      2);
+
+  REQUIRE( graph.source_count() == 3 );
+  REQUIRE( graph.find_source("B") == 1 );
+  REQUIRE_FALSE( graph.find_source("D") );
+  REQUIRE( graph.recipe_count() == 8 );
+  REQUIRE( graph.dependency_count() == 6 );
+  // {}, {A}, {A, B}, {B}, {C} and {A, C} of recipe c
+  REQUIRE( graph.source_set_count() == 6 );
+
+  auto query = [&graph](const char * recipe,
+                        bool reverse,
+                        bool transitive,
+                        const std::vector<std::size_t>& sources){
+    std::stringstream out;
+    graph.list_recipe_depends(recipe, reverse, transitive,
+                              graph.make_source_set(sources), out);
+    return out.str();
+  };
+
+  REQUIRE( query("a", false, false, {}) == "b\tA\tB\n" );
+  REQUIRE( query("a", false, true, {}) == "b\tA\tB\nc\tA\nd\tB\n" );
+  REQUIRE( query("a", false, true, {1}) == "b\tB\nd\tB\n" );
+  REQUIRE( query("c", true, true, {}) == "a\tA\nb\tA\nx\tC\n" );
+  REQUIRE( query("c", true, false, {1}) == "" );
+  // Dependencies are only followed within the same source
+  REQUIRE( query("p", false, true, {}) == "q\tA\n" );
+  REQUIRE( query("r", true, true, {}) == "q\tB\n" );
+  REQUIRE_THROWS_AS( query("y", false, false, {}), std::runtime_error );
+  REQUIRE_THROWS_AS( graph.make_source_set({3}), std::out_of_range );
+
+  std::stringstream list;
+  graph.list(graph.make_source_set({2}), list);
+  REQUIRE( list.str() == "c\tC\nx\tC\n" );
+}
+
+TEST_CASE("export-dot")
+{
+  bbrd::DependencyGraph graph{bbrd::Dependencies(R"dot(
+"image" -> "curl"
+"image" -> "openssl"
+"image" -> "libc"
+"curl" -> "openssl"
+"curl" -> "libc"
+"openssl" -> "libc"
+"openssl" -> "perl"
+"perl" -> "openssl"
+"perl" -> "libc"
+)dot")};
+
+  std::stringstream full;
+  graph.export_dot(false, 1, full);
+  REQUIRE( full.str() == "digraph depends {\n"
+                         "\"image\"\n"
+                         "\"curl\"\n"
+                         "\"openssl\"\n"
+                         "\"libc\"\n"
+                         "\"perl\"\n"
+                         "\"image\" -> \"curl\"\n"
+                         "\"image\" -> \"openssl\"\n"
+                         "\"image\" -> \"libc\"\n"
+                         "\"curl\" -> \"openssl\"\n"
+                         "\"curl\" -> \"libc\"\n"
+                         "\"openssl\" -> \"libc\"\n"
+                         "\"openssl\" -> \"perl\"\n"
+                         "\"perl\" -> \"openssl\"\n"
+                         "\"perl\" -> \"libc\"\n"
+                         "}\n" );
+
+  // The cycle between openssl and perl is kept, one dependency on libc is
+  // kept for both of them
+  std::stringstream reduced;
+  graph.export_dot(true, 1, reduced);
+  REQUIRE( reduced.str() == "digraph depends {\n"
+                            "\"image\"\n"
+                            "\"curl\"\n"
+                            "\"openssl\"\n"
+                            "\"libc\"\n"
+                            "\"perl\"\n"
+                            "\"image\" -> \"curl\"\n"
+                            "\"curl\" -> \"openssl\"\n"
+                            "\"openssl\" -> \"libc\"\n"
+                            "\"openssl\" -> \"perl\"\n"
+                            "\"perl\" -> \"openssl\"\n"
+                            "}\n" );
+
+  // The reduction of a random graph has the same transitive dependencies,
+  // independent of the number of threads
+  std::string dot;
+  std::uint32_t random = 7;
+  for(int i = 0; i < 3000; ++i)
+  {
+    random = random * 1103515245 + 12345;
+    auto to = (random >> 8) % 1000;
+    random = random * 1103515245 + 12345;
+    // Mostly acyclic, with a few cycles
+    auto from = ( (random >> 8) % 50 == 0 ) ? (random >> 16) % 1000
+                                            : to + 1 + (random >> 8) % 40;
+    dot += "\"r" + std::to_string(to) + "\" -> \"r"
+         + std::to_string(from % 1000) + "\"\n";
+  }
+  bbrd::DependencyGraph random_graph{bbrd::Dependencies(dot)};
+  std::stringstream sequential;
+  random_graph.export_dot(true, 1, sequential);
+  std::stringstream parallel;
+  random_graph.export_dot(true, 4, parallel);
+  REQUIRE( sequential.str() == parallel.str() );
+
+  auto original = random_graph.image().with_closure(1);
+  auto reduction = bbrd::GraphImage::Build(
+      bbrd::Dependencies(sequential.str())).with_closure(1);
+  REQUIRE( reduction.recipe_count() == original.recipe_count() );
+  REQUIRE( reduction.dependency_count() < original.dependency_count() );
+  std::size_t differences = 0;
+  for(bbrd::GraphImage::Id v = 0; v < original.recipe_count(); ++v)
+  {
+    auto reduced_v = *reduction.find(original.recipe_name(v));
+    for(bbrd::GraphImage::Id w = 0; w < original.recipe_count(); ++w)
+    {
+      auto reduced_w = *reduction.find(original.recipe_name(w));
+      if( original.forward_closure().reaches(v, w) !=
+          reduction.forward_closure().reaches(reduced_v, reduced_w) )
+        differences++;
+    }
+  }
+  REQUIRE( differences == 0 );
+}
+
+TEST_CASE("stats")
+{
+  std::string dot = R"dot(digraph depends {
+"a.do_build" [label="a do_build"]
+"a.do_build" -> "a.do_compile"
+"a.do_build" -> "b.do_build"
+"a.do_compile" -> "b.do_build"
+"b.do_build" -> "c.do_build"
+}
+)dot";
+
+  // Dependencies within a recipe are parsed, but not kept
+  for(unsigned threads : {1u, 2u})
+  {
+    bbrd::Dependencies dependencies(dot, threads);
+    REQUIRE( dependencies.input_size() == dot.size() );
+    REQUIRE( dependencies.input() == dot );
+    REQUIRE( dependencies.parsed_dependency_count() == 4 );
+    REQUIRE( dependencies.task_dependency_count() == 3 );
+    REQUIRE( std::distance(dependencies.begin(), dependencies.end()) == 2 );
+    REQUIRE( dependencies.recipe_table_load() > 0.0 );
+    REQUIRE( dependencies.recipe_table_load() < 1.0 );
+  }
+
+  bbrd::Stats stats;
+  {
+    bbrd::Stats::Timer timer(&stats, "parse", "in \"quotes\".dot");
+  }
+  std::thread([&stats](){
+    bbrd::Stats::Timer timer(&stats, "query");
+  }).join();
+  {
+    // Without stats nothing is recorded
+    bbrd::Stats::Timer timer(nullptr, "ignored");
+  }
+  stats.add_counter("recipes", "in \"quotes\".dot", 3);
+
+  auto phases = stats.phases();
+  REQUIRE( phases.size() == 2 );
+  REQUIRE( phases[0].name == "parse" );
+  REQUIRE( phases[0].thread == 0 );
+  REQUIRE( phases[1].name == "query" );
+  REQUIRE( phases[1].thread == 1 );
+  REQUIRE( phases[1].begin_us >= phases[0].begin_us );
+
+  std::stringstream text;
+  stats.print(text);
+  REQUIRE( text.str().find("parse") != std::string::npos );
+  REQUIRE( text.str().find("peak rss bytes") != std::string::npos );
+
+  std::stringstream json;
+  stats.print_json(json);
+  REQUIRE( json.str().find(
+      "{\"name\":\"recipes\",\"input\":\"in \\\"quotes\\\".dot\","
+      "\"value\":3}") != std::string::npos );
+
+  std::stringstream trace;
+  stats.write_trace(trace);
+  REQUIRE( trace.str().find("\"ph\":\"X\"") != std::string::npos );
+  REQUIRE( trace.str().find("\"tid\":1") != std::string::npos );
+}
+
+
+TEST_CASE("graph-cache")
+{
+  TempFile file(simple_dot::buffer);
+  const auto& path = file.path();
+
+  auto stamp = bbrd::ReadFileStampOrThrow(path);
+  REQUIRE( stamp.size == std::string_view(simple_dot::buffer).size() );
+  REQUIRE( stamp == bbrd::ReadFileStampOrThrow(path) );
+
+  auto cache_path = bbrd::GraphCachePath(path, stamp);
+  REQUIRE( !bbrd::LoadGraphCache(cache_path, stamp).has_value() );
+
+  bbrd::WriteGraphCache(
+      cache_path,
+      bbrd::GraphImage::Build(bbrd::Dependencies(simple_dot::buffer), stamp));
+  auto image = bbrd::LoadGraphCache(cache_path, stamp);
+  REQUIRE( image.has_value() );
+  REQUIRE( image->source() == stamp );
+
+  bbrd::DependencyGraph graph(std::move(*image));
+  std::stringstream sstream;
+  graph.list_adjacent_recipes("boost", false, sstream);
+  REQUIRE( sstream.str() == "libc\n" );
+
+  // A cache of a different version of the file is not used
+  file.append("\"a\" -> \"b\"\n");
+  auto new_stamp = bbrd::ReadFileStampOrThrow(path);
+  REQUIRE( new_stamp != stamp );
+  REQUIRE( !bbrd::LoadGraphCache(cache_path, new_stamp).has_value() );
+
+  std::remove(cache_path.c_str());
+
+  // The cache moves to the directory of the user if it cannot be written
+  // next to the file
+  REQUIRE( bbrd::DefaultGraphCacheDir(path).empty() );
+  REQUIRE( !bbrd::DefaultGraphCacheDir("/nonexistent/dir/task-depends.dot")
+              .empty() );
+}
+
+TEST_CASE("graph-cache-tasks")
+{
+  TempFile file("\"a.do_build\" -> \"b.do_build\"\n"
+                "\"z.do_build\" -> \"z.do_compile\"\n");
+  const auto& path = file.path();
+
+  auto query = [&path](bool tasks, bool cache, const char * recipe){
+    bbrd::ReadGraphOptions options;
+    options.thread_count = 1;
+    options.tasks = tasks;
+    options.cache = cache;
+    bbrd::DependencyGraph graph(bbrd::ReadGraphImage(path, options));
+    std::stringstream out;
+    try
+    {
+      graph.list_recipe_depends(recipe, false, out);
+    }
+    catch( const std::runtime_error& e )
+    {
+      out << "error: " << e.what();
+    }
+    graph.list(out);
+    return std::make_pair(graph.image().has_tasks(), out.str());
+  };
+
+  // A cached image with tasks answers recipe queries like one without
+  for( const char * recipe : {"a", "z"} )
+  {
+    INFO("Recipe " << recipe)
+    auto expected = query(false, false, recipe);
+    REQUIRE( !expected.first );
+    REQUIRE( query(true, true, recipe).first );
+    auto cached = query(false, true, recipe);
+    REQUIRE( cached.first );
+    REQUIRE( cached.second == expected.second );
+  }
+  REQUIRE( query(false, false, "z").second ==
+           "error: recipe not found: za\nb\n" );
+
+  // So does the C interface
+  auto graph = bbrd_graph_open(path.c_str(), nullptr, 0, 1);
+  REQUIRE( graph );
+  bbrd_id id = 0;
+  REQUIRE( bbrd_find_recipe(graph, "z", 1, &id) == -1 );
+  std::string recipes;
+  for( bbrd_id i = 0; i < bbrd_recipe_count(graph); ++i )
+  {
+    bbrd_string name{nullptr, 0};
+    bbrd_ids ids{nullptr, 0};
+    bool exists = bbrd_recipe_name(graph, i, &name) == 0;
+    REQUIRE( ( bbrd_adjacent_recipes(graph, i, 0, &ids) == 0 ) == exists );
+    if( exists )
+      recipes.append(name.data, name.size).append("\n");
+  }
+  REQUIRE( recipes == "a\nb\n" );
+  bbrd_graph_close(graph);
+
+  std::remove(bbrd::GraphCachePath(path, bbrd::ReadFileStampOrThrow(path))
+                  .c_str());
+}
+
+TEST_CASE("c-api")
+{
+  TempFile file(simple_dot::buffer);
+  const auto& path = file.path();
+
+  REQUIRE( bbrd_graph_open("/nonexistent.dot", nullptr, BBRD_NO_CACHE, 1)
+             == nullptr );
+  REQUIRE( std::string(bbrd_last_error()).find("nonexistent")
+             != std::string::npos );
+
+  bbrd::DependencyGraph expected{bbrd::Dependencies(simple_dot::buffer)};
+  const std::vector<unsigned> flag_sets = {BBRD_NO_CACHE,
+                                           BBRD_NO_CACHE | BBRD_CLOSURE};
+  for( auto flags : flag_sets )
+  {
+    INFO("Flags " << flags)
+    auto graph = bbrd_graph_open(path.c_str(), nullptr, flags, 1);
+    REQUIRE( graph );
+    REQUIRE( bbrd_recipe_count(graph) == expected.image().recipe_count() );
+    REQUIRE( bbrd_dependency_count(graph)
+               == expected.image().dependency_count() );
+
+    auto names = [graph](bbrd_ids ids){
+      std::string joined;
+      for( std::size_t i = 0; i < ids.count; ++i )
+      {
+        bbrd_string name{nullptr, 0};
+        REQUIRE( bbrd_recipe_name(graph, ids.ids[i], &name) == 0 );
+        joined.append(name.data, name.size).append("\n");
+      }
+      return joined;
+    };
+
+    for( bool reverse : {false, true} )
+      for( std::string recipe : {"htmlext", "libc", "boost-regex"} )
+      {
+        bbrd_id id = 0;
+        REQUIRE( bbrd_find_recipe(graph, recipe.data(), recipe.size(), &id)
+                   == 0 );
+
+        std::stringstream adjacent;
+        expected.list_adjacent_recipes(recipe, reverse, adjacent);
+        bbrd_ids ids{nullptr, 0};
+        REQUIRE( bbrd_adjacent_recipes(graph, id, reverse, &ids) == 0 );
+        REQUIRE( names(ids) == adjacent.str() );
+
+        std::stringstream transitive;
+        expected.list_recipe_depends(recipe, reverse, transitive);
+        REQUIRE( bbrd_transitive_recipes(graph, id, reverse, &ids) == 0 );
+        auto transitive_names = names(ids);
+        bbrd_ids_free(ids);
+        REQUIRE( transitive_names == transitive.str() );
+      }
+
+    bbrd_id image = 0;
+    bbrd_id libc = 0;
+    REQUIRE( bbrd_find_recipe(graph, "image", 5, &image) == 0 );
+    REQUIRE( bbrd_find_recipe(graph, "libc", 4, &libc) == 0 );
+    REQUIRE( bbrd_depends_on(graph, image, libc) == 1 );
+    REQUIRE( bbrd_depends_on(graph, libc, image) == 0 );
+
+    // Errors
+    bbrd_id id = 0;
+    REQUIRE( bbrd_find_recipe(graph, "lib", 3, &id) == -1 );
+    REQUIRE( std::string(bbrd_last_error()) == "recipe not found: lib" );
+    auto missing = static_cast<bbrd_id>(bbrd_recipe_count(graph));
+    bbrd_ids ids{nullptr, 0};
+    bbrd_string name{nullptr, 0};
+    REQUIRE( bbrd_adjacent_recipes(graph, missing, 0, &ids) == -1 );
+    REQUIRE( bbrd_transitive_recipes(graph, missing, 1, &ids) == -1 );
+    REQUIRE( bbrd_recipe_name(graph, missing, &name) == -1 );
+    REQUIRE( bbrd_depends_on(graph, image, missing) == -1 );
+
+    bbrd_graph_close(graph);
+  }
+}
+
+TEST_CASE("parse-query")
+{
+  REQUIRE( !bbrd::ParseQuery("").has_value() );
+  REQUIRE( !bbrd::ParseQuery("  \t").has_value() );
+  REQUIRE( !bbrd::ParseQuery("# rdeps openssl").has_value() );
+
+  auto query = bbrd::ParseQuery("openssl");
+  REQUIRE( query.has_value() );
+  REQUIRE( query->recipe == "openssl" );
+  REQUIRE( !query->reverse );
+  REQUIRE( !query->transitive );
+
+  query = bbrd::ParseQuery(" rdeps  -t openssl ");
+  REQUIRE( query.has_value() );
+  REQUIRE( query->recipe == "openssl" );
+  REQUIRE( query->reverse );
+  REQUIRE( query->transitive );
+
+  query = bbrd::ParseQuery("-tr openssl");
+  REQUIRE( query.has_value() );
+  REQUIRE( query->reverse );
+  REQUIRE( query->transitive );
+
+  query = bbrd::ParseQuery("deps -d curl");
+  REQUIRE( query.has_value() );
+  REQUIRE( !query->reverse );
+
+  REQUIRE_THROWS_AS( bbrd::ParseQuery("rdeps"), bbrd::QueryError );
+  REQUIRE_THROWS_AS( bbrd::ParseQuery("-dr curl"), bbrd::QueryError );
+  REQUIRE_THROWS_AS( bbrd::ParseQuery("deps -r curl"), bbrd::QueryError );
+  REQUIRE_THROWS_AS( bbrd::ParseQuery("-x curl"), bbrd::QueryError );
+  REQUIRE_THROWS_AS( bbrd::ParseQuery("curl wget"), bbrd::QueryError );
+}
+
+TEST_CASE("batch-query")
+{
+  auto graph = bbrd::DependencyGraph(bbrd::Dependencies(simple_dot::buffer));
+
+  std::string queries = "rdeps libc\n"
+                        "\n"
+                        "# comment\n"
+                        "  -t boost-regex\n"
+                        "nope\n"
+                        "deps htmlext\n";
+
+  // Answers are in input order, regardless of the number of threads
+  for( unsigned thread_count = 1; thread_count < 5; ++thread_count )
+  {
+    INFO("Thread count " << thread_count)
+    std::istringstream in(queries);
+    std::ostringstream out;
+    REQUIRE( bbrd::RunBatch(graph, in, out, thread_count) == 1 );
+    REQUIRE( out.str() == "# rdeps libc\n"
+                          "boost\n"
+                          "# -t boost-regex\n"
+                          "boost\n"
+                          "libc\n"
+                          "# nope\n"
+                          "# error: recipe not found: nope\n"
+                          "# deps htmlext\n"
+                          "libhext\n"
+                          "boost-program-options\n" );
+  }
+}
+
+TEST_CASE("graph-server")
+{
+  TempFile file(simple_dot::buffer);
+  const auto& path = file.path();
+
+  std::string socket_path = path + ".sock";
+  bbrd::ErrorOutput errout("graph-server");
+  auto load = [&path](){
+    return bbrd::DependencyGraph(
+        bbrd::Dependencies(bbrd::ReadFileOrThrow(path)));
+  };
+
+  bbrd::GraphServer server(socket_path, path, load, errout);
+  std::thread server_thread(&bbrd::GraphServer::run, &server);
+
+  // A second server on the same socket is refused
+  REQUIRE_THROWS_AS( bbrd::GraphServer(socket_path, path, load, errout),
+                     bbrd::ServerError );
+
+  auto query = [&socket_path](const std::string& q){
+    std::ostringstream out;
+    bbrd::QueryServer(socket_path, q, out);
+    return out.str();
+  };
+
+  // Answers are the same as without a server
+  auto graph = load();
+  for( std::string q : {"-d htmlext", "-r libc", "-tr boost-regex", "htmlext"} )
+  {
+    INFO("Query " << q)
+    auto parsed = bbrd::ParseQuery(q);
+    std::ostringstream expected;
+    bbrd::RunQuery(graph, *parsed, expected);
+    REQUIRE( query(q) == expected.str() );
+  }
+
+  std::ostringstream all;
+  graph.list(all);
+  REQUIRE( query("") == all.str() );
+  REQUIRE_THROWS_AS( query("-d nope"), bbrd::ServerError );
+
+  // More clients than connections that are served at the same time
+  {
+    auto expected = query("-d htmlext");
+    std::vector<std::string> answers(200);
+    std::vector<std::thread> clients;
+    for( auto& answer : answers )
+      clients.emplace_back([&query, &answer]{ answer = query("-d htmlext"); });
+    for( auto& client : clients )
+      client.join();
+    for( const auto& answer : answers )
+      REQUIRE( answer == expected );
+  }
+
+  // The graph is reloaded when the file changes
+  file.append("\"libc\" -> \"kernel\"\n");
+  for( int i = 0; i < 500 && server.reload_count() == 0; ++i )
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  REQUIRE( server.reload_count() > 0 );
+  REQUIRE( query("-d libc") == "kernel\n" );
+
+  server.stop();
+  server_thread.join();
+}